@@ -0,0 +1,511 @@
+#include "batch.h"
+#include "verifier.h"
+#include "vm.h"
+#include <algorithm>
+#include <sstream>
+
+// Операции над словами для пакетного выполнения. Каждая операция - отдельный тип,
+// чтобы циклы по экземплярам не содержали ветвлений и векторизовались.
+struct AddOperation
+{
+	int operator()(int left, int right) const { return addValues(left, right); }
+};
+
+struct SubOperation
+{
+	int operator()(int left, int right) const { return subtractValues(left, right); }
+};
+
+struct MultOperation
+{
+	int operator()(int left, int right) const { return multiplyValues(left, right); }
+};
+
+struct EqualOperation
+{
+	int operator()(int left, int right) const { return left == right; }
+};
+
+struct NotEqualOperation
+{
+	int operator()(int left, int right) const { return left != right; }
+};
+
+struct LessOperation
+{
+	int operator()(int left, int right) const { return left < right; }
+};
+
+struct GreaterOperation
+{
+	int operator()(int left, int right) const { return left > right; }
+};
+
+struct LessEqualOperation
+{
+	int operator()(int left, int right) const { return left <= right; }
+};
+
+struct GreaterEqualOperation
+{
+	int operator()(int left, int right) const { return left >= right; }
+};
+
+struct AndOperation
+{
+	int operator()(int left, int right) const { return left != 0 && right != 0; }
+};
+
+struct OrOperation
+{
+	int operator()(int left, int right) const { return left != 0 || right != 0; }
+};
+
+struct XorOperation
+{
+	int operator()(int left, int right) const { return (left != 0) != (right != 0); }
+};
+
+struct ImpliesOperation
+{
+	int operator()(int left, int right) const { return left == 0 || right != 0; }
+};
+
+struct InvertOperation
+{
+	int operator()(int value) const { return negateValue(value); }
+};
+
+struct NotOperation
+{
+	int operator()(int value) const { return value == 0; }
+};
+
+// left[l] := op(left[l], right[l]) для экземпляров из active
+// (или для всех n экземпляров, если активны все)
+template<class Operation>
+static void binary(int* left, const int* right, const vector<int>& active, int n, Operation op)
+{
+	if((int) active.size() == n) {
+		for(int l = 0; l < n; ++l) {
+			left[l] = op(left[l], right[l]);
+		}
+	}
+	else {
+		for(size_t k = 0; k < active.size(); ++k) {
+			int l = active[k];
+			left[l] = op(left[l], right[l]);
+		}
+	}
+}
+
+// value[l] := op(value[l])
+template<class Operation>
+static void unary(int* value, const vector<int>& active, int n, Operation op)
+{
+	if((int) active.size() == n) {
+		for(int l = 0; l < n; ++l) {
+			value[l] = op(value[l]);
+		}
+	}
+	else {
+		for(size_t k = 0; k < active.size(); ++k) {
+			int l = active[k];
+			value[l] = op(value[l]);
+		}
+	}
+}
+
+// to[l] := from[l]
+static void copy(int* to, const int* from, const vector<int>& active, int n)
+{
+	if((int) active.size() == n) {
+		for(int l = 0; l < n; ++l) {
+			to[l] = from[l];
+		}
+	}
+	else {
+		for(size_t k = 0; k < active.size(); ++k) {
+			int l = active[k];
+			to[l] = from[l];
+		}
+	}
+}
+
+// to[l] := value
+static void fill(int* to, int value, const vector<int>& active, int n)
+{
+	if((int) active.size() == n) {
+		for(int l = 0; l < n; ++l) {
+			to[l] = value;
+		}
+	}
+	else {
+		for(size_t k = 0; k < active.size(); ++k) {
+			to[active[k]] = value;
+		}
+	}
+}
+
+// Сравнение с кодом cmp (см. инструкцию COMPARE)
+static void compare(int cmp, int* left, const int* right, const vector<int>& active, int n)
+{
+	switch(cmp) {
+		case 0:
+			binary(left, right, active, n, EqualOperation());
+			break;
+		case 1:
+			binary(left, right, active, n, NotEqualOperation());
+			break;
+		case 2:
+			binary(left, right, active, n, LessOperation());
+			break;
+		case 3:
+			binary(left, right, active, n, GreaterOperation());
+			break;
+		case 4:
+			binary(left, right, active, n, LessEqualOperation());
+			break;
+		case 5:
+			binary(left, right, active, n, GreaterEqualOperation());
+			break;
+		default:
+			fill(left, 0, active, n);
+			break;
+	}
+}
+
+BatchMachine::BatchMachine(const vector<Command>& program, const vector<vector<int> >& inputs)
+	: program_(program), inputs_(inputs), lanes_(inputs.size()), executed_(0), dispatches_(0)
+{
+}
+
+void BatchMachine::fail(int lane, int address, const string& message)
+{
+	ostringstream os;
+	os << "Runtime error at " << address << ": " << message;
+	errors_[lane] = os.str();
+	pc_[lane] = -1;
+}
+
+bool BatchMachine::run()
+{
+	int n = lanes_;
+	int size = program_.size();
+	ProgramInfo info;
+	if(!verifyProgram(program_, info)) {
+		cerr << "Verification error at " << info.errorAddress << ": " << info.error << endl;
+		return false;
+	}
+	for(int i = 0; i < size; ++i) {
+		if(program_[i].getInstruction() > IMPLIES) {
+			cerr << "Superinstructions are not supported in batch mode" << endl;
+			return false;
+		}
+	}
+
+	memory_.assign((size_t) info.memorySize * n, 0);
+	stack_.assign((size_t) (info.maxStackDepth + 1) * n, 0);
+	pc_.assign(n, 0);
+	read_.assign(n, 0);
+	outputs_.assign(n, vector<int>());
+	errors_.assign(n, string());
+	executed_ = 0;
+	dispatches_ = 0;
+
+	// active - экземпляры, выполняющие инструкцию pc; waiting - экземпляры, ожидающие
+	// на других адресах (их адреса в pc_), minWaiting - наименьший из этих адресов
+	vector<int> active;
+	vector<int> waiting;
+	vector<int> taken;
+	for(int l = 0; l < n; ++l) {
+		active.push_back(l);
+	}
+	int minWaiting = size;
+	int pc = 0;
+	int* s = stack_.empty() ? 0 : &stack_[0];
+	int* memory = memory_.empty() ? 0 : &memory_[0];
+
+	while(!active.empty()) {
+		const Command& c = program_[pc];
+		int depth = info.stackDepth[pc];
+		int* push = s + depth * n;                            // новое слово
+		int* top = depth >= 1 ? push - n : s;                 // вершина стека
+		int* below = depth >= 2 ? push - 2 * n : s;           // слово под вершиной
+		int next = pc + 1;
+		bool failed = false;
+
+		++dispatches_;
+		executed_ += active.size();
+		taken.clear();
+
+		switch(c.getInstruction()) {
+			case NOP:
+				break;
+
+			case STOP:
+				for(size_t k = 0; k < active.size(); ++k) {
+					pc_[active[k]] = -1;
+				}
+				active.clear();
+				break;
+
+			case LOAD:
+				copy(push, memory + c.getArg() * n, active, n);
+				break;
+
+			case STORE:
+				copy(memory + c.getArg() * n, top, active, n);
+				break;
+
+			case BLOAD:
+			case BSTORE:
+			case BLOAD_UNCHECKED:
+			case BSTORE_UNCHECKED:
+				for(size_t k = 0; k < active.size(); ++k) {
+					int l = active[k];
+					int address = c.getArg() + top[l];
+					if((c.getInstruction() == BLOAD || c.getInstruction() == BSTORE)
+						&& (unsigned) top[l] >= (unsigned) c.getArg2()) {
+						fail(l, pc, "array index out of range");
+						failed = true;
+					}
+					else if(c.getInstruction() == BLOAD || c.getInstruction() == BLOAD_UNCHECKED) {
+						top[l] = memory[address * n + l];
+					}
+					else {
+						memory[address * n + l] = below[l];
+					}
+				}
+				break;
+
+			case PUSH:
+				fill(push, c.getArg(), active, n);
+				break;
+
+			case POP:
+				break;
+
+			case DUP:
+				copy(push, top, active, n);
+				break;
+
+			case ADD:
+				binary(below, top, active, n, AddOperation());
+				break;
+
+			case SUB:
+				binary(below, top, active, n, SubOperation());
+				break;
+
+			case MULT:
+				binary(below, top, active, n, MultOperation());
+				break;
+
+			case DIV:
+				for(size_t k = 0; k < active.size(); ++k) {
+					int l = active[k];
+					if(top[l] == 0) {
+						fail(l, pc, "division by zero");
+						failed = true;
+					}
+					else {
+						below[l] = divideValues(below[l], top[l]);
+					}
+				}
+				break;
+
+			case INVERT:
+				unary(top, active, n, InvertOperation());
+				break;
+
+			case COMPARE:
+				compare(c.getArg(), below, top, active, n);
+				break;
+
+			case JUMP:
+				next = c.getArg();
+				break;
+
+			case JUMP_YES:
+			case JUMP_NO:
+			{
+				// экземпляры, для которых переход выполняется, уходят в taken
+				bool yes = c.getInstruction() == JUMP_YES;
+				size_t kept = 0;
+				for(size_t k = 0; k < active.size(); ++k) {
+					int l = active[k];
+					if((top[l] != 0) == yes) {
+						taken.push_back(l);
+					}
+					else {
+						active[kept++] = l;
+					}
+				}
+				active.resize(kept);
+				break;
+			}
+
+			case INPUT:
+				for(size_t k = 0; k < active.size(); ++k) {
+					int l = active[k];
+					if(read_[l] >= inputs_[l].size()) {
+						fail(l, pc, "integer input expected");
+						failed = true;
+					}
+					else {
+						push[l] = inputs_[l][read_[l]++];
+					}
+				}
+				break;
+
+			case PRINT:
+				for(size_t k = 0; k < active.size(); ++k) {
+					outputs_[active[k]].push_back(top[active[k]]);
+				}
+				break;
+
+			case AND:
+				binary(below, top, active, n, AndOperation());
+				break;
+
+			case OR:
+				binary(below, top, active, n, OrOperation());
+				break;
+
+			case NOT:
+				unary(top, active, n, NotOperation());
+				break;
+
+			case XOR:
+				binary(below, top, active, n, XorOperation());
+				break;
+
+			case IMPLIES:
+				binary(below, top, active, n, ImpliesOperation());
+				break;
+
+			default:
+				for(size_t k = 0; k < active.size(); ++k) {
+					fail(active[k], pc, "illegal instruction");
+				}
+				active.clear();
+				break;
+		}
+
+		if(failed) {
+			size_t kept = 0;
+			for(size_t k = 0; k < active.size(); ++k) {
+				if(pc_[active[k]] >= 0) {
+					active[kept++] = active[k];
+				}
+			}
+			active.resize(kept);
+		}
+
+		// Экземпляры, выполнившие переход, ждут на его адресе
+		if(!taken.empty()) {
+			for(size_t k = 0; k < taken.size(); ++k) {
+				pc_[taken[k]] = c.getArg();
+				waiting.push_back(taken[k]);
+			}
+			if(c.getArg() < minWaiting) {
+				minWaiting = c.getArg();
+			}
+		}
+
+		// Выбор следующей группы: выполняется группа с наименьшим адресом,
+		// группы на одном адресе сливаются
+		if(!active.empty() && next < minWaiting) {
+			pc = next;
+			continue;
+		}
+		if(waiting.empty()) {
+			pc = next;
+			continue;
+		}
+		if(!active.empty()) {
+			for(size_t k = 0; k < active.size(); ++k) {
+				pc_[active[k]] = next;
+				waiting.push_back(active[k]);
+			}
+			if(next < minWaiting) {
+				minWaiting = next;
+			}
+			active.clear();
+		}
+
+		pc = minWaiting;
+		minWaiting = size;
+		size_t kept = 0;
+		for(size_t k = 0; k < waiting.size(); ++k) {
+			int l = waiting[k];
+			if(pc_[l] == pc) {
+				active.push_back(l);
+			}
+			else {
+				waiting[kept++] = l;
+				if(pc_[l] < minWaiting) {
+					minWaiting = pc_[l];
+				}
+			}
+		}
+		waiting.resize(kept);
+	}
+
+	for(int l = 0; l < n; ++l) {
+		if(!errors_[l].empty()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool readColumns(istream& input, vector<vector<int> >& inputs)
+{
+	inputs.clear();
+	string line;
+	bool first = true;
+	while(getline(input, line)) {
+		istringstream row(line);
+		vector<int> values;
+		int value;
+		while(row >> value) {
+			values.push_back(value);
+		}
+		if(!row.eof()) {
+			return false;
+		}
+		if(values.empty()) {
+			continue;
+		}
+		if(first) {
+			inputs.resize(values.size());
+			first = false;
+		}
+		for(size_t l = 0; l < values.size() && l < inputs.size(); ++l) {
+			inputs[l].push_back(values[l]);
+		}
+	}
+	return true;
+}
+
+void printColumns(ostream& output, const BatchMachine& machine, int lanes)
+{
+	size_t rows = 0;
+	for(int l = 0; l < lanes; ++l) {
+		rows = max(rows, machine.getOutput(l).size());
+	}
+	for(size_t r = 0; r < rows; ++r) {
+		for(int l = 0; l < lanes; ++l) {
+			if(l > 0) {
+				output << '\t';
+			}
+			if(r < machine.getOutput(l).size()) {
+				output << machine.getOutput(l)[r];
+			}
+		}
+		output << '\n';
+	}
+	output.flush();
+}
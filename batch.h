@@ -0,0 +1,90 @@
+#ifndef CMILAN_BATCH_H
+#define CMILAN_BATCH_H
+
+#include "codegen.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Пакетное выполнение программы (cmilan --run --batch файл).
+//
+// Одна программа выполняется сразу для многих наборов входных данных (экземпляров).
+// Экземпляры, стоящие на одной инструкции, выполняют ее вместе: каждая инструкция
+// становится циклом по экземплярам, а стек и память хранятся по столбцам
+// (слово с номером k всех экземпляров лежит подряд), так что компилятор может
+// векторизовать эти циклы. Глубина стека в каждой точке программы известна после
+// проверки (см. verifier.h), поэтому у всех экземпляров на одной инструкции она одинакова.
+//
+// Условный переход разделяет экземпляры на две группы. Выполняется группа с наименьшим
+// адресом инструкции, остальные ждут; когда выполняемая группа доходит до адреса
+// ожидающей, группы сливаются. В структурированном коде Милана это происходит в конце
+// if и после выхода всех экземпляров из цикла while.
+//
+// Входной файл - таблица целых чисел: строка k содержит k-е прочитанное значение
+// для каждого экземпляра, количество столбцов первой строки задает количество экземпляров.
+// Результат печатается так же: строка k содержит k-е напечатанные значения через
+// табуляцию (пустое поле, если экземпляр напечатал меньше значений).
+
+class BatchMachine
+{
+public:
+	// Конструктор
+	//    const vector<Command>& program - выполняемая программа (без суперинструкций)
+	//    const vector<vector<int> >& inputs - входные данные каждого экземпляра
+	BatchMachine(const vector<Command>& program, const vector<vector<int> >& inputs);
+
+	// Выполнение всех экземпляров. Возвращает false, если программа не прошла
+	// проверку или хотя бы один экземпляр завершился ошибкой.
+	bool run();
+
+	// Значения, напечатанные экземпляром instance
+	const vector<int>& getOutput(int instance) const
+	{
+		return outputs_[instance];
+	}
+
+	// Сообщение об ошибке экземпляра instance (пустое, если ошибки не было)
+	const string& getError(int instance) const
+	{
+		return errors_[instance];
+	}
+
+	// Количество выполненных инструкций (по всем экземплярам)
+	long long getExecutedCount() const
+	{
+		return executed_;
+	}
+
+	// Количество диспетчеризаций: сколько раз инструкция выполнялась для группы экземпляров
+	long long getDispatchCount() const
+	{
+		return dispatches_;
+	}
+
+private:
+	// Завершение экземпляра lane с ошибкой
+	void fail(int lane, int address, const string& message);
+
+	const vector<Command>& program_;     // выполняемая программа
+	const vector<vector<int> >& inputs_; // входные данные экземпляров
+	int lanes_;                          // количество экземпляров
+	vector<int> memory_;                 // память: ячейка cell экземпляра l - [cell * lanes_ + l]
+	vector<int> stack_;                  // стек: слово d экземпляра l - [d * lanes_ + l]
+	vector<int> pc_;                     // адрес следующей инструкции каждого экземпляра
+	vector<size_t> read_;                // количество прочитанных значений каждого экземпляра
+	vector<vector<int> > outputs_;       // напечатанные значения
+	vector<string> errors_;              // ошибки выполнения
+	long long executed_;                 // количество выполненных инструкций
+	long long dispatches_;               // количество диспетчеризаций
+};
+
+// Чтение таблицы входных данных по столбцам: inputs[l] - значения экземпляра l.
+// Возвращает false, если в таблице есть что-то кроме целых чисел.
+bool readColumns(istream& input, vector<vector<int> >& inputs);
+
+// Печать результатов пакетного выполнения по столбцам
+void printColumns(ostream& output, const BatchMachine& machine, int lanes);
+
+#endif
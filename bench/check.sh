@@ -0,0 +1,86 @@
+#!/bin/sh
+# Быстрая проверка согласованности режимов компилятора и машин (make check).
+#
+# Программы из milangen (SEEDS программ по STATEMENTS операторов с разной глубиной
+# вложенности, без ввода) и программы из bench/check выполняются без опций и во всех
+# конфигурациях из списка ниже; вывод и код возврата каждого запуска должны совпасть с выводом запуска без
+# опций. Для программ из bench/check они, кроме того, сравниваются с записанными в
+# name.out (последняя строка - код возврата); вход программы берется из name.in, если
+# он есть. Сообщения об ошибках выполнения содержат адреса инструкций, разные в разных
+# конфигурациях, поэтому не сравниваются. Код каждой программы, напечатанный по мере
+# генерации (--stream), должен побайтно совпасть с буферизованным.
+# Печатаются несовпавшие запуски; код возврата ненулевой, если такие есть.
+#
+# Использование: bench/check.sh
+# Переменные окружения: CMILAN, MILANGEN - пути к программам,
+#                       SEEDS - количество программ, STATEMENTS - их размер.
+
+CMILAN=${CMILAN:-./cmilan}
+MILANGEN=${MILANGEN:-./milangen}
+SEEDS=${SEEDS:-30}
+STATEMENTS=${STATEMENTS:-300}
+DIR=$(dirname "$0")/check
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# Вывод программы $1 со входом из файла $2, запущенной с опциями $3, и код возврата
+run() {
+	$CMILAN $3 --run "$1" < "$2" 2> /dev/null
+	echo "exit $?"
+}
+
+# Сравнение вывода программы $1 со входом $2 во всех конфигурациях с файлом $3
+compare() {
+	for options in "-O" "--fuse" "-O --fuse" "--cache-top" "-O --fuse --cache-top" \
+		"--target=reg" "-O --target=reg"; do
+		run "$1" "$2" "$options" > "$TMP/output"
+		if ! cmp -s "$TMP/output" "$3"; then
+			echo "$1: the run with $options differs from $3"
+			failed=$((failed + 1))
+		fi
+		checked=$((checked + 1))
+	done
+}
+
+# Сравнение кода программы $1, напечатанного с --stream, с буферизованным
+stream() {
+	$CMILAN "$1" > "$TMP/code" 2>&1
+	$CMILAN --stream "$1" > "$TMP/streamed" 2>&1
+	if ! cmp -s "$TMP/streamed" "$TMP/code"; then
+		echo "$1: the code printed with --stream differs from the buffered code"
+		failed=$((failed + 1))
+	fi
+	checked=$((checked + 1))
+}
+
+failed=0
+checked=0
+seed=1
+while [ "$seed" -le "$SEEDS" ]; do
+	program=$TMP/seed$seed.mil
+	$MILANGEN -n "$STATEMENTS" -d $((seed % 8 + 2)) -s "$seed" > "$program" || exit 1
+	run "$program" /dev/null "" > "$TMP/seed$seed.out"
+	compare "$program" /dev/null "$TMP/seed$seed.out"
+	stream "$program"
+	seed=$((seed + 1))
+done
+
+for program in "$DIR"/*.mil; do
+	name=${program%.mil}
+	input=/dev/null
+	if [ -f "$name.in" ]; then
+		input=$name.in
+	fi
+	run "$program" "$input" "" > "$TMP/expected"
+	if ! cmp -s "$TMP/expected" "$name.out"; then
+		echo "$program: the plain run differs from $name.out"
+		failed=$((failed + 1))
+	fi
+	checked=$((checked + 1))
+	compare "$program" "$input" "$name.out"
+	stream "$program"
+done
+
+echo "$checked runs checked, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,258 @@
+// Микротесты производительности front end компилятора (make bench).
+//
+// Лексический анализатор прогоняется по синтетическим текстам разного состава
+// (идентификаторы, комментарии, числа, комплексные литералы), парсер с генератором
+// кода - по программам из операторов одного вида. Каждый замер повторяется
+// несколько раз; печатаются медиана и разброс скорости в МБ/с и лексемах в секунду.
+//
+// Использование: frontbench [повторений [размер текста в КБ]]
+
+#include "../parser.h"
+#include "../scanner.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <time.h>
+
+using namespace std;
+
+// Показания монотонных часов, с
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Простой детерминированный генератор псевдослучайных чисел, чтобы тексты
+// не зависели от реализации rand()
+static unsigned nextRandom(unsigned& state)
+{
+	state = state * 1103515245 + 12345;
+	return (state >> 16) & 0x7fff;
+}
+
+// Имя переменной длиной от 6 до 15 символов
+static string identifier(unsigned& state)
+{
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	string name;
+	int length = 6 + nextRandom(state) % 10;
+	for(int i = 0; i < length; ++i) {
+		name += i > 0 && nextRandom(state) % 4 == 0
+			? (char) ('0' + nextRandom(state) % 10)
+			: letters[nextRandom(state) % 52];
+	}
+	return name;
+}
+
+// Виды синтетических текстов
+enum InputKind
+{
+	INPUT_IDENTIFIERS,  // длинные идентификаторы в присваиваниях
+	INPUT_COMMENTS,     // короткие операторы между большими комментариями
+	INPUT_NUMBERS,      // выражения из целочисленных литералов
+	INPUT_COMPLEX,      // выражения из комплексных литералов
+	INPUT_ASSIGN,       // только присваивания
+	INPUT_IF,           // только операторы if с else
+	INPUT_WHILE,        // только циклы while
+	INPUT_WRITE,        // только операторы write
+	INPUT_COUNT
+};
+
+static const char* inputNames[INPUT_COUNT] = {
+	"identifiers", "comments", "numbers", "complex", "assign", "if", "while", "write"
+};
+
+// Один оператор текста вида kind. Переменные x0..x7 всегда определены
+// (их присваивает пролог программы).
+static string statement(InputKind kind, unsigned& state)
+{
+	ostringstream os;
+	int a = nextRandom(state) % 8;
+	int b = nextRandom(state) % 8;
+	switch(kind) {
+		case INPUT_IDENTIFIERS:
+		{
+			string target = identifier(state);
+			os << target << " := " << identifier(state) << " + " << identifier(state)
+				<< " * " << identifier(state) << " - " << target;
+			break;
+		}
+		case INPUT_COMMENTS:
+			os << "/*";
+			for(int i = 0, n = 20 + nextRandom(state) % 40; i < n; ++i) {
+				os << ' ' << identifier(state);
+				if(i % 8 == 7) {
+					os << "\n *";
+				}
+			}
+			os << " */\n  x" << a << " := x" << b;
+			break;
+		case INPUT_NUMBERS:
+			os << "x" << a << " := " << nextRandom(state) * 1000 << " + " << nextRandom(state)
+				<< " * " << nextRandom(state) % 1000 << " - " << nextRandom(state) * 100;
+			break;
+		case INPUT_COMPLEX:
+			os << "z" << a << " := " << nextRandom(state) << ":" << nextRandom(state) << " + "
+				<< nextRandom(state) % 100 << ":" << nextRandom(state) % 100 << " * "
+				<< nextRandom(state) % 10 << ":" << nextRandom(state) % 10;
+			break;
+		case INPUT_ASSIGN:
+			os << "x" << a << " := (x" << b << " + " << nextRandom(state) % 100 << ") * x"
+				<< (a + b) % 8 << " - x" << a;
+			break;
+		case INPUT_IF:
+			os << "if x" << a << " < x" << b << " & x" << b << " != " << nextRandom(state) % 10
+				<< " then x" << a << " := x" << a << " + 1 else x" << b << " := x" << b << " - 1 fi";
+			break;
+		case INPUT_WHILE:
+			os << "while x" << a << " > " << nextRandom(state) % 100 << " do x" << a << " := x"
+				<< a << " - x" << b << " od";
+			break;
+		case INPUT_WRITE:
+			os << "write(x" << a << " * " << nextRandom(state) % 100 << " + x" << b << ")";
+			break;
+		default:
+			break;
+	}
+	return os.str();
+}
+
+// Программа из операторов вида kind размером не меньше size байт
+static string makeInput(InputKind kind, size_t size)
+{
+	unsigned state = 1 + kind;
+	string text = "begin\n  x0 := 1; x1 := 2; x2 := 3; x3 := 4; x4 := 5; x5 := 6; x6 := 7; x7 := 8";
+	while(text.size() < size) {
+		text += ";\n  ";
+		text += statement(kind, state);
+	}
+	text += "\nend\n";
+	return text;
+}
+
+// Количество лексем текста
+static long long countTokens(const string& text)
+{
+	istringstream input(text);
+	Scanner scanner("bench", input);
+	long long tokens = 0;
+	for(scanner.nextToken(); scanner.token() != T_EOF; scanner.nextToken()) {
+		++tokens;
+	}
+	return tokens;
+}
+
+// Результат серии повторений: времена прогонов, с
+struct Series
+{
+	vector<double> times;
+
+	double median() const
+	{
+		vector<double> sorted(times);
+		sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	}
+
+	// Относительное стандартное отклонение, %
+	double deviation() const
+	{
+		double mean = 0;
+		for(size_t i = 0; i < times.size(); ++i) {
+			mean += times[i];
+		}
+		mean /= times.size();
+		double variance = 0;
+		for(size_t i = 0; i < times.size(); ++i) {
+			variance += (times[i] - mean) * (times[i] - mean);
+		}
+		variance /= times.size() > 1 ? times.size() - 1 : 1;
+		return mean > 0 ? 100 * sqrt(variance) / mean : 0;
+	}
+};
+
+// Прогон лексического анализатора по всему тексту
+static double scanOnce(const string& text)
+{
+	istringstream input(text);
+	double start = now();
+	Scanner scanner("bench", input);
+	for(scanner.nextToken(); scanner.token() != T_EOF; scanner.nextToken()) {
+	}
+	return now() - start;
+}
+
+// Разбор текста с порождением кода. Возвращает время или -1 при ошибке разбора.
+static double parseOnce(const string& text, size_t* instructions)
+{
+	istringstream input(text);
+	double start = now();
+	Parser parser("bench", input);
+	if(!parser.compile()) {
+		return -1;
+	}
+	double time = now() - start;
+	*instructions = parser.getCodeGen().getProgram().size();
+	return time;
+}
+
+static void printRow(const char* name, const string& text, long long tokens, const Series& series,
+	const char* extraName, double extra)
+{
+	double median = series.median();
+	char buffer[160];
+	snprintf(buffer, sizeof(buffer), "%-12s %8.1f %9lld %9.2f %12.0f %6.1f%%  %s %.0f",
+		name, text.size() / 1024.0, tokens, text.size() / median / 1e6, tokens / median,
+		series.deviation(), extraName, extra / median);
+	cout << buffer << endl;
+}
+
+int main(int argc, char** argv)
+{
+	int repetitions = argc > 1 ? atoi(argv[1]) : 15;
+	size_t size = (argc > 2 ? atoi(argv[2]) : 1024) * 1024;
+	if(repetitions < 1 || size == 0) {
+		cerr << "Usage: frontbench [repetitions [size in KB]]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "repetitions: " << repetitions << " (median speed, relative standard deviation)" << endl;
+	cout << endl << "Scanner::nextToken" << endl;
+	cout << "input            KB    tokens      MB/s     tokens/s    dev" << endl;
+	for(int kind = INPUT_IDENTIFIERS; kind <= INPUT_COMPLEX; ++kind) {
+		string text = makeInput((InputKind) kind, size);
+		long long tokens = countTokens(text);
+		Series series;
+		scanOnce(text);
+		for(int r = 0; r < repetitions; ++r) {
+			series.times.push_back(scanOnce(text));
+		}
+		printRow(inputNames[kind], text, tokens, series, "lines/s", count(text.begin(), text.end(), '\n'));
+	}
+
+	cout << endl << "Parser::compile (scanning, parsing and code generation)" << endl;
+	cout << "statements       KB    tokens      MB/s     tokens/s    dev" << endl;
+	for(int kind = INPUT_ASSIGN; kind <= INPUT_WRITE; ++kind) {
+		string text = makeInput((InputKind) kind, size);
+		long long tokens = countTokens(text);
+		size_t instructions = 0;
+		Series series;
+		if(parseOnce(text, &instructions) < 0) {
+			cerr << "Benchmark input '" << inputNames[kind] << "' does not compile" << endl;
+			return EXIT_FAILURE;
+		}
+		for(int r = 0; r < repetitions; ++r) {
+			series.times.push_back(parseOnce(text, &instructions));
+		}
+		printRow(inputNames[kind], text, tokens, series, "instructions/s", instructions);
+	}
+	return EXIT_SUCCESS;
+}
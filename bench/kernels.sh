@@ -0,0 +1,213 @@
+#!/bin/sh
+# Сквозные тесты производительности на ядрах из bench/kernels (make kernels).
+#
+# Каждое ядро name.mil выполняется со входом name.in во всех конфигурациях машин и
+# уровней оптимизации, в том числе с кэшированием вершины стека (--cache-top, базовая
+# конфигурация - та же без кэширования) и с расположением ветвей по профилю
+# (--profile-generate, затем --profile-use). Вход ядра echo не хранится в репозитории:
+# он генерируется здесь (SIZE псевдослучайных чисел), и тот же проход awk вычисляет
+# ожидаемый вывод, так что время этого ядра определяется вводом и выводом чисел.
+# Вывод каждого запуска сравнивается по контрольной сумме (cksum) с ожидаемым: для
+# ядер со входом name.in он записан в name.out.
+#
+# Ядра со входом name.in выполняются также как INSTANCES экземпляров с одинаковым
+# входом: записями --inputs в одном и в JOBS потоках, кооперативным планировщиком
+# (--cooperative) и пакетной машиной (--batch); для них печатается время на один
+# экземпляр. Наконец, программа из milangen (COMPILE операторов) компилируется с
+# буферизованной и с потоковой (--stream) генерацией кода; код должен совпасть.
+#
+# Для каждой конфигурации печатаются количество выполненных инструкций
+# (cmilan --count), лучшее время из нескольких запусков и ускорение относительно
+# базовой конфигурации. Конфигурация, которая медленнее базовой больше чем на
+# TOLERANCE процентов, отмечается SLOWER, конфигурация с неверным выводом - FAILED.
+# Код возврата 1, если хотя бы один вывод неверен. Отметки SLOWER по умолчанию лишь
+# предупреждения (одно зашумленное измерение не должно проваливать проверку); с
+# STRICT=1 код возврата 2, если есть медленные конфигурации.
+#
+# Использование: bench/kernels.sh [ядро...]
+# Переменные окружения: CMILAN, MILANGEN - пути к программам,
+#                       REPEAT - количество запусков, TOLERANCE - допуск в процентах,
+#                       STRICT - 1, чтобы медленные конфигурации давали код возврата 2,
+#                       SIZE - количество чисел во входе echo,
+#                       INSTANCES - количество экземпляров, JOBS - количество потоков,
+#                       COMPILE - количество операторов компилируемой программы.
+
+CMILAN=${CMILAN:-./cmilan}
+MILANGEN=${MILANGEN:-./milangen}
+REPEAT=${REPEAT:-3}
+TOLERANCE=${TOLERANCE:-10}
+STRICT=${STRICT:-0}
+SIZE=${SIZE:-2000000}
+INSTANCES=${INSTANCES:-8}
+JOBS=${JOBS:-$(nproc 2> /dev/null || echo 4)}
+COMPILE=${COMPILE:-64000}
+DIR=$(dirname "$0")/kernels
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+if [ $# -eq 0 ]; then
+	set -- $(cd "$DIR" && ls *.mil | sed 's/\.mil$//') milangen
+fi
+
+# Время в наносекундах
+now() {
+	date +%s%N
+}
+
+# Контрольная сумма стандартного ввода
+checksum() {
+	cksum | awk '{ print $1, $2 }'
+}
+
+# Вход ядра echo: количество чисел и сами числа из [-100000, 100000] (генератор
+# Парка-Миллера). В стандартный вывод печатается ожидаемый вывод ядра: каждое число,
+# умноженное на 2, минус 1, затем сумма по модулю 2^32, наименьшее и наибольшее.
+generate_echo() {
+	awk -v n="$SIZE" -v input="$1" 'BEGIN {
+		print n > input
+		x = 1
+		sum = 0
+		for (k = 0; k < n; k++) {
+			x = (x * 16807) % 2147483647
+			v = x % 200001 - 100000
+			print v > input
+			printf "%d\n", v * 2 - 1
+			sum += v
+			if (sum >= 2147483648) sum -= 4294967296
+			if (sum < -2147483648) sum += 4294967296
+			if (k == 0 || v < low) low = v
+			if (k == 0 || v > high) high = v
+		}
+		printf "%d\n%d\n%d\n", sum, low, high
+	}'
+}
+
+# Лучшее время (в микросекундах) из REPEAT запусков команды со стандартным вводом
+# из файла $1; вывод последнего запуска остается в $TMP/output и $TMP/errors
+measure() {
+	input=$1
+	shift
+	best=
+	r=0
+	while [ "$r" -lt "$REPEAT" ]; do
+		start=$(now)
+		"$@" < "$input" > "$TMP/output" 2> "$TMP/errors"
+		time=$(( ($(now) - start) / 1000 ))
+		if [ -z "$best" ] || [ "$time" -lt "$best" ]; then
+			best=$time
+		fi
+		r=$((r + 1))
+	done
+}
+
+# Строка таблицы для последнего измерения: ядро $1, конфигурация $2, базовая
+# конфигурация $3 (пустая - сама конфигурация), ожидаемая контрольная сумма $4,
+# количество экземпляров $5. Время конфигурации запоминается для следующих строк.
+report() {
+	key=time_$(echo "$2" | tr -c 'a-zA-Z0-9\n' '_')
+	per=$((best / $5))
+	eval "$key=$per"
+	base=$per
+	if [ -n "$3" ]; then
+		eval "base=\$time_$(echo "$3" | tr -c 'a-zA-Z0-9\n' '_')"
+	fi
+	executed=$(sed -n 's/^executed: \([0-9]*\).*/\1/p' "$TMP/errors")
+	speedup=$(awk "BEGIN { printf \"%.2fx\", $base / ($per > 0 ? $per : 1) }")
+	result=$(awk "BEGIN { printf \"%.1f\", $per / 1000 }")
+	mark=
+	if [ "$(checksum < "$TMP/output")" != "$4" ]; then
+		mark=FAILED
+		failed=1
+	elif [ $((per * 100)) -gt $((base * (100 + TOLERANCE))) ]; then
+		mark="SLOWER than $3"
+		slower=1
+	fi
+	printf "%-11s %-17s %12s %10s %8s  %s\n" "$1" "$2" "${executed:--}" "$result" "$speedup" "$mark"
+}
+
+# Выполнение ядра $1 в конфигурациях одной машины со входом $2 и ожидаемой
+# контрольной суммой $3
+run_single() {
+	$CMILAN --run --profile-generate="$TMP/profile" "$DIR/$1.mil" < "$2" > /dev/null
+	for config in "stack||" "stack -O|stack|-O" "fuse -O|stack -O|-O --fuse" \
+		"cached|stack|--cache-top" "cached -O|stack -O|-O --cache-top" \
+		"cached fuse -O|fuse -O|-O --fuse --cache-top" \
+		"reg|stack|--target=reg" "reg -O|reg|-O --target=reg" \
+		"profile -O|stack -O|-O --profile-use=$TMP/profile"; do
+		name=${config%%|*}
+		rest=${config#*|}
+		options=${rest#*|}
+		measure "$2" $CMILAN $options --count --run "$DIR/$1.mil"
+		report "$1" "$name" "${rest%%|*}" "$3" 1
+	done
+}
+
+# Выполнение ядра $1 как INSTANCES экземпляров со входом из файла $DIR/$1.in
+run_instances() {
+	# Записи --inputs: программа на Милане печатает их двоичными словами
+	awk -v k="$INSTANCES" 'BEGIN { printf "begin\n  k := 0;\n  while k < %d do\n", k }
+		{ for (i = 1; i <= NF; i++) value[n++] = $i }
+		END {
+			printf "    write(%d);\n", n
+			for (i = 0; i < n; i++) printf "    write(%s);\n", value[i]
+			printf "    k := k + 1\n  od\nend\n"
+		}' "$DIR/$1.in" > "$TMP/records.mil"
+	$CMILAN --run --binary-io "$TMP/records.mil" < /dev/null > "$TMP/records"
+	# Таблица --batch: k-я строка содержит k-е значение входа каждого экземпляра
+	awk -v k="$INSTANCES" '{ for (i = 1; i <= NF; i++) {
+			line = $i
+			for (j = 1; j < k; j++) line = line "\t" $i
+			print line
+		} }' "$DIR/$1.in" > "$TMP/table"
+	records=$(awk -v k="$INSTANCES" '{ line[NR] = $0 }
+		END { for (i = 0; i < k; i++) { for (j = 1; j <= NR; j++) print line[j]; print "" } }' \
+		"$DIR/$1.out" | checksum)
+	table=$(awk -v k="$INSTANCES" '{ line = $0; for (j = 1; j < k; j++) line = line "\t" $0; print line }' \
+		"$DIR/$1.out" | checksum)
+
+	measure /dev/null $CMILAN -O --inputs "$TMP/records" -j 1 "$DIR/$1.mil"
+	report "$1" "inputs -j 1" "stack -O" "$records" "$INSTANCES"
+	if [ "$JOBS" -gt 1 ]; then
+		measure /dev/null $CMILAN -O --inputs "$TMP/records" -j "$JOBS" "$DIR/$1.mil"
+		report "$1" "inputs -j $JOBS" "inputs -j 1" "$records" "$INSTANCES"
+	fi
+	measure /dev/null $CMILAN -O --inputs "$TMP/records" -j 1 --cooperative "$DIR/$1.mil"
+	report "$1" "cooperative" "inputs -j 1" "$records" "$INSTANCES"
+	measure /dev/null $CMILAN -O --count --batch "$TMP/table" "$DIR/$1.mil"
+	report "$1" "batch" "inputs -j 1" "$table" "$INSTANCES"
+}
+
+# Компиляция программы из milangen с буферизованной и с потоковой генерацией кода
+run_compile() {
+	$MILANGEN -n "$COMPILE" > "$TMP/program.mil" || return
+	measure /dev/null $CMILAN "$TMP/program.mil"
+	code=$(checksum < "$TMP/output")
+	report milangen buffered "" "$code" 1
+	measure /dev/null $CMILAN --stream "$TMP/program.mil"
+	report milangen stream buffered "$code" 1
+}
+
+failed=0
+slower=0
+printf "%-11s %-17s %12s %10s %8s\n" kernel configuration executed ms speedup
+for kernel in "$@"; do
+	if [ "$kernel" = milangen ]; then
+		run_compile
+	elif [ -f "$DIR/$kernel.in" ]; then
+		run_single "$kernel" "$DIR/$kernel.in" "$(checksum < "$DIR/$kernel.out")"
+		run_instances "$kernel"
+	else
+		sum=$(generate_"$kernel" "$TMP/input" | checksum)
+		run_single "$kernel" "$TMP/input" "$sum"
+	fi
+done
+if [ "$failed" -ne 0 ]; then
+	exit 1
+fi
+if [ "$slower" -ne 0 ]; then
+	echo "warning: some configurations are slower than their baselines" >&2
+	if [ "$STRICT" = 1 ]; then
+		exit 2
+	fi
+fi
@@ -0,0 +1,307 @@
+// Генератор синтетических программ на Милане для нагрузочных тестов и измерения
+// масштабируемости компилятора (см. bench/scaling.sh).
+//
+// Программа состоит из пролога, присваивающего значения всем переменным, и заданного
+// количества операторов верхнего уровня. Составной оператор (if или while) содержит
+// вложенный составной оператор (пока не достигнута заданная глубина) и простой оператор,
+// поэтому размер программы растет линейно и с количеством операторов, и с глубиной.
+// Все переменные определены до использования, типы операндов согласованы, деления нет,
+// циклы выполняются не больше двух раз, поэтому при небольшой глубине программы
+// можно и выполнять; ввода программы не читают.
+//
+// Использование: milangen [-n операторов] [-d глубина] [-e операндов] [-v переменных]
+//                         [-c процент комплексных] [-m байт комментариев] [-s зерно]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Параметры генерации
+struct Shape
+{
+	Shape()
+		: statements(100), depth(3), operands(4), variables(8), complexPercent(10),
+		  commentBytes(0), seed(1)
+	{}
+
+	int statements;      // количество операторов верхнего уровня
+	int depth;           // глубина вложенности составных операторов
+	int operands;        // количество операндов в выражении
+	int variables;       // количество переменных каждого типа
+	int complexPercent;  // доля комплексных присваиваний среди простых операторов, %
+	int commentBytes;    // размер комментария после каждого оператора верхнего уровня
+	unsigned seed;       // зерно генератора псевдослучайных чисел
+};
+
+class Generator
+{
+public:
+	Generator(const Shape& shape, ostream& output)
+		: shape_(shape), output_(output), state_(shape.seed)
+	{}
+
+	void program();
+
+private:
+	unsigned random(unsigned n)
+	{
+		state_ = state_ * 1103515245 + 12345;
+		return ((state_ >> 16) & 0x7fff) % n;
+	}
+
+	void indent(int depth)
+	{
+		output_ << "\n";
+		for(int i = 0; i <= depth; ++i) {
+			output_ << "  ";
+		}
+	}
+
+	void intOperand();
+	void intExpression();
+	void boolExpression();
+	void complexExpression();
+	void simpleStatement();
+	void statement(int depth, bool compound);
+	void comment();
+
+	const Shape& shape_;
+	ostream& output_;
+	unsigned state_;
+};
+
+void Generator::intOperand()
+{
+	if(random(3) == 0) {
+		output_ << random(1000);
+	}
+	else {
+		output_ << "i" << random(shape_.variables);
+	}
+}
+
+// Цепочка операций над целыми; изредка подвыражение берется в скобки
+void Generator::intExpression()
+{
+	static const char* operations[] = { " + ", " - ", " * " };
+	int open = 0;
+	intOperand();
+	for(int k = 1; k < shape_.operands; ++k) {
+		output_ << operations[random(3)];
+		if(random(8) == 0 && k + 1 < shape_.operands) {
+			output_ << "(";
+			++open;
+		}
+		intOperand();
+		if(open > 0 && random(3) == 0) {
+			output_ << ")";
+			--open;
+		}
+	}
+	for(; open > 0; --open) {
+		output_ << ")";
+	}
+}
+
+void Generator::boolExpression()
+{
+	static const char* comparisons[] = { " < ", " > ", " = ", " != ", " <= ", " >= " };
+	static const char* operations[] = { " & ", " | " };
+	int terms = shape_.operands / 2 > 1 ? shape_.operands / 2 : 1;
+	for(int k = 0; k < terms; ++k) {
+		if(k > 0) {
+			output_ << operations[random(2)];
+		}
+		if(random(3) == 0) {
+			output_ << (random(2) ? "!" : "") << "b" << random(shape_.variables);
+		}
+		else {
+			intOperand();
+			output_ << comparisons[random(6)];
+			intOperand();
+		}
+	}
+}
+
+void Generator::complexExpression()
+{
+	static const char* operations[] = { " + ", " - ", " * " };
+	for(int k = 0; k < shape_.operands; ++k) {
+		if(k > 0) {
+			output_ << operations[random(3)];
+		}
+		// Первый операнд комплексный, чтобы выражение имело комплексный тип
+		switch(k == 0 ? random(2) * 2 : random(4)) {
+			case 0:
+				output_ << random(100) << ":" << random(100);
+				break;
+			case 1:
+				output_ << "i" << random(shape_.variables);
+				break;
+			default:
+				output_ << "z" << random(shape_.variables);
+				break;
+		}
+	}
+}
+
+void Generator::simpleStatement()
+{
+	int kind = random(100);
+	if(kind < shape_.complexPercent) {
+		output_ << "z" << random(shape_.variables) << " := ";
+		complexExpression();
+	}
+	else if(kind < shape_.complexPercent + (100 - shape_.complexPercent) / 6) {
+		output_ << "b" << random(shape_.variables) << " := ";
+		boolExpression();
+	}
+	else if(kind < shape_.complexPercent + (100 - shape_.complexPercent) / 4) {
+		output_ << "write(";
+		intExpression();
+		output_ << ")";
+	}
+	else {
+		output_ << "i" << random(shape_.variables) << " := ";
+		intExpression();
+	}
+}
+
+// Оператор на глубине depth. Составной оператор содержит вложенный составной
+// (если глубина позволяет) и простой оператор.
+void Generator::statement(int depth, bool compound)
+{
+	if(!compound || depth >= shape_.depth) {
+		simpleStatement();
+		return;
+	}
+
+	if(random(2) == 0) {
+		output_ << "if ";
+		boolExpression();
+		output_ << " then";
+		indent(depth + 1);
+		statement(depth + 1, true);
+		output_ << ";";
+		indent(depth + 1);
+		simpleStatement();
+		indent(depth);
+		output_ << "else";
+		indent(depth + 1);
+		simpleStatement();
+		indent(depth);
+		output_ << "fi";
+	}
+	else {
+		// Счетчик цикла свой у каждого уровня вложенности
+		output_ << "l" << depth << " := 0;";
+		indent(depth);
+		output_ << "while l" << depth << " < " << 1 + random(2) << " do";
+		indent(depth + 1);
+		statement(depth + 1, true);
+		output_ << ";";
+		indent(depth + 1);
+		simpleStatement();
+		output_ << ";";
+		indent(depth + 1);
+		output_ << "l" << depth << " := l" << depth << " + 1";
+		indent(depth);
+		output_ << "od";
+	}
+}
+
+void Generator::comment()
+{
+	static const char* words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur" };
+	indent(0);
+	output_ << "/*";
+	int written = 2;
+	while(written < shape_.commentBytes - 3) {
+		const char* word = words[random(6)];
+		output_ << " " << word;
+		written += 1 + strlen(word);
+		if(random(12) == 0) {
+			output_ << "\n   *";
+			written += 5;
+		}
+	}
+	output_ << " */";
+}
+
+void Generator::program()
+{
+	output_ << "begin";
+	indent(0);
+	for(int v = 0; v < shape_.variables; ++v) {
+		output_ << "i" << v << " := " << v + 1 << "; b" << v << " := " << (v % 2 ? "true" : "false")
+			<< "; z" << v << " := " << v << ":" << v + 1 << ";";
+		indent(0);
+	}
+	for(int s = 0; s < shape_.statements; ++s) {
+		statement(0, random(4) == 0);
+		output_ << ";";
+		if(shape_.commentBytes > 0) {
+			comment();
+		}
+		indent(0);
+	}
+	output_ << "write(i0)\nend\n";
+}
+
+// Разбор неотрицательного целого аргумента опции
+static bool parseCount(const char* text, int minimum, int& value)
+{
+	char* end;
+	long result = strtol(text, &end, 10);
+	if(*end || result < minimum || result > 100000000) {
+		return false;
+	}
+	value = result;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Shape shape;
+	for(int i = 1; i < argc; ++i) {
+		int seed = 0;
+		bool ok = i + 1 < argc;
+		if(ok && !strcmp(argv[i], "-n")) {
+			ok = parseCount(argv[++i], 0, shape.statements);
+		}
+		else if(ok && !strcmp(argv[i], "-d")) {
+			ok = parseCount(argv[++i], 0, shape.depth);
+		}
+		else if(ok && !strcmp(argv[i], "-e")) {
+			ok = parseCount(argv[++i], 1, shape.operands);
+		}
+		else if(ok && !strcmp(argv[i], "-v")) {
+			ok = parseCount(argv[++i], 1, shape.variables);
+		}
+		else if(ok && !strcmp(argv[i], "-c")) {
+			ok = parseCount(argv[++i], 0, shape.complexPercent) && shape.complexPercent <= 100;
+		}
+		else if(ok && !strcmp(argv[i], "-m")) {
+			ok = parseCount(argv[++i], 0, shape.commentBytes);
+		}
+		else if(ok && !strcmp(argv[i], "-s")) {
+			ok = parseCount(argv[++i], 0, seed);
+			shape.seed = seed;
+		}
+		else {
+			ok = false;
+		}
+		if(!ok) {
+			cerr << "Usage: milangen [-n statements] [-d depth] [-e operands] [-v variables]" << endl;
+			cerr << "                [-c complex percent] [-m comment bytes] [-s seed]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	Generator generator(shape, cout);
+	generator.program();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#!/bin/sh
+# Масштабируемость компилятора (make scaling).
+#
+# Для нескольких форм программ (см. milangen) размер удваивается от начального до
+# конечного; время фаз компиляции и наибольший объем памяти берутся из
+# cmilan --stats-json. Результаты печатаются таблицей и записываются в файл
+# данных (по умолчанию scaling.dat); если установлен gnuplot, строятся графики времени
+# компиляции и памяти от размера программы (scaling.svg).
+#
+# Использование: bench/scaling.sh [файл данных]
+# Переменные окружения: CMILAN, MILANGEN - пути к программам,
+#                       FROM, TO - начальное и конечное количество операторов,
+#                       OPTIONS - дополнительные опции cmilan. Анализ копий
+#                       оптимизатора хранит состояние каждого блока для всех
+#                       переменных, поэтому время -O растет быстрее линейного; его
+#                       лучше измерять на меньших размерах: OPTIONS=-O TO=32000.
+
+CMILAN=${CMILAN:-./cmilan}
+MILANGEN=${MILANGEN:-./milangen}
+FROM=${FROM:-1000}
+TO=${TO:-128000}
+OPTIONS=${OPTIONS:-}
+DATA=${1:-scaling.dat}
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# Значение поля "wall_ms" фазы $1 из файла JSON $2 (0, если фаза не выполнялась)
+phase() {
+	value=$(sed -n "s/.*\"$1\": {\"wall_ms\": \([0-9.]*\).*/\1/p" "$2")
+	echo "${value:-0}"
+}
+
+# Значение числового поля $1 из файла JSON $2
+field() {
+	sed -n "s/.*\"$1\": \([0-9]*\).*/\1/p" "$2"
+}
+
+echo "# shape statements bytes tokens parse_ms optimize_ms peak_kb" > "$DATA"
+printf "%-9s %10s %10s %10s %10s %11s %10s\n" shape statements KB tokens "parse ms" "optimize ms" "peak KB"
+
+# Формы программ: имя, делитель количества операторов (чтобы программы разных форм
+# были сравнимого размера) и параметры milangen
+for shape in "mixed:1:" "nested:16:-d 40" "expr:8:-e 64" "vars:1:-v 2000 -d 0" "complex:1:-c 80" "comments:8:-m 1024"; do
+	name=${shape%%:*}
+	rest=${shape#*:}
+	divisor=${rest%%:*}
+	options=${rest#*:}
+	n=$FROM
+	while [ "$n" -le "$TO" ]; do
+		statements=$((n / divisor))
+		$MILANGEN -n "$statements" $options > "$TMP/program.mil" || exit 1
+		if ! $CMILAN $OPTIONS --stats-json "$TMP/stats.json" "$TMP/program.mil" > /dev/null; then
+			echo "cmilan failed on '$name' with $statements statements" >&2
+			exit 1
+		fi
+		bytes=$(wc -c < "$TMP/program.mil")
+		tokens=$(field tokens "$TMP/stats.json")
+		parse=$(phase parse "$TMP/stats.json")
+		optimize=$(phase optimize "$TMP/stats.json")
+		peak=$(field peak_memory_kb "$TMP/stats.json")
+		echo "$name $statements $bytes $tokens $parse $optimize $peak" >> "$DATA"
+		printf "%-9s %10d %10d %10d %10s %11s %10d\n" "$name" "$statements" $((bytes / 1024)) "$tokens" "$parse" "$optimize" "$peak"
+		n=$((n * 2))
+	done
+	# Пустая строка разделяет серии для gnuplot
+	echo >> "$DATA"
+	echo >> "$DATA"
+done
+
+if command -v gnuplot > /dev/null; then
+	gnuplot <<EOF
+set terminal svg size 1000,450
+set output "${DATA%.*}.svg"
+set multiplot layout 1,2
+set logscale xy
+set key left top
+set xlabel "program size, KB"
+set ylabel "compile time, ms"
+plot for [i=0:5] "$DATA" index i using (\$3/1024):(\$5+\$6) with linespoints title word("mixed nested expr vars complex comments", i + 1)
+set ylabel "peak memory, KB"
+plot for [i=0:5] "$DATA" index i using (\$3/1024):7 with linespoints notitle
+unset multiplot
+EOF
+	echo "plots: ${DATA%.*}.svg"
+fi
+echo "data: $DATA"
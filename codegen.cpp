@@ -1,129 +1,337 @@
 #include "codegen.h"
+#include "stats.h"
+#include <algorithm>
 
-void Command::print(int address, ostream& os)
-{
-	os << address << ":\t";
-	switch(instruction_) {
-		case NOP:
-			os << "NOP";
-			break;
-			
-		case STOP:
-			os << "STOP";
-			break;
-			
+static const char * instructionNames_[] = {
+	"NOP",
+	"STOP",
+	"LOAD",
+	"STORE",
+	"BLOAD",
+	"BSTORE",
+	"BLOAD_UNCHECKED",
+	"BSTORE_UNCHECKED",
+	"PUSH",
+	"POP",
+	"DUP",
+	"ADD",
+	"SUB",
+	"MULT",
+	"DIV",
+	"INVERT",
+	"COMPARE",
+	"JUMP",
+	"JUMP_YES",
+	"JUMP_NO",
+	"INPUT",
+	"PRINT",
+	"AND",
+	"OR",
+	"NOT",
+	"XOR",
+	"IMPLIES",
+	"LOAD2",
+	"LOAD_PUSH",
+	"LOAD_ADD",
+	"LOAD_SUB",
+	"LOAD_MULT",
+	"PUSH_ADD",
+	"PUSH_SUB",
+	"PUSH_MULT",
+	"PUSH_COMPARE",
+	"COMPARE_JUMP_NO",
+	"LOAD_STORE",
+	"PUSH_STORE",
+	"STORE2",
+	"INCR",
+	"ADD3",
+	"SUB3",
+	"MULT3",
+};
+
+const char * instructionToString(Instruction instruction)
+{
+	return instructionNames_[instruction];
+}
+
+int instructionArity(Instruction instruction)
+{
+	switch(instruction) {
 		case LOAD:
-			os << "LOAD\t" << arg_;
-			break;
-			
 		case STORE:
-			os << "STORE\t" << arg_;
-			break;
-			
+		case PUSH:
+		case COMPARE:
+		case JUMP:
+		case JUMP_YES:
+		case JUMP_NO:
+		case LOAD_ADD:
+		case LOAD_SUB:
+		case LOAD_MULT:
+		case PUSH_ADD:
+		case PUSH_SUB:
+		case PUSH_MULT:
+			return 1;
+
 		case BLOAD:
-			os << "BLOAD\t" << arg_;
-			break;
-			
 		case BSTORE:
-			os << "BSTORE\t" << arg_;
-			break;
-			
-		case PUSH:
-			os << "PUSH\t" << arg_;
-			break;
-			
+		case BLOAD_UNCHECKED:
+		case BSTORE_UNCHECKED:
+		case LOAD2:
+		case LOAD_PUSH:
+		case PUSH_COMPARE:
+		case COMPARE_JUMP_NO:
+		case LOAD_STORE:
+		case PUSH_STORE:
+		case STORE2:
+		case INCR:
+			return 2;
+
+		case ADD3:
+		case SUB3:
+		case MULT3:
+			return 3;
+
+		default:
+			return 0;
+	}
+}
+
+int instructionPops(Instruction instruction)
+{
+	switch(instruction) {
+		case STORE:
+		case BLOAD:
+		case BLOAD_UNCHECKED:
 		case POP:
-			os << "POP";
-			break;
-			
 		case DUP:
-			os << "DUP";
-			break;
-			
+		case INVERT:
+		case JUMP_YES:
+		case JUMP_NO:
+		case PRINT:
+		case NOT:
+		case LOAD_ADD:
+		case LOAD_SUB:
+		case LOAD_MULT:
+		case PUSH_ADD:
+		case PUSH_SUB:
+		case PUSH_MULT:
+		case PUSH_COMPARE:
+			return 1;
+
+		case BSTORE:
+		case BSTORE_UNCHECKED:
+		case ADD:
+		case SUB:
+		case MULT:
+		case DIV:
+		case COMPARE:
+		case AND:
+		case OR:
+		case XOR:
+		case IMPLIES:
+		case COMPARE_JUMP_NO:
+		case STORE2:
+			return 2;
+
+		default:
+			return 0;
+	}
+}
+
+int instructionPushes(Instruction instruction)
+{
+	switch(instruction) {
+		case LOAD:
+		case BLOAD:
+		case BLOAD_UNCHECKED:
+		case PUSH:
 		case ADD:
-			os << "ADD";
-			break;
-			
 		case SUB:
-			os << "SUB";
-			break;
-			
 		case MULT:
-			os << "MULT";
-			break;
-			
 		case DIV:
-			os << "DIV";
-			break;
-			
 		case INVERT:
-			os << "INVERT";
-			break;
-	
 		case COMPARE:
-			os << "COMPARE\t" << arg_;
-			break;
-	
-		case JUMP:
-			os << "JUMP\t" << arg_;
-			break;
-	
-		case JUMP_YES:
-			os << "JUMP_YES\t" << arg_;
-			break;
-	
-		case JUMP_NO:
-			os << "JUMP_NO\t" << arg_;
-			break;
-	
 		case INPUT:
-			os << "INPUT";
-			break;
-	
-		case PRINT:
-			os << "PRINT";
-			break;
+		case AND:
+		case OR:
+		case NOT:
+		case XOR:
+		case IMPLIES:
+		case LOAD_ADD:
+		case LOAD_SUB:
+		case LOAD_MULT:
+		case PUSH_ADD:
+		case PUSH_SUB:
+		case PUSH_MULT:
+		case PUSH_COMPARE:
+			return 1;
+
+		case DUP:
+		case LOAD2:
+		case LOAD_PUSH:
+			return 2;
+
+		default:
+			return 0;
+	}
+}
+
+bool isJump(Instruction instruction)
+{
+	return instruction == JUMP || instruction == JUMP_YES || instruction == JUMP_NO
+		|| instruction == COMPARE_JUMP_NO;
+}
+
+bool isIndexed(Instruction instruction)
+{
+	return instruction == BLOAD || instruction == BSTORE || instruction == BLOAD_UNCHECKED
+		|| instruction == BSTORE_UNCHECKED;
+}
+
+void Command::print(int address, ostream& os) const
+{
+	os << address << ":\t" << instructionToString(instruction_);
+
+	int arity = instructionArity(instruction_);
+	if(arity > 0) {
+		os << "\t" << arg_;
+	}
+	if(arity > 1) {
+		os << "\t" << arg2_;
+	}
+	if(arity > 2) {
+		os << "\t" << arg3_;
 	}
 
 	os << endl;
 }
 
+void inheritLines(vector<Command>& program)
+{
+	int line = 0;
+	for(size_t i = 0; i < program.size(); ++i) {
+		if(program[i].getLine() == 0) {
+			program[i].setLine(line);
+		}
+		else {
+			line = program[i].getLine();
+		}
+	}
+}
+
 void CodeGen::emit(Instruction instruction)
 {
 	commandBuffer_.push_back(Command(instruction));
+	commandBuffer_.back().setLine(line_);
+	if(stats_) {
+		++stats_->emitted;
+	}
 }
 
 void CodeGen::emit(Instruction instruction, int arg)
 {
 	commandBuffer_.push_back(Command(instruction, arg));
+	commandBuffer_.back().setLine(line_);
+	if(stats_) {
+		++stats_->emitted;
+	}
+}
+
+void CodeGen::emit(Instruction instruction, int arg, int arg2)
+{
+	commandBuffer_.push_back(Command(instruction, arg, arg2));
+	commandBuffer_.back().setLine(line_);
+	if(stats_) {
+		++stats_->emitted;
+	}
 }
 
+// Инструкция, записываемая на место зарезервированной, сохраняет ее номер строки
 void CodeGen::emitAt(int address, Instruction instruction)
 {
+	reserved_.erase(address);
+	address -= base_;
+	int line = commandBuffer_[address].getLine();
 	commandBuffer_[address] = Command(instruction);
+	commandBuffer_[address].setLine(line);
+	if(stats_) {
+		++stats_->backpatches;
+	}
 }
 
 void CodeGen::emitAt(int address, Instruction instruction, int arg)
 {
+	reserved_.erase(address);
+	address -= base_;
+	int line = commandBuffer_[address].getLine();
 	commandBuffer_[address] = Command(instruction, arg);
+	commandBuffer_[address].setLine(line);
+	if(stats_) {
+		++stats_->backpatches;
+	}
+}
+
+void CodeGen::insert(int address, Instruction instruction, int arg)
+{
+	address -= base_;
+	Command command(instruction, arg);
+	command.setLine(address < (int) commandBuffer_.size() ? commandBuffer_[address].getLine() : line_);
+	commandBuffer_.insert(commandBuffer_.begin() + address, command);
+	if(stats_) {
+		++stats_->inserts;
+	}
+}
+
+void CodeGen::moveToEnd(int address, int end)
+{
+	rotate(commandBuffer_.begin() + (address - base_), commandBuffer_.begin() + (end - base_),
+		commandBuffer_.end());
+}
+
+bool CodeGen::readsInput(int address, int end)
+{
+	for(int i = address - base_; i < end - base_; ++i) {
+		if(commandBuffer_[i].getInstruction() == INPUT) {
+			return true;
+		}
+	}
+	return false;
 }
 
 int CodeGen::getCurrentAddress()
 {
-	return commandBuffer_.size();
+	return base_ + commandBuffer_.size();
 }
 
 int CodeGen::reserve()
 {
 	emit(NOP);
-	return commandBuffer_.size() - 1;
+	int address = getCurrentAddress() - 1;
+	if(streaming_) {
+		reserved_.insert(address);
+	}
+	return address;
 }
 
 void CodeGen::flush()
 {
 	int count = commandBuffer_.size();
-	for(int address = 0; address < count; ++address) {
-		commandBuffer_[address].print(address, output_);
+	for(int i = 0; i < count; ++i) {
+		commandBuffer_[i].print(base_ + i, output_);
 	}
 	output_.flush();
 }
+
+void CodeGen::commit()
+{
+	if(!streaming_) {
+		return;
+	}
+	int end = reserved_.empty() ? getCurrentAddress() : *reserved_.begin();
+	int count = end - base_;
+	for(int i = 0; i < count; ++i) {
+		commandBuffer_[i].print(base_ + i, output_);
+	}
+	commandBuffer_.erase(commandBuffer_.begin(), commandBuffer_.begin() + count);
+	base_ = end;
+}
@@ -3,9 +3,11 @@
 
 #include <vector>
 #include <iostream>
+#include <set>
 
 using namespace std;
 
+struct CompileStats;
 
 // Инструкции виртуальной машины Милана 
 
@@ -15,8 +17,14 @@ enum Instruction
 	STOP,		// остановка машины, завершение работы программы
 	LOAD,		// LOAD addr - загрузка слова данных в стек из памяти по адресу addr
 	STORE,		// STORE addr - запись слова данных с вершины стека в память по адресу addr
-	BLOAD,		// BLOAD addr - загрузка слова данных в стек из памяти по адресу addr + значение на вершине стека
-	BSTORE,		// BSTORE addr - запись слова данных по адресу addr + значение на вершине стека
+	BLOAD,		// BLOAD addr n - загрузка в стек элемента массива из n слов, начинающегося по адресу addr;
+				// индекс элемента снимается с вершины стека, индекс вне [0, n) - ошибка выполнения
+	BSTORE,		// BSTORE addr n - запись слова из-под вершины стека в элемент массива из n слов по адресу addr;
+				// индекс элемента снимается с вершины стека, индекс вне [0, n) - ошибка выполнения
+	// Варианты без проверки индекса парсер не порождает, их подставляет оптимизатор там,
+	// где индекс заведомо лежит в границах массива (см. eliminateBoundsChecks в optimizer.h).
+	BLOAD_UNCHECKED,	// BLOAD_UNCHECKED addr n - BLOAD без проверки индекса
+	BSTORE_UNCHECKED,	// BSTORE_UNCHECKED addr n - BSTORE без проверки индекса
 	PUSH,		// PUSH n - загрузка в стек константы n
 	POP,		// удаление слова с вершины стека
 	DUP,		// копирование слова на вершине стека
@@ -30,46 +38,188 @@ enum Instruction
 	JUMP_YES,	// JUMP_YES addr - переход по адресу addr, если на вершине стека значение 1
 	JUMP_NO,	// JUMP_NO addr - переход по адресу addr, если на вершине стека значение 0
 	INPUT,		// чтение целого числа со стандартного ввода и загрузка его в стек
-	PRINT		// печать на стандартный вывод числа с вершины стека
+	PRINT,		// печать на стандартный вывод числа с вершины стека
+
+	// Логические инструкции. Ненулевое слово считается истиной, результат всегда 0 или 1.
+	AND,		// логическое "и" двух слов на вершине стека
+	OR,			// логическое "или" двух слов на вершине стека
+	NOT,		// логическое отрицание слова на вершине стека
+	XOR,		// исключающее "или" двух слов на вершине стека
+	IMPLIES,	// импликация: слово под вершиной -> слово на вершине стека
+
+	// Суперинструкции. Каждая из них выполняет за одну диспетчеризацию последовательность
+	// обычных инструкций, указанную в комментарии. Кодогенератор их не порождает,
+	// их подставляет проход fuseSuperinstructions (см. fusion.h).
+	LOAD2,				// LOAD2 a b - LOAD a; LOAD b
+	LOAD_PUSH,			// LOAD_PUSH a n - LOAD a; PUSH n
+	LOAD_ADD,			// LOAD_ADD a - LOAD a; ADD
+	LOAD_SUB,			// LOAD_SUB a - LOAD a; SUB
+	LOAD_MULT,			// LOAD_MULT a - LOAD a; MULT
+	PUSH_ADD,			// PUSH_ADD n - PUSH n; ADD
+	PUSH_SUB,			// PUSH_SUB n - PUSH n; SUB
+	PUSH_MULT,			// PUSH_MULT n - PUSH n; MULT
+	PUSH_COMPARE,		// PUSH_COMPARE n cmp - PUSH n; COMPARE cmp
+	COMPARE_JUMP_NO,	// COMPARE_JUMP_NO cmp addr - COMPARE cmp; JUMP_NO addr
+	LOAD_STORE,			// LOAD_STORE a b - LOAD a; STORE b
+	PUSH_STORE,			// PUSH_STORE n a - PUSH n; STORE a
+	STORE2,				// STORE2 a b - STORE a; STORE b
+	INCR,				// INCR a n - LOAD a; PUSH n; ADD; STORE a
+	ADD3,				// ADD3 a b c - LOAD a; LOAD b; ADD; STORE c
+	SUB3,				// SUB3 a b c - LOAD a; LOAD b; SUB; STORE c
+	MULT3,				// MULT3 a b c - LOAD a; LOAD b; MULT; STORE c
+
+	INSTRUCTION_COUNT	// количество инструкций (сама инструкцией не является)
 };
 
+// Функция instructionToString возвращает мнемонику инструкции.
+const char * instructionToString(Instruction instruction);
+
+// Функция instructionArity возвращает количество аргументов инструкции (от 0 до 3).
+int instructionArity(Instruction instruction);
+
+// Функция instructionPops возвращает количество слов, которые инструкция снимает со стека.
+int instructionPops(Instruction instruction);
+
+// Функция instructionPushes возвращает количество слов, которые инструкция кладет в стек.
+int instructionPushes(Instruction instruction);
+
+// Функция isJump проверяет, является ли инструкция переходом.
+bool isJump(Instruction instruction);
+
+// Функция isIndexed проверяет, является ли инструкция обращением к элементу массива
+// (BLOAD, BSTORE и их варианты без проверки индекса).
+bool isIndexed(Instruction instruction);
+
 // Класс Command представляет машинные инструкции. 
-const int SHIFT = 8; //константа смещения памяти
+// Временные ячейки, через которые парсер перекладывает части комплексных чисел и индексы
+// элементов массивов, занимают младшие адреса памяти [TEMP, TEMP + TEMP_CELLS); переменные
+// и массивы размещаются после них. Поэтому временные ячейки не пересекаются с переменными
+// и массивами, появившимися в программе позже, а их адреса известны до конца разбора
+// (это нужно потоковой генерации кода).
+const int TEMP = 0; //адрес первой временной ячейки
+const int TEMP_CELLS = 5; //количество временных ячеек
 class Command
 {
 public:
 	// Конструктор для инструкций без аргументов
 	Command(Instruction instruction)
-		: instruction_(instruction), arg_(0)
+		: instruction_(instruction), arg_(0), arg2_(0), arg3_(0), line_(0)
 	{}
 
 	// Конструктор для инструкций с одним аргументом
 	Command(Instruction instruction, int arg)
-		: instruction_(instruction), arg_(arg)
+		: instruction_(instruction), arg_(arg), arg2_(0), arg3_(0), line_(0)
+	{}
+
+	// Конструктор для инструкций с двумя или тремя аргументами
+	Command(Instruction instruction, int arg, int arg2, int arg3 = 0)
+		: instruction_(instruction), arg_(arg), arg2_(arg2), arg3_(arg3), line_(0)
 	{}
 
+	Instruction getInstruction() const
+	{
+		return instruction_;
+	}
+
+	int getArg() const
+	{
+		return arg_;
+	}
+
+	int getArg2() const
+	{
+		return arg2_;
+	}
+
+	int getArg3() const
+	{
+		return arg3_;
+	}
+
+	// Адрес перехода (только для инструкций-переходов)
+	int getJumpTarget() const
+	{
+		return instruction_ == COMPARE_JUMP_NO ? arg2_ : arg_;
+	}
+
+	// Изменение адреса перехода (только для инструкций-переходов)
+	void setJumpTarget(int target)
+	{
+		if(instruction_ == COMPARE_JUMP_NO) {
+			arg2_ = target;
+		}
+		else {
+			arg_ = target;
+		}
+	}
+
+	// Номер строки исходного текста, из которой получена инструкция (0 - неизвестен)
+	int getLine() const
+	{
+		return line_;
+	}
+
+	void setLine(int line)
+	{
+		line_ = line;
+	}
+
 	// Печать инструкции
 	//     int address - адрес инструкции
 	//     ostream& os - поток вывода, куда будет напечатана инструкция
-	void print(int address, ostream& os);
+	void print(int address, ostream& os) const;
 
 private:
 	Instruction instruction_; // Код инструкции
 	int arg_;				  // Аргумент инструкции
+	int arg2_;				  // Второй аргумент (размер массива или аргумент суперинструкции)
+	int arg3_;				  // Третий аргумент (только у суперинструкций)
+	int line_;				  // Номер строки исходного текста
 };
 
+// Присвоение номеров строк инструкциям, созданным проходами над готовой программой
+// (оптимизатором, объединением в суперинструкции): инструкция без номера строки
+// получает номер предыдущей инструкции.
+void inheritLines(vector<Command>& program);
+
 // Кодогенератор.
 // Назначение кодогенератора:
 // - Формировать программу для виртуальной машины Милана
 // - Отслеживать адрес последней инструкции
 // - Буферизовать программу и печатать ее в указанный поток вывода
+//
+// В потоковом режиме (cmilan --stream) в буфере остается только код, который еще
+// может измениться: начиная с самой ранней зарезервированной, но не заполненной
+// инструкции (открытые операторы if и while). Все, что раньше, печатается при
+// вызове commit, поэтому память не зависит от размера программы. Адреса остаются
+// сквозными, напечатанный текст совпадает с текстом буферизованного режима.
+// После ошибки разбора парсер перестает вызывать commit; код, напечатанный до
+// оператора с ошибкой, остается в выводе (буферизованный режим не печатает ничего).
 
 class CodeGen
 {
 public:
 	explicit CodeGen(ostream& output)
-		: output_(output)
+		: output_(output), line_(0), stats_(0), streaming_(false), base_(0)
+	{
+	}
+
+	// Включение потокового режима. Вызывается до порождения первой инструкции.
+	void setStreaming(bool streaming)
+	{
+		streaming_ = streaming;
+	}
+
+	// Статистика компиляции, в которой учитываются добавленные инструкции (0 - не учитывать)
+	void setStats(CompileStats* stats)
 	{
+		stats_ = stats;
+	}
+
+	// Номер строки исходного текста, который получат следующие инструкции
+	void setLine(int line)
+	{
+		line_ = line;
 	}
 
 	// Добавление инструкции без аргументов в конец программы
@@ -77,12 +227,29 @@ public:
 	
 	// Добавление инструкции с одним аргументом в конец программы
 	void emit(Instruction instruction, int arg);
+
+	// Добавление инструкции с двумя аргументами в конец программы
+	void emit(Instruction instruction, int arg, int arg2);
 	
 	// Запись инструкции без аргументов по указанному адресу
 	void emitAt(int address, Instruction instruction);
 
 	// Запись инструкции с одним аргументом по указанному адресу
 	void emitAt(int address, Instruction instruction, int arg);
+
+	// Вставка инструкции с одним аргументом перед инструкцией с указанным адресом.
+	// Все последующие инструкции сдвигаются на одну позицию, поэтому вставлять
+	// можно только в участок кода без переходов (например, в код выражения).
+	void insert(int address, Instruction instruction, int arg);
+
+	// Перенос инструкций [address, end) в конец программы: порожденные после них
+	// инструкции сдвигаются на их место. Как и insert, применяется только к коду
+	// выражений, в котором нет переходов.
+	void moveToEnd(int address, int end);
+
+	// Проверка, есть ли среди инструкций [address, end) чтение ввода (INPUT).
+	// Как и moveToEnd, применяется к коду разбираемого выражения.
+	bool readsInput(int address, int end);
 	
 	// Получение адреса, непосредственно следующего за последней инструкцией в программе
 	int getCurrentAddress();
@@ -93,8 +260,26 @@ public:
 	// Запись последовательности инструкций в выходной поток
 	void flush();
 
+	// Печать инструкций, которые уже не могут измениться (только в потоковом режиме).
+	// Вызывается между операторами, когда не разбирается ни одно выражение: вставка
+	// (insert) может изменить код выражения, в котором нет зарезервированных инструкций.
+	void commit();
+
+	// Доступ к буферу инструкций для проходов над готовой программой и для ее выполнения
+	// (только в буферизованном режиме)
+	vector<Command>& getProgram()
+	{
+		return commandBuffer_;
+	}
+
 private:
 	ostream& output_;               // Выходной поток
+	int line_;                      // Номер текущей строки исходного текста
+	CompileStats* stats_;           // Статистика компиляции
+	bool streaming_;                // Потоковый режим
+	int base_;                      // Адрес первой инструкции буфера (уже напечатанные
+	                                // инструкции из буфера удалены)
+	set<int> reserved_;             // Зарезервированные и еще не заполненные адреса
 	vector<Command> commandBuffer_;	// Буфер инструкций
 };
 
@@ -0,0 +1,313 @@
+#include "fusion.h"
+#include <algorithm>
+#include <sstream>
+
+// Заполнение массива признаков "на инструкцию есть переход"
+static void markJumpTargets(const vector<Command>& program, vector<bool>& targets)
+{
+	targets.assign(program.size() + 1, false);
+	for(size_t i = 0; i < program.size(); ++i) {
+		if(isJump(program[i].getInstruction())) {
+			int target = program[i].getJumpTarget();
+			if(target >= 0 && target <= (int) program.size()) {
+				targets[target] = true;
+			}
+		}
+	}
+}
+
+// Суперинструкция "обычная операция с операндом из памяти" для LOAD a; op
+static Instruction loadOperation(Instruction op)
+{
+	switch(op) {
+		case ADD:
+			return LOAD_ADD;
+		case SUB:
+			return LOAD_SUB;
+		case MULT:
+			return LOAD_MULT;
+		default:
+			return NOP;
+	}
+}
+
+// Суперинструкция "операция с константой" для PUSH n; op
+static Instruction pushOperation(Instruction op)
+{
+	switch(op) {
+		case ADD:
+			return PUSH_ADD;
+		case SUB:
+			return PUSH_SUB;
+		case MULT:
+			return PUSH_MULT;
+		default:
+			return NOP;
+	}
+}
+
+// Трехадресная суперинструкция для LOAD a; LOAD b; op; STORE c
+static Instruction threeAddressOperation(Instruction op)
+{
+	switch(op) {
+		case ADD:
+			return ADD3;
+		case SUB:
+			return SUB3;
+		case MULT:
+			return MULT3;
+		default:
+			return NOP;
+	}
+}
+
+// Поиск всех суперинструкций, которыми можно заменить последовательность,
+// начинающуюся по адресу address. Найденные варианты добавляются в candidates.
+static void matchSuperinstructions(const vector<Command>& program, int address,
+	const vector<bool>& targets, vector<Command>& candidates)
+{
+	int size = program.size();
+
+	// Сколько инструкций подряд, начиная с address, можно объединить: внутрь
+	// последовательности не должно быть переходов.
+	int available = 1;
+	while(available < 4 && address + available < size && !targets[address + available]) {
+		++available;
+	}
+
+	const Command& c0 = program[address];
+	Instruction i0 = c0.getInstruction();
+	if(available < 2 || isJump(i0)) {
+		return;
+	}
+
+	const Command& c1 = program[address + 1];
+	Instruction i1 = c1.getInstruction();
+
+	if(i0 == LOAD) {
+		if(i1 == LOAD) {
+			candidates.push_back(Command(LOAD2, c0.getArg(), c1.getArg()));
+		}
+		else if(i1 == PUSH) {
+			candidates.push_back(Command(LOAD_PUSH, c0.getArg(), c1.getArg()));
+		}
+		else if(i1 == STORE) {
+			candidates.push_back(Command(LOAD_STORE, c0.getArg(), c1.getArg()));
+		}
+		else if(loadOperation(i1) != NOP) {
+			candidates.push_back(Command(loadOperation(i1), c0.getArg()));
+		}
+	}
+	else if(i0 == PUSH) {
+		if(i1 == STORE) {
+			candidates.push_back(Command(PUSH_STORE, c0.getArg(), c1.getArg()));
+		}
+		else if(i1 == COMPARE) {
+			candidates.push_back(Command(PUSH_COMPARE, c0.getArg(), c1.getArg()));
+		}
+		else if(pushOperation(i1) != NOP) {
+			candidates.push_back(Command(pushOperation(i1), c0.getArg()));
+		}
+	}
+	else if(i0 == STORE && i1 == STORE) {
+		candidates.push_back(Command(STORE2, c0.getArg(), c1.getArg()));
+	}
+	else if(i0 == COMPARE && i1 == JUMP_NO) {
+		candidates.push_back(Command(COMPARE_JUMP_NO, c0.getArg(), c1.getArg()));
+	}
+
+	if(available < 4 || i0 != LOAD) {
+		return;
+	}
+
+	const Command& c2 = program[address + 2];
+	const Command& c3 = program[address + 3];
+	if(c3.getInstruction() != STORE) {
+		return;
+	}
+
+	// LOAD a; PUSH n; ADD; STORE a
+	if(i1 == PUSH && c2.getInstruction() == ADD && c3.getArg() == c0.getArg()) {
+		candidates.push_back(Command(INCR, c0.getArg(), c1.getArg()));
+	}
+	// LOAD a; LOAD b; op; STORE c
+	else if(i1 == LOAD && threeAddressOperation(c2.getInstruction()) != NOP) {
+		candidates.push_back(Command(threeAddressOperation(c2.getInstruction()),
+			c0.getArg(), c1.getArg(), c3.getArg()));
+	}
+}
+
+int fusedLength(Instruction instruction)
+{
+	switch(instruction) {
+		case LOAD2:
+		case LOAD_PUSH:
+		case LOAD_ADD:
+		case LOAD_SUB:
+		case LOAD_MULT:
+		case PUSH_ADD:
+		case PUSH_SUB:
+		case PUSH_MULT:
+		case PUSH_COMPARE:
+		case COMPARE_JUMP_NO:
+		case LOAD_STORE:
+		case PUSH_STORE:
+		case STORE2:
+			return 2;
+
+		case INCR:
+		case ADD3:
+		case SUB3:
+		case MULT3:
+			return 4;
+
+		default:
+			return 1;
+	}
+}
+
+int fuseSuperinstructions(vector<Command>& program, vector<int>* sites)
+{
+	int size = program.size();
+	vector<bool> targets;
+	markJumpTargets(program, targets);
+
+	// Динамическое программирование с конца программы: best[i] - наименьшее количество
+	// инструкций, которым можно записать участок [i, size), choice[i] - выбранная замена
+	// для инструкции i (NOP, если инструкция остается как есть).
+	vector<int> best(size + 1, 0);
+	vector<Command> choice(size, Command(NOP));
+	vector<Command> candidates;
+	for(int i = size - 1; i >= 0; --i) {
+		best[i] = best[i + 1] + 1;
+		candidates.clear();
+		matchSuperinstructions(program, i, targets, candidates);
+		for(size_t k = 0; k < candidates.size(); ++k) {
+			int length = fusedLength(candidates[k].getInstruction());
+			if(best[i + length] + 1 < best[i]) {
+				best[i] = best[i + length] + 1;
+				choice[i] = candidates[k];
+			}
+		}
+	}
+
+	// Формирование новой программы и таблицы соответствия старых адресов новым
+	vector<Command> fused;
+	vector<int> newAddress(size + 1, 0);
+	int replaced = 0;
+	for(int i = 0; i < size; ) {
+		newAddress[i] = fused.size();
+		if(choice[i].getInstruction() != NOP) {
+			fused.push_back(choice[i]);
+			fused.back().setLine(program[i].getLine());
+			if(sites) {
+				++(*sites)[choice[i].getInstruction()];
+			}
+			++replaced;
+			i += fusedLength(choice[i].getInstruction());
+		}
+		else {
+			fused.push_back(program[i]);
+			++i;
+		}
+	}
+	newAddress[size] = fused.size();
+
+	// Пересчет адресов переходов. Переходы ведут только на начала последовательностей,
+	// поэтому каждый адрес перехода есть в таблице.
+	for(size_t i = 0; i < fused.size(); ++i) {
+		const Command& c = fused[i];
+		switch(c.getInstruction()) {
+			case JUMP:
+			case JUMP_YES:
+			case JUMP_NO:
+				fused[i].setJumpTarget(newAddress[c.getArg()]);
+				break;
+
+			case COMPARE_JUMP_NO:
+				fused[i].setJumpTarget(newAddress[c.getArg2()]);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	program.swap(fused);
+	return replaced;
+}
+
+void printFusionReport(ostream& os, const vector<int>& sites, const vector<long long>* executed)
+{
+	os << "superinstruction\tlength\tsites";
+	if(executed) {
+		os << "\texecuted";
+	}
+	os << endl;
+
+	for(int op = 0; op < INSTRUCTION_COUNT; ++op) {
+		Instruction instruction = (Instruction) op;
+		if(fusedLength(instruction) < 2 || sites[op] == 0) {
+			continue;
+		}
+		os << instructionToString(instruction) << "\t" << fusedLength(instruction) << "\t" << sites[op];
+		if(executed) {
+			os << "\t" << (*executed)[op];
+		}
+		os << endl;
+	}
+
+	if(executed) {
+		long long dispatches = 0;
+		long long unfused = 0;
+		for(int op = 0; op < INSTRUCTION_COUNT; ++op) {
+			dispatches += (*executed)[op];
+			unfused += (*executed)[op] * fusedLength((Instruction) op);
+		}
+		os << "dispatches: " << dispatches << " (" << unfused << " without superinstructions)" << endl;
+	}
+}
+
+void NgramMiner::addProgram(const vector<Command>& program)
+{
+	vector<bool> targets;
+	markJumpTargets(program, targets);
+
+	++programs_;
+	instructions_ += program.size();
+
+	int size = program.size();
+	for(int i = 0; i < size; ++i) {
+		string key = instructionToString(program[i].getInstruction());
+		for(int length = 2; length <= maxLength_ && i + length <= size; ++length) {
+			// последовательность не может продолжаться после передачи управления
+			// и не может содержать переход внутрь себя
+			Instruction last = program[i + length - 2].getInstruction();
+			if(isJump(last) || last == STOP || targets[i + length - 1]) {
+				break;
+			}
+			key += "; ";
+			key += instructionToString(program[i + length - 1].getInstruction());
+			++counts_[key];
+		}
+	}
+}
+
+void NgramMiner::report(ostream& os, int limit) const
+{
+	// сортировка по количеству сэкономленных диспетчеризаций
+	vector<pair<long long, string> > ranked;
+	for(map<string, long long>::const_iterator it = counts_.begin(); it != counts_.end(); ++it) {
+		long long length = count(it->first.begin(), it->first.end(), ';') + 1;
+		ranked.push_back(make_pair(it->second * (length - 1), it->first));
+	}
+	sort(ranked.rbegin(), ranked.rend());
+
+	os << "programs: " << programs_ << ", instructions: " << instructions_ << endl;
+	os << "saved\tcount\tsequence" << endl;
+	for(int i = 0; i < limit && i < (int) ranked.size(); ++i) {
+		const string& key = ranked[i].second;
+		long long length = count(key.begin(), key.end(), ';') + 1;
+		os << ranked[i].first << "\t" << ranked[i].first / (length - 1) << "\t" << key << endl;
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef CMILAN_FUSION_H
+#define CMILAN_FUSION_H
+
+#include "codegen.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Суперинструкции.
+//
+// Кодогенератор порождает короткие однотипные последовательности инструкций:
+// "LOAD a; LOAD b; ADD; STORE c" для присваиваний, "LOAD x; PUSH k; COMPARE n; JUMP_NO"
+// для условий, пары STORE/LOAD для комплексных чисел. Проход fuseSuperinstructions
+// заменяет такие последовательности суперинструкциями (см. codegen.h), каждая из которых
+// выполняется машиной за одну диспетчеризацию.
+//
+// Набор суперинструкций выбран по отчету NgramMiner на программах-образцах и
+// зафиксирован в коде: поддерживать его в машине проще, чем генерировать на лету.
+
+// Замена последовательностей инструкций суперинструкциями.
+//    vector<Command>& program - программа, изменяется на месте
+//    vector<int>* sites - если не 0, сюда добавляется количество подстановок по кодам
+//                         суперинструкций (массив размером INSTRUCTION_COUNT)
+//
+// Последовательности не объединяются через границу, на которую есть переход, поэтому
+// после подстановки все адреса переходов можно пересчитать. Среди возможных разбиений
+// выбирается то, которое дает наименьшее количество инструкций.
+// Возвращает количество выполненных подстановок.
+int fuseSuperinstructions(vector<Command>& program, vector<int>* sites);
+
+// Количество обычных инструкций, которое заменяет инструкция (1 для обычных инструкций)
+int fusedLength(Instruction instruction);
+
+// Печать отчета о суперинструкциях: сколько раз каждая была подставлена и,
+// если переданы счетчики выполнения машины, сколько раз выполнена.
+void printFusionReport(ostream& os, const vector<int>& sites, const vector<long long>* executed);
+
+// Поиск часто встречающихся последовательностей инструкций (n-грамм) в наборе программ.
+// Последовательности учитываются только внутри линейных участков: они не содержат
+// переходов в середине и не продолжаются после инструкций передачи управления.
+class NgramMiner
+{
+public:
+	// Конструктор. maxLength - наибольшая длина последовательности (не меньше 2).
+	explicit NgramMiner(int maxLength)
+		: maxLength_(maxLength < 2 ? 2 : maxLength), programs_(0), instructions_(0)
+	{}
+
+	// Учет очередной программы из корпуса
+	void addProgram(const vector<Command>& program);
+
+	// Печать limit последовательностей, замена которых сэкономила бы больше всего
+	// диспетчеризаций (количество вхождений * (длина - 1)).
+	void report(ostream& os, int limit) const;
+
+private:
+	int maxLength_;                    // наибольшая длина последовательности
+	int programs_;                     // количество программ в корпусе
+	long long instructions_;           // общее количество инструкций в корпусе
+	map<string, long long> counts_;    // количество вхождений каждой последовательности
+};
+
+#endif
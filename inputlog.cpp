@@ -0,0 +1,95 @@
+#include "inputlog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Заголовок файла журнала
+struct InputLogHeader
+{
+	char magic[4];              // "CMVI"
+	unsigned version;           // версия формата
+};
+
+static const char inputLogMagic[4] = { 'C', 'M', 'V', 'I' };
+static const unsigned inputLogVersion = 1;
+
+bool InputRecorder::open(const string& file)
+{
+	name_ = file;
+	file_.open(file.c_str(), ios::binary | ios::trunc);
+	InputLogHeader header;
+	memcpy(header.magic, inputLogMagic, sizeof(header.magic));
+	header.version = inputLogVersion;
+	file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if(!file_) {
+		cerr << "Cannot write '" << file << "'" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool InputRecorder::close()
+{
+	writer_.flush();
+	file_.close();
+	if(!file_) {
+		cerr << "Cannot write '" << name_ << "'" << endl;
+		return false;
+	}
+	return true;
+}
+
+InputReplay::~InputReplay()
+{
+	if(data_) {
+		munmap(data_, size_);
+	}
+}
+
+bool InputReplay::open(const string& file)
+{
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if(fd < 0) {
+		cerr << "File '" << file << "' not found" << endl;
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(InputLogHeader)
+		|| (st.st_size - sizeof(InputLogHeader)) % sizeof(int) != 0) {
+		::close(fd);
+		cerr << "File '" << file << "' is not a valid input log" << endl;
+		return false;
+	}
+	size_t size = st.st_size;
+	void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED) {
+		cerr << "Cannot map input log '" << file << "'" << endl;
+		return false;
+	}
+
+	const InputLogHeader* header = static_cast<const InputLogHeader*>(data);
+	if(memcmp(header->magic, inputLogMagic, sizeof(header->magic)) != 0
+		|| header->version != inputLogVersion) {
+		munmap(data, size);
+		cerr << "File '" << file << "' is not a valid input log" << endl;
+		return false;
+	}
+	// Значения читаются многократно, последовательно
+	madvise(data, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+	data_ = data;
+	size_ = size;
+	return true;
+}
+
+const int* InputReplay::getValues() const
+{
+	return reinterpret_cast<const int*>(static_cast<const InputLogHeader*>(data_) + 1);
+}
+
+size_t InputReplay::getCount() const
+{
+	return data_ ? (size_ - sizeof(InputLogHeader)) / sizeof(int) : 0;
+}
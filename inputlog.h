@@ -0,0 +1,76 @@
+#ifndef CMILAN_INPUTLOG_H
+#define CMILAN_INPUTLOG_H
+
+#include "intio.h"
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+// Журналы ввода (cmilan --run --record-input FILE, --replay-input FILE).
+//
+// При записи каждое значение, прочитанное инструкцией INPUT, добавляется в журнал;
+// при воспроизведении INPUT берет значения из журнала, а не из стандартного ввода.
+// Журнал отображается в память (mmap) и читается как массив, без разбора текста
+// и системных вызовов, поэтому время выполнения не зависит от источника ввода.
+//
+// Формат файла (порядок байтов машины, на которой запускается cmilan):
+//    4 байта "CMVI" и 32-битная версия формата;
+//    32-битные значения ввода в порядке чтения.
+
+// Запись журнала ввода
+class InputRecorder
+{
+public:
+	InputRecorder()
+		: writer_(file_)
+	{
+		writer_.setBinary(true);
+	}
+
+	// Создание файла журнала. При ошибке печатает сообщение и возвращает false.
+	bool open(const string& file);
+
+	// Поток, в который машина записывает прочитанные значения (см. IntegerReader::setRecording)
+	IntegerWriter* getWriter()
+	{
+		return &writer_;
+	}
+
+	// Завершение записи. При ошибке печатает сообщение и возвращает false.
+	bool close();
+
+private:
+	string name_;               // имя файла
+	ofstream file_;             // файл журнала
+	IntegerWriter writer_;      // буферизованная запись значений в file_
+};
+
+// Журнал ввода, отображенный в память
+class InputReplay
+{
+public:
+	InputReplay()
+		: data_(0), size_(0)
+	{}
+
+	~InputReplay();
+
+	// Отображение журнала в память. При ошибке печатает сообщение и возвращает false.
+	bool open(const string& file);
+
+	// Значения журнала
+	const int* getValues() const;
+
+	// Количество значений
+	size_t getCount() const;
+
+private:
+	InputReplay(const InputReplay&);
+	InputReplay& operator=(const InputReplay&);
+
+	void* data_;                // отображение файла (0 - файл не открыт)
+	size_t size_;               // размер отображения
+};
+
+#endif
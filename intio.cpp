@@ -0,0 +1,101 @@
+#include "intio.h"
+#include <climits>
+#include <string>
+
+bool IntegerReader::fill()
+{
+	if(interactive_) {
+		// По строке за раз: в интерактивном режиме следующая строка может появиться
+		// только после того, как программа напечатает ответ на предыдущую
+		string line;
+		if(!getline(input_, line)) {
+			return false;
+		}
+		line += '\n';
+		if(line.size() > buffer_.size()) {
+			buffer_.resize(line.size());
+		}
+		line.copy(&buffer_[0], line.size());
+		position_ = 0;
+		end_ = line.size();
+		return true;
+	}
+	input_.read(&buffer_[0], buffer_.size());
+	position_ = 0;
+	end_ = input_.gcount();
+	return end_ > 0;
+}
+
+bool IntegerReader::readText(int& value)
+{
+	int c = peek();
+	while(c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f') {
+		++position_;
+		c = peek();
+	}
+
+	bool negative = false;
+	if(c == '-' || c == '+') {
+		negative = c == '-';
+		++position_;
+		c = peek();
+	}
+	if(c < '0' || c > '9') {
+		return false;
+	}
+
+	// Модуль числа накапливается в unsigned, чтобы поместился и -INT_MIN
+	unsigned limit = negative ? (unsigned) INT_MAX + 1 : (unsigned) INT_MAX;
+	unsigned result = 0;
+	do {
+		unsigned digit = c - '0';
+		if(result > (limit - digit) / 10) {
+			return false;
+		}
+		result = result * 10 + digit;
+		++position_;
+		c = peek();
+	} while(c >= '0' && c <= '9');
+
+	value = negative ? (int) (0u - result) : (int) result;
+	return true;
+}
+
+bool IntegerReader::readBinary(int& value)
+{
+	char* bytes = reinterpret_cast<char*>(&value);
+	for(int k = 0; k < 4; ++k) {
+		int c = peek();
+		if(c < 0) {
+			return false;
+		}
+		bytes[k] = (char) c;
+		++position_;
+	}
+	return true;
+}
+
+// Определение вынесено из read: IntegerWriter в объявлении IntegerReader неполный
+void IntegerReader::record(int value)
+{
+	recording_->write(value);
+}
+
+void IntegerWriter::writeText(int value)
+{
+	char digits[12];
+	int count = 0;
+	unsigned magnitude = value < 0 ? 0u - (unsigned) value : (unsigned) value;
+	do {
+		digits[count++] = (char) ('0' + magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude > 0);
+
+	if(value < 0) {
+		buffer_[end_++] = '-';
+	}
+	while(count > 0) {
+		buffer_[end_++] = digits[--count];
+	}
+	buffer_[end_++] = '\n';
+}
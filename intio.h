@@ -0,0 +1,189 @@
+#ifndef CMILAN_INTIO_H
+#define CMILAN_INTIO_H
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Ввод и вывод целых чисел для инструкций INPUT и PRINT.
+//
+// Числа читаются и печатаются через собственные буферы большого размера, а переводятся
+// из текста и в текст вручную, без форматирования потоков. Текстовый формат совпадает
+// с operator>> и operator<< для int: при чтении пропускаются пробельные символы,
+// допускается знак, число, не помещающееся в int, - ошибка; при печати каждое число
+// занимает отдельную строку. В двоичном режиме каждое число - 4 байта в порядке байтов
+// машины.
+//
+// Вывод передается в поток, когда буфер заполнен, и при вызове flush (машины вызывают
+// его по окончании программы и при ошибке). В интерактивном режиме каждое число сразу
+// выталкивается в поток, а ввод читается по строкам, чтобы не ждать заполнения буфера.
+//
+// Вместо потока ввод может браться из готового массива значений (воспроизведение
+// журнала, см. inputlog.h), а каждое прочитанное значение - дублироваться в поток
+// записи журнала.
+
+// Размер буферов ввода и вывода
+const int INTEGER_IO_BUFFER = 1 << 16;
+
+class IntegerWriter;
+
+class IntegerReader
+{
+public:
+	explicit IntegerReader(istream& input)
+		: input_(input), buffer_(INTEGER_IO_BUFFER), position_(0), end_(0), binary_(false),
+		  interactive_(false), replay_(0), replayCount_(0), replayPosition_(0), recording_(0)
+	{}
+
+	void setBinary(bool binary)
+	{
+		binary_ = binary;
+	}
+
+	void setInteractive(bool interactive)
+	{
+		interactive_ = interactive;
+	}
+
+	// Чтение значений из массива values (count значений) вместо потока
+	void setReplay(const int* values, size_t count)
+	{
+		replay_ = values;
+		replayCount_ = count;
+		replayPosition_ = 0;
+	}
+
+	// Запись каждого прочитанного значения в recording (0 - не записывать)
+	void setRecording(IntegerWriter* recording)
+	{
+		recording_ = recording;
+	}
+
+	// Чтение числа. Возвращает false, если ввод исчерпан или не содержит целого числа.
+	bool read(int& value)
+	{
+		bool ok;
+		if(replay_) {
+			ok = replayPosition_ < replayCount_;
+			if(ok) {
+				value = replay_[replayPosition_++];
+			}
+		}
+		else {
+			ok = binary_ ? readBinary(value) : readText(value);
+		}
+		if(ok && recording_) {
+			record(value);
+		}
+		return ok;
+	}
+
+	// Отбрасывание прочитанного в буфер, но еще не разобранного ввода. Вызывается,
+	// когда содержимое потока заменено (например, очередной записью в runRecords).
+	// Воспроизведение журнала начинается сначала.
+	void discard()
+	{
+		position_ = end_ = 0;
+		replayPosition_ = 0;
+	}
+
+private:
+	// Очередной символ ввода без изъятия из буфера (-1 - ввод исчерпан)
+	int peek()
+	{
+		if(position_ == end_ && !fill()) {
+			return -1;
+		}
+		return (unsigned char) buffer_[position_];
+	}
+
+	// Заполнение буфера. Возвращает false, если ввод исчерпан.
+	bool fill();
+
+	bool readText(int& value);
+	bool readBinary(int& value);
+	void record(int value);
+
+	istream& input_;            // поток ввода
+	vector<char> buffer_;       // буфер
+	size_t position_;           // первый неразобранный символ буфера
+	size_t end_;                // конец прочитанной части буфера
+	bool binary_;               // двоичный режим
+	bool interactive_;          // интерактивный режим
+	const int* replay_;         // воспроизводимые значения (0 - читать из потока)
+	size_t replayCount_;        // количество воспроизводимых значений
+	size_t replayPosition_;     // следующее воспроизводимое значение
+	IntegerWriter* recording_;  // запись прочитанных значений (0 - не записывать)
+};
+
+class IntegerWriter
+{
+public:
+	explicit IntegerWriter(ostream& output)
+		: output_(output), buffer_(INTEGER_IO_BUFFER), end_(0), binary_(false), interactive_(false)
+	{}
+
+	~IntegerWriter()
+	{
+		sync();
+	}
+
+	void setBinary(bool binary)
+	{
+		binary_ = binary;
+	}
+
+	void setInteractive(bool interactive)
+	{
+		interactive_ = interactive;
+	}
+
+	// Печать числа
+	void write(int value)
+	{
+		if(end_ + 16 > buffer_.size()) {
+			sync();
+		}
+		if(binary_) {
+			const char* bytes = reinterpret_cast<const char*>(&value);
+			buffer_[end_++] = bytes[0];
+			buffer_[end_++] = bytes[1];
+			buffer_[end_++] = bytes[2];
+			buffer_[end_++] = bytes[3];
+		}
+		else {
+			writeText(value);
+		}
+		if(interactive_) {
+			flush();
+		}
+	}
+
+	// Передача содержимого буфера в поток без выталкивания потока
+	void sync()
+	{
+		if(end_ > 0) {
+			output_.write(&buffer_[0], end_);
+			end_ = 0;
+		}
+	}
+
+	// Передача содержимого буфера в поток и выталкивание потока
+	void flush()
+	{
+		sync();
+		output_.flush();
+	}
+
+private:
+	void writeText(int value);
+
+	ostream& output_;           // поток вывода
+	vector<char> buffer_;       // буфер
+	size_t end_;                // конец заполненной части буфера
+	bool binary_;               // двоичный режим
+	bool interactive_;          // интерактивный режим
+};
+
+#endif
@@ -1,32 +1,608 @@
 #include "parser.h"
+#include "batch.h"
+#include "fusion.h"
+#include "inputlog.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "regvm.h"
+#include "runner.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "verifier.h"
+#include "vm.h"
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <csignal>
+#include <unistd.h>
 
 using namespace std;
 
 void printHelp()
 {
-	cout << "Usage: cmilan input_file" << endl;
+	cout << "Usage: cmilan [options] input_file" << endl;
+	cout << "       cmilan --ngrams N input_file..." << endl;
+	cout << "Options:" << endl;
+	cout << "  -O                 optimize the program" << endl;
+	cout << "  --run              execute the program in the built-in virtual machine" << endl;
+	cout << "  --cache-top        with --run, keep up to two top stack words in registers" << endl;
+	cout << "  --batch FILE       run the program for every column of the table in FILE" << endl;
+	cout << "                     (row k holds the k-th input value of each instance)" << endl;
+	cout << "                     and print the results as a table" << endl;
+	cout << "  --inputs FILE      run the program once for every input record in FILE" << endl;
+	cout << "  -j N               number of threads for --inputs (default: all processors)" << endl;
+	cout << "  --cooperative      run the records of --inputs as cooperatively scheduled" << endl;
+	cout << "                     contexts that receive their input one value at a time" << endl;
+	cout << "  --budget N         instructions a context may run before it is preempted" << endl;
+	cout << "                     (default 10000); with --checkpoint, how often the signals" << endl;
+	cout << "                     are checked" << endl;
+	cout << "  --profile          with --run, print execution counts by instruction, source" << endl;
+	cout << "                     line and loop to stderr" << endl;
+	cout << "  --profile-folded FILE" << endl;
+	cout << "                     with --run, write the execution counts to FILE as folded" << endl;
+	cout << "                     stacks for flame graph tools" << endl;
+	cout << "  --profile-generate=FILE" << endl;
+	cout << "                     with --run, write how often each condition was true and" << endl;
+	cout << "                     false to FILE" << endl;
+	cout << "  --profile-use=FILE place the frequent branch of each condition in FILE inline" << endl;
+	cout << "                     and the rare one out of line; with -O, unroll loops by it" << endl;
+	cout << "  --checkpoint FILE  save the machine state to FILE periodically and on SIGINT or" << endl;
+	cout << "                     SIGTERM, and resume from FILE if it exists" << endl;
+	cout << "  --checkpoint-every N" << endl;
+	cout << "                     instructions between checkpoints (default 100000000)" << endl;
+	cout << "  --binary-io        with --run, read and write the numbers as 4-byte binary words" << endl;
+	cout << "  --interactive      with --run, read the input by lines and write every number" << endl;
+	cout << "                     at once instead of at the end of the program" << endl;
+	cout << "  --record-input FILE with --run, also write every value read by the program to FILE" << endl;
+	cout << "  --replay-input FILE with --run, read the input values from FILE written by" << endl;
+	cout << "                     --record-input instead of the standard input" << endl;
+	cout << "  --target=stack     generate code for the stack machine (default)" << endl;
+	cout << "  --target=reg       generate code for the register machine" << endl;
+	cout << "  --count            print the number of executed instructions to stderr" << endl;
+	cout << "  --verify           check the program and print its stack depth and memory size" << endl;
+	cout << "                     before the code" << endl;
+	cout << "  --fuse             replace frequent instruction sequences with superinstructions" << endl;
+	cout << "  --fusion-report    print superinstruction statistics to stderr" << endl;
+	cout << "  --stream           print the program while it is being generated, keeping only" << endl;
+	cout << "                     the code of open if and while statements in memory;" << endl;
+	cout << "                     nothing is printed after a compile error" << endl;
+	cout << "  --time-report      print the wall and CPU time of each compiler phase to stderr" << endl;
+	cout << "  --stats            print token, symbol table and code generation counters and" << endl;
+	cout << "                     the peak memory use to stderr" << endl;
+	cout << "  --stats-json FILE  write the phase times and counters to FILE as JSON" << endl;
+	cout << "  --ngrams N         print the most frequent instruction sequences of length 2..N" << endl;
+	cout << "                     found in the input files" << endl;
+}
+
+// Поиск n-грамм в программах, перечисленных в командной строке
+int mineNgrams(const vector<string>& files, int maxLength)
+{
+	NgramMiner miner(maxLength);
+	for(size_t i = 0; i < files.size(); ++i) {
+		ifstream input(files[i].c_str());
+		if(!input) {
+			cerr << "File '" << files[i] << "' not found" << endl;
+			return EXIT_FAILURE;
+		}
+
+		Parser p(files[i], input);
+		if(p.compile()) {
+			miner.addProgram(p.getCodeGen().getProgram());
+		}
+	}
+	miner.report(cout, 40);
+	return EXIT_SUCCESS;
+}
+
+// Пакетное выполнение программы для всех столбцов таблицы входных данных
+int runBatch(const vector<Command>& program, const char* file, bool count)
+{
+	ifstream input(file);
+	if(!input) {
+		cerr << "File '" << file << "' not found" << endl;
+		return EXIT_FAILURE;
+	}
+	vector<vector<int> > inputs;
+	if(!readColumns(input, inputs)) {
+		cerr << "File '" << file << "' must contain a table of integers" << endl;
+		return EXIT_FAILURE;
+	}
+
+	BatchMachine machine(program, inputs);
+	bool ok = machine.run();
+	printColumns(cout, machine, inputs.size());
+	for(size_t l = 0; l < inputs.size(); ++l) {
+		if(!machine.getError(l).empty()) {
+			cerr << "Instance " << l << ": " << machine.getError(l) << endl;
+		}
+	}
+	if(count) {
+		cerr << "executed: " << machine.getExecutedCount()
+			<< ", dispatches: " << machine.getDispatchCount() << endl;
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Выполнение записей кооперативным планировщиком. Значения передаются контекстам
+// по одному, по очереди всем контекстам, как если бы ввод приходил постепенно.
+int scheduleRecords(const vector<Command>& program, const vector<vector<int> >& records,
+	int threads, long long budget, bool count)
+{
+	Scheduler scheduler(program, threads, budget);
+	for(size_t i = 0; i < records.size(); ++i) {
+		scheduler.spawn();
+	}
+	scheduler.start();
+
+	size_t longest = 0;
+	for(size_t i = 0; i < records.size(); ++i) {
+		longest = max(longest, records[i].size());
+	}
+	for(size_t k = 0; k <= longest; ++k) {
+		for(size_t i = 0; i < records.size(); ++i) {
+			if(k < records[i].size()) {
+				scheduler.provideInput(i, records[i][k]);
+			}
+			else if(k == records[i].size()) {
+				scheduler.closeInput(i);
+			}
+		}
+	}
+	scheduler.wait();
+
+	bool ok = true;
+	for(size_t i = 0; i < records.size(); ++i) {
+		cout << scheduler.getOutput(i) << '\n';
+		string errors = scheduler.getErrors(i);
+		if(!errors.empty()) {
+			cerr << "Record " << i << ": " << errors;
+			ok = false;
+		}
+	}
+	cout.flush();
+	if(count) {
+		cerr << "contexts: " << records.size() << ", preemptions: " << scheduler.getPreemptions()
+			<< ", parks: " << scheduler.getParks() << endl;
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Печать статистики компиляции при выходе из main, каким бы путем он ни произошел
+struct StatsReport
+{
+	StatsReport(const CompileStats* s, bool t, bool c, const char* j)
+		: stats(s), times(t), counters(c), jsonFile(j)
+	{}
+
+	~StatsReport()
+	{
+		if(!stats) {
+			return;
+		}
+		if(times) {
+			stats->printTimes(cerr);
+		}
+		if(counters) {
+			stats->printCounters(cerr);
+		}
+		if(jsonFile) {
+			ofstream json(jsonFile);
+			stats->printJson(json);
+			if(!json) {
+				cerr << "Cannot write '" << jsonFile << "'" << endl;
+			}
+		}
+	}
+
+	const CompileStats* stats;  // статистика (0, если не собиралась)
+	bool times;                 // печатать время фаз
+	bool counters;              // печатать счетчики
+	const char* jsonFile;       // файл для JSON (0 - не записывать)
+};
+
+// Признак получения SIGINT или SIGTERM во время выполнения с --checkpoint
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int)
+{
+	interrupted = 1;
+}
+
+// Выполнение программы со снимками состояния. Машина выполняется порциями по budget
+// инструкций; снимок записывается, когда с предыдущего выполнено не меньше every
+// инструкций, и при получении сигнала, после чего выполнение прерывается. Если файл
+// снимка уже существует, выполнение продолжается с него. После завершения программы
+// файл снимка удаляется.
+int runWithCheckpoints(const vector<Command>& program, VirtualMachine& vm, const char* file,
+	long long every, long long budget)
+{
+	if(access(file, F_OK) == 0) {
+		if(!loadSnapshot(file, program, vm)) {
+			return EXIT_FAILURE;
+		}
+	}
+	else {
+		vm.reset();
+	}
+
+	signal(SIGINT, interrupt);
+	signal(SIGTERM, interrupt);
+	long long saved = vm.getExecutedCount();
+	RunStatus status;
+	while((status = vm.resume(budget)) == RUN_PREEMPTED) {
+		if(interrupted) {
+			cout.flush();
+			if(!saveSnapshot(file, program, vm)) {
+				return EXIT_FAILURE;
+			}
+			cerr << "Interrupted, state saved to '" << file << "'" << endl;
+			return EXIT_FAILURE;
+		}
+		if(vm.getExecutedCount() - saved >= every) {
+			// Вывод, напечатанный до снимка, не должен повториться после восстановления
+			cout.flush();
+			if(!saveSnapshot(file, program, vm)) {
+				return EXIT_FAILURE;
+			}
+			saved = vm.getExecutedCount();
+		}
+	}
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if(status == RUN_FINISHED) {
+		remove(file);
+		return EXIT_SUCCESS;
+	}
+	return EXIT_FAILURE;
 }
 
 int main(int argc, char** argv)
 {
-	if(argc < 2) {
+	bool optimizeProgram = false;
+	bool run = false;
+	bool fuse = false;
+	bool fusionReport = false;
+	bool registerTarget = false;
+	bool count = false;
+	bool verify = false;
+	bool cacheTop = false;
+	const char* batchFile = 0;
+	const char* recordsFile = 0;
+	int threads = 0;
+	bool cooperative = false;
+	long long budget = 10000;
+	bool profile = false;
+	const char* foldedFile = 0;
+	const char* profileGenerate = 0;
+	const char* profileUse = 0;
+	const char* checkpointFile = 0;
+	long long checkpointEvery = 100000000;
+	bool binaryIO = false;
+	bool interactive = false;
+	const char* recordInput = 0;
+	const char* replayInput = 0;
+	bool stream = false;
+	bool timeReport = false;
+	bool printStats = false;
+	const char* statsJson = 0;
+	int ngrams = 0;
+	vector<string> files;
+
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "-O")) {
+			optimizeProgram = true;
+		}
+		else if(!strcmp(argv[i], "--run")) {
+			run = true;
+		}
+		else if(!strcmp(argv[i], "--fuse")) {
+			fuse = true;
+		}
+		else if(!strcmp(argv[i], "--fusion-report")) {
+			fusionReport = true;
+		}
+		else if(!strcmp(argv[i], "--target=stack")) {
+			registerTarget = false;
+		}
+		else if(!strcmp(argv[i], "--target=reg")) {
+			registerTarget = true;
+		}
+		else if(!strcmp(argv[i], "--count")) {
+			count = true;
+		}
+		else if(!strcmp(argv[i], "--verify")) {
+			verify = true;
+		}
+		else if(!strcmp(argv[i], "--cache-top")) {
+			cacheTop = true;
+		}
+		else if(!strcmp(argv[i], "--batch") && i + 1 < argc) {
+			batchFile = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--inputs") && i + 1 < argc) {
+			recordsFile = argv[++i];
+		}
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--cooperative")) {
+			cooperative = true;
+		}
+		else if(!strcmp(argv[i], "--budget") && i + 1 < argc) {
+			budget = atoll(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--profile")) {
+			profile = true;
+		}
+		else if(!strcmp(argv[i], "--profile-folded") && i + 1 < argc) {
+			foldedFile = argv[++i];
+		}
+		else if(!strncmp(argv[i], "--profile-generate=", 19) && argv[i][19]) {
+			profileGenerate = argv[i] + 19;
+		}
+		else if(!strncmp(argv[i], "--profile-use=", 14) && argv[i][14]) {
+			profileUse = argv[i] + 14;
+		}
+		else if(!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+			checkpointFile = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--checkpoint-every") && i + 1 < argc) {
+			checkpointEvery = atoll(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--binary-io")) {
+			binaryIO = true;
+		}
+		else if(!strcmp(argv[i], "--interactive")) {
+			interactive = true;
+		}
+		else if(!strcmp(argv[i], "--record-input") && i + 1 < argc) {
+			recordInput = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--replay-input") && i + 1 < argc) {
+			replayInput = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--stream")) {
+			stream = true;
+		}
+		else if(!strcmp(argv[i], "--time-report")) {
+			timeReport = true;
+		}
+		else if(!strcmp(argv[i], "--stats")) {
+			printStats = true;
+		}
+		else if(!strcmp(argv[i], "--stats-json") && i + 1 < argc) {
+			statsJson = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--ngrams") && i + 1 < argc) {
+			ngrams = atoi(argv[++i]);
+		}
+		else if(argv[i][0] == '-') {
+			cerr << "Unknown option '" << argv[i] << "'" << endl;
+			printHelp();
+			return EXIT_FAILURE;
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+
+	if(files.empty()) {
 		printHelp();
 		return EXIT_FAILURE;
 	}
 
+	if(ngrams > 0) {
+		return mineNgrams(files, ngrams);
+	}
+
+	if(registerTarget && (fuse || fusionReport)) {
+		cerr << "Superinstructions are not supported by the register machine" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(stream && (optimizeProgram || run || fuse || fusionReport || registerTarget || verify
+		|| batchFile || recordsFile || profileUse)) {
+		cerr << "--stream only prints the program as it is generated" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if((recordInput || replayInput) && (!run || batchFile || recordsFile)) {
+		cerr << "--record-input and --replay-input require --run" << endl;
+		return EXIT_FAILURE;
+	}
+
 	ifstream input;
-        input.open(argv[1]);
+        input.open(files[0].c_str());
 
-	if(input) {
-		Parser p(argv[1], input);
-		p.parse();
-		return EXIT_SUCCESS;
+	if(!input) {
+		cerr << "File '" << files[0] << "' not found" << endl;
+		return EXIT_FAILURE;
 	}
-	else {
-		cerr << "File '" << argv[1] << "' not found" << endl;
+
+	CompileStats compileStats;
+	CompileStats* stats = timeReport || printStats || statsJson ? &compileStats : 0;
+	StatsReport report(stats, timeReport, printStats, statsJson);
+
+	Parser p(files[0], input, stats);
+	p.getCodeGen().setStreaming(stream);
+	{
+		PhaseTimer timer(stats, PHASE_PARSE);
+		if(!p.compile()) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	vector<Command>& program = p.getCodeGen().getProgram();
+	BranchProfile branchProfile;
+	if(profileUse) {
+		ifstream data(profileUse);
+		if(!data) {
+			cerr << "File '" << profileUse << "' not found" << endl;
+			return EXIT_FAILURE;
+		}
+		if(!branchProfile.read(data)) {
+			cerr << "File '" << profileUse << "' is not a valid profile" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	{
+		PhaseTimer timer(stats, PHASE_OPTIMIZE);
+		if(optimizeProgram) {
+			optimize(program, profileUse ? &branchProfile : 0);
+		}
+		if(profileUse) {
+			layoutBlocks(program, branchProfile);
+		}
+	}
+
+	if(batchFile) {
+		PhaseTimer timer(stats, PHASE_RUN);
+		return runBatch(program, batchFile, count);
+	}
+
+	if(recordsFile) {
+		ifstream records(recordsFile, ios::binary);
+		if(!records) {
+			cerr << "File '" << recordsFile << "' not found" << endl;
+			return EXIT_FAILURE;
+		}
+		vector<vector<int> > inputs;
+		if(!readRecords(records, inputs)) {
+			cerr << "File '" << recordsFile << "' is not a valid record file" << endl;
+			return EXIT_FAILURE;
+		}
+		PhaseTimer timer(stats, PHASE_RUN);
+		if(cooperative) {
+			return scheduleRecords(program, inputs, threads, budget, count);
+		}
+		return runRecords(program, inputs, threads, cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	InputRecorder recorder;
+	if(recordInput && !recorder.open(recordInput)) {
 		return EXIT_FAILURE;
 	}
-}
+	InputReplay replay;
+	if(replayInput && !replay.open(replayInput)) {
+		return EXIT_FAILURE;
+	}
+
+	if(registerTarget) {
+		RegisterProgram registerProgram;
+		if(!translateToRegisters(program, registerProgram)) {
+			return EXIT_FAILURE;
+		}
+		if(!run) {
+			registerProgram.print(cout);
+			return EXIT_SUCCESS;
+		}
 
+		RegisterMachine vm(registerProgram, cin, cout);
+		vm.setBinaryIO(binaryIO);
+		vm.setInteractive(interactive);
+		if(recordInput) {
+			vm.setInputRecording(recorder.getWriter());
+		}
+		if(replayInput) {
+			vm.setInputReplay(replay.getValues(), replay.getCount());
+		}
+		bool ok;
+		{
+			PhaseTimer timer(stats, PHASE_RUN);
+			ok = vm.run();
+			cout.flush();
+		}
+		if(count) {
+			cerr << "executed: " << vm.getExecutedCount() << endl;
+		}
+		if(recordInput && !recorder.close()) {
+			return EXIT_FAILURE;
+		}
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	vector<int> sites(INSTRUCTION_COUNT, 0);
+	if(fuse) {
+		PhaseTimer timer(stats, PHASE_FUSE);
+		fuseSuperinstructions(program, &sites);
+	}
+
+	if(run) {
+		VirtualMachine vm(program, cin, cout);
+		vm.setStackCaching(cacheTop);
+		vm.setBinaryIO(binaryIO);
+		vm.setInteractive(interactive);
+		if(recordInput) {
+			vm.setInputRecording(recorder.getWriter());
+		}
+		if(replayInput) {
+			vm.setInputReplay(replay.getValues(), replay.getCount());
+		}
+		vector<long long> executed(program.size(), 0);
+		if(fusionReport || profile || foldedFile || profileGenerate) {
+			vm.setInstructionCounts(&executed);
+		}
+		bool ok;
+		{
+			PhaseTimer timer(stats, PHASE_RUN);
+			ok = checkpointFile
+				? runWithCheckpoints(program, vm, checkpointFile, checkpointEvery, budget) == EXIT_SUCCESS
+				: vm.run();
+			cout.flush();
+		}
+		if(count) {
+			cerr << "executed: " << vm.getExecutedCount() << endl;
+		}
+		if(recordInput && !recorder.close()) {
+			return EXIT_FAILURE;
+		}
+		if(fusionReport) {
+			vector<long long> opcodes;
+			countOpcodes(program, executed, opcodes);
+			printFusionReport(cerr, sites, &opcodes);
+		}
+		if(profile) {
+			printProfile(cerr, program, executed);
+		}
+		if(profileGenerate) {
+			BranchProfile generated;
+			generated.collect(program, executed);
+			ofstream data(profileGenerate);
+			generated.write(data);
+			if(!data) {
+				cerr << "Cannot write '" << profileGenerate << "'" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		if(foldedFile) {
+			ofstream folded(foldedFile);
+			printFoldedProfile(folded, files[0], program, executed);
+			if(!folded) {
+				cerr << "Cannot write '" << foldedFile << "'" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if(verify) {
+		ProgramInfo info;
+		if(!verifyProgram(program, info)) {
+			cerr << "Verification error at " << info.errorAddress << ": " << info.error << endl;
+			return EXIT_FAILURE;
+		}
+		cout << "; stack depth: " << info.maxStackDepth << endl;
+		cout << "; memory size: " << info.memorySize << endl;
+	}
+	{
+		PhaseTimer timer(stats, PHASE_EMIT);
+		p.getCodeGen().flush();
+		cout.flush();
+	}
+	if(fusionReport) {
+		printFusionReport(cerr, sites, 0);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,2240 @@
+#include "optimizer.h"
+#include "vm.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+
+// Множество ячеек памяти (битовая шкала)
+class CellSet
+{
+public:
+	explicit CellSet(int size = 0)
+		: bits_((size + 63) / 64, 0)
+	{}
+
+	bool contains(int cell) const
+	{
+		return (bits_[cell / 64] >> (cell % 64)) & 1;
+	}
+
+	void add(int cell)
+	{
+		bits_[cell / 64] |= 1ULL << (cell % 64);
+	}
+
+	void remove(int cell)
+	{
+		bits_[cell / 64] &= ~(1ULL << (cell % 64));
+	}
+
+	// Добавление ячеек [first, last) (ячеек массива)
+	void addRange(int first, int last)
+	{
+		for(; first < last && first % 64 != 0; ++first) {
+			add(first);
+		}
+		for(; first + 64 <= last; first += 64) {
+			bits_[first / 64] = ~0ULL;
+		}
+		for(; first < last; ++first) {
+			add(first);
+		}
+	}
+
+	// Удаление всех ячеек, которые есть в другом множестве
+	void subtract(const CellSet& other)
+	{
+		for(size_t i = 0; i < bits_.size(); ++i) {
+			bits_[i] &= ~other.bits_[i];
+		}
+	}
+
+	// Объединение с другим множеством. Возвращает true, если множество изменилось.
+	bool unite(const CellSet& other)
+	{
+		bool changed = false;
+		for(size_t i = 0; i < bits_.size(); ++i) {
+			unsigned long long merged = bits_[i] | other.bits_[i];
+			if(merged != bits_[i]) {
+				bits_[i] = merged;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// Перечисление элементов множества
+	void list(vector<int>& cells) const
+	{
+		cells.clear();
+		for(size_t i = 0; i < bits_.size(); ++i) {
+			unsigned long long word = bits_[i];
+			while(word) {
+				int bit = __builtin_ctzll(word);
+				cells.push_back(i * 64 + bit);
+				word &= word - 1;
+			}
+		}
+	}
+
+private:
+	vector<unsigned long long> bits_;
+};
+
+FlowGraph::FlowGraph(const vector<Command>& program)
+{
+	int size = program.size();
+
+	// Начала блоков: первая инструкция, адреса переходов и инструкции,
+	// следующие за передачей управления.
+	vector<bool> leader(size + 1, false);
+	leader[0] = true;
+	for(int i = 0; i < size; ++i) {
+		Instruction instruction = program[i].getInstruction();
+		if(isJump(instruction)) {
+			int target = program[i].getJumpTarget();
+			if(target >= 0 && target < size) {
+				leader[target] = true;
+			}
+			leader[i + 1] = true;
+		}
+		else if(instruction == STOP) {
+			leader[i + 1] = true;
+		}
+	}
+
+	blockOf_.assign(size, 0);
+	for(int i = 0; i < size; ) {
+		BasicBlock block;
+		block.begin = i;
+		do {
+			blockOf_[i] = blocks_.size();
+			++i;
+		} while(i < size && !leader[i]);
+		block.end = i;
+		blocks_.push_back(block);
+	}
+
+	for(size_t b = 0; b < blocks_.size(); ++b) {
+		const Command& last = program[blocks_[b].end - 1];
+		Instruction instruction = last.getInstruction();
+		if(isJump(instruction)) {
+			int target = last.getJumpTarget();
+			if(target >= 0 && target < size) {
+				blocks_[b].successors.push_back(blockOf_[target]);
+			}
+		}
+		if(instruction != JUMP && instruction != STOP && blocks_[b].end < size) {
+			if(find(blocks_[b].successors.begin(), blocks_[b].successors.end(), (int) b + 1)
+				== blocks_[b].successors.end()) {
+				blocks_[b].successors.push_back(b + 1);
+			}
+		}
+		for(size_t s = 0; s < blocks_[b].successors.size(); ++s) {
+			blocks_[blocks_[b].successors[s]].predecessors.push_back(b);
+		}
+	}
+
+	// Переходы, ведущие на каждый адрес
+	vector<vector<int> > incoming(size);
+	for(int i = 0; i < size; ++i) {
+		if(isJump(program[i].getInstruction())) {
+			int target = program[i].getJumpTarget();
+			if(target >= 0 && target < size) {
+				incoming[target].push_back(i);
+			}
+		}
+	}
+
+	loopDepth_.assign(size, 0);
+	for(int i = 0; i < size; ++i) {
+		if(program[i].getInstruction() == JUMP && program[i].getArg() <= i) {
+			Loop loop;
+			loop.header = program[i].getArg();
+			loop.backEdge = i;
+			for(int k = loop.header; k <= i; ++k) {
+				++loopDepth_[k];
+			}
+
+			// Цикл естественный, если снаружи нет переходов внутрь участка, кроме заголовка
+			bool natural = true;
+			for(int k = loop.header + 1; k <= loop.backEdge && natural; ++k) {
+				for(size_t j = 0; j < incoming[k].size() && natural; ++j) {
+					natural = incoming[k][j] >= loop.header && incoming[k][j] <= loop.backEdge;
+				}
+			}
+			if(natural) {
+				loops_.push_back(loop);
+			}
+		}
+	}
+	// Вложенные циклы короче объемлющих
+	for(size_t i = 1; i < loops_.size(); ++i) {
+		for(size_t k = i; k > 0 && loops_[k].backEdge - loops_[k].header
+			< loops_[k - 1].backEdge - loops_[k - 1].header; --k) {
+			swap(loops_[k], loops_[k - 1]);
+		}
+	}
+}
+
+// Наибольшее количество ячеек, с которым работают анализы потока данных. Они хранят
+// состояние каждой ячейки в каждом блоке, поэтому программы с большими массивами
+// не оптимизируются (кроме устранения проверок индексов, которому это не нужно).
+static const int MAX_OPTIMIZED_CELLS = 1 << 16;
+
+// Чтение элемента массива: может прочитать любую из ячеек [arg, arg + arg2)
+static bool isIndexedLoad(Instruction instruction)
+{
+	return instruction == BLOAD || instruction == BLOAD_UNCHECKED;
+}
+
+// Запись в элемент массива: может изменить любую из ячеек [arg, arg + arg2)
+static bool isIndexedStore(Instruction instruction)
+{
+	return instruction == BSTORE || instruction == BSTORE_UNCHECKED;
+}
+
+// Количество ячеек памяти, к которым обращается программа (для массивов - все их ячейки).
+// Возвращает -1, если в программе есть суперинструкции, которые оптимизатор не поддерживает,
+// или ячеек больше MAX_OPTIMIZED_CELLS.
+static int countCells(const vector<Command>& program)
+{
+	int cells = 0;
+	for(size_t i = 0; i < program.size(); ++i) {
+		Instruction instruction = program[i].getInstruction();
+		if(instruction > IMPLIES) {
+			return -1;
+		}
+		if(instruction == LOAD || instruction == STORE) {
+			cells = max(cells, program[i].getArg() + 1);
+		}
+		else if(isIndexed(instruction)) {
+			cells = max(cells, program[i].getArg() + program[i].getArg2());
+		}
+	}
+	return cells <= MAX_OPTIMIZED_CELLS ? cells : -1;
+}
+
+// Анализ живучести ячеек памяти. Для каждого блока вычисляется множество ячеек,
+// значение которых может быть прочитано после выхода из блока.
+static void computeLiveness(const vector<Command>& program, const FlowGraph& graph, int cells,
+	vector<CellSet>& liveOut)
+{
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	int count = blocks.size();
+
+	// use - ячейки, читаемые в блоке до записи, def - ячейки, записываемые в блоке
+	vector<CellSet> use(count, CellSet(cells));
+	vector<CellSet> def(count, CellSet(cells));
+	for(int b = 0; b < count; ++b) {
+		for(int i = blocks[b].begin; i < blocks[b].end; ++i) {
+			const Command& c = program[i];
+			if(c.getInstruction() == LOAD && !def[b].contains(c.getArg())) {
+				use[b].add(c.getArg());
+			}
+			else if(c.getInstruction() == STORE) {
+				def[b].add(c.getArg());
+			}
+			else if(isIndexedLoad(c.getInstruction())) {
+				// Чтение элемента использует все ячейки массива. Запись в элемент ничего
+				// не определяет: неизвестно, какую ячейку она изменит.
+				CellSet range(cells);
+				range.addRange(c.getArg(), c.getArg() + c.getArg2());
+				range.subtract(def[b]);
+				use[b].unite(range);
+			}
+		}
+	}
+
+	liveOut.assign(count, CellSet(cells));
+	vector<CellSet> liveIn(use);
+	vector<int> members;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(int b = count - 1; b >= 0; --b) {
+			for(size_t s = 0; s < blocks[b].successors.size(); ++s) {
+				liveOut[b].unite(liveIn[blocks[b].successors[s]]);
+			}
+
+			// in = use + (out - def)
+			CellSet in(liveOut[b]);
+			def[b].list(members);
+			for(size_t k = 0; k < members.size(); ++k) {
+				in.remove(members[k]);
+			}
+			in.unite(use[b]);
+			if(liveIn[b].unite(in)) {
+				changed = true;
+			}
+		}
+	}
+}
+
+// Множества ячеек, живых после каждой инструкции блока (after[i - block.begin]),
+// и множество ячеек, живых перед первой инструкцией блока (before).
+static void computeBlockLiveness(const vector<Command>& program, const BasicBlock& block,
+	const CellSet& liveOut, vector<CellSet>& after, CellSet& before)
+{
+	after.assign(block.end - block.begin, liveOut);
+	CellSet live(liveOut);
+	for(int i = block.end - 1; i >= block.begin; --i) {
+		after[i - block.begin] = live;
+		const Command& c = program[i];
+		if(c.getInstruction() == STORE) {
+			live.remove(c.getArg());
+		}
+		else if(c.getInstruction() == LOAD) {
+			live.add(c.getArg());
+		}
+		else if(isIndexedLoad(c.getInstruction())) {
+			live.addRange(c.getArg(), c.getArg() + c.getArg2());
+		}
+	}
+	before = live;
+}
+
+// Замена инструкции другой с сохранением номера строки исходного текста
+static void replaceCommand(Command& c, const Command& replacement)
+{
+	int line = c.getLine();
+	c = replacement;
+	c.setLine(line);
+}
+
+// Замена участка [begin, end) программы кодом code (см. replaceRegions)
+struct Replacement
+{
+	Replacement(int b, int e)
+		: begin(b), end(e)
+	{}
+
+	int begin;
+	int end;                // begin, если код вставляется перед инструкцией begin
+	vector<Command> code;   // переходы кода ведут внутрь него или на следующую за ним
+	                        // инструкцию; их адреса заданы так, как если бы код стоял по адресу begin
+};
+
+static bool precedes(const Replacement& a, const Replacement& b)
+{
+	return a.begin != b.begin ? a.begin < b.begin : a.end < b.end;
+}
+
+// Замена непересекающихся участков программы за один проход с пересчетом адресов переходов.
+// Переходы внутрь заменяемого участка ведут на начало нового кода. Перед вставкой (пустым
+// участком, например предзаголовком цикла) переходы на begin из инструкций с адресами
+// меньше begin ведут на вставленный код, а из остальных (обратные переходы цикла) -
+// на инструкцию, которая раньше была по адресу begin. Несколько вставок по одному адресу
+// выполняются в порядке следования в replacements.
+static void replaceRegions(vector<Command>& program, vector<Replacement>& replacements)
+{
+	if(replacements.empty()) {
+		return;
+	}
+	stable_sort(replacements.begin(), replacements.end(), precedes);
+
+	// Новые адреса для переходов на каждый старый адрес сверху (enter) и снизу (resume);
+	// для каждой инструкции результата - ее старый адрес или -1 - номер замены
+	int size = program.size();
+	vector<int> enter(size + 1), resume(size + 1);
+	vector<int> origin, start(replacements.size());
+	vector<Command> output;
+	output.reserve(size);
+	size_t r = 0;
+	for(int i = 0; ; ) {
+		enter[i] = output.size();
+		for(; r < replacements.size() && replacements[r].begin == i; ++r) {
+			const Replacement& replacement = replacements[r];
+			if(replacement.end > i) {
+				break;
+			}
+			start[r] = output.size();
+			output.insert(output.end(), replacement.code.begin(), replacement.code.end());
+			origin.insert(origin.end(), replacement.code.size(), -1 - (int) r);
+		}
+		resume[i] = output.size();
+		if(i == size) {
+			break;
+		}
+		if(r < replacements.size() && replacements[r].begin == i) {
+			const Replacement& replacement = replacements[r];
+			start[r] = output.size();
+			output.insert(output.end(), replacement.code.begin(), replacement.code.end());
+			origin.insert(origin.end(), replacement.code.size(), -1 - (int) r);
+			for(int k = i + 1; k < replacement.end; ++k) {
+				enter[k] = resume[k] = resume[i];
+			}
+			i = replacement.end;
+			++r;
+			continue;
+		}
+		output.push_back(program[i]);
+		origin.push_back(i);
+		++i;
+	}
+
+	for(size_t j = 0; j < output.size(); ++j) {
+		if(!isJump(output[j].getInstruction())) {
+			continue;
+		}
+		int target = output[j].getJumpTarget();
+		if(origin[j] >= 0) {
+			output[j].setJumpTarget(origin[j] >= target ? resume[target] : enter[target]);
+		}
+		else {
+			const Replacement& replacement = replacements[-1 - origin[j]];
+			output[j].setJumpTarget(target - replacement.begin + start[-1 - origin[j]]);
+		}
+	}
+	program.swap(output);
+}
+
+// Удаление инструкций NOP и значений, которые вычисляются только для того, чтобы быть
+// снятыми со стека инструкцией POP. Вычисление удаляется, если оно не имеет побочных
+// эффектов; при этом его операнды тоже становятся ненужными. Адреса переходов пересчитываются.
+static void removeDeadValues(vector<Command>& program)
+{
+	int size = program.size();
+	FlowGraph graph(program);
+
+	vector<Command> output;
+	vector<int> outputBlock;
+	vector<int> newAddress(size + 1, 0);
+	for(int i = 0; i < size; ++i) {
+		newAddress[i] = output.size();
+		const Command& c = program[i];
+		int block = graph.blockOf(i);
+		if(c.getInstruction() == NOP) {
+			continue;
+		}
+		if(c.getInstruction() != POP) {
+			output.push_back(c);
+			outputBlock.push_back(block);
+			continue;
+		}
+
+		// Сокращение POP с вычислением снимаемого значения в пределах одного блока
+		int pending = 1;
+		while(pending > 0 && !output.empty() && outputBlock.back() == block) {
+			Instruction last = output.back().getInstruction();
+			if(last == DUP) {
+				--pending;
+			}
+			else if(last == LOAD || last == PUSH || last == INVERT || last == NOT
+				|| last == ADD || last == SUB || last == MULT || last == COMPARE
+				|| last == AND || last == OR || last == XOR || last == IMPLIES) {
+				pending += instructionPops(last) - 1;
+			}
+			else {
+				break;
+			}
+			output.pop_back();
+			outputBlock.pop_back();
+		}
+		for(; pending > 0; --pending) {
+			output.push_back(Command(POP));
+			outputBlock.push_back(block);
+		}
+	}
+	newAddress[size] = output.size();
+
+	for(size_t i = 0; i < output.size(); ++i) {
+		const Command& c = output[i];
+		if(isJump(c.getInstruction())) {
+			output[i].setJumpTarget(newAddress[c.getJumpTarget()]);
+		}
+	}
+	program.swap(output);
+}
+
+// Инструкции без побочных эффектов, которые снимают со стека два слова и кладут одно
+static bool isPureBinary(Instruction instruction)
+{
+	return instruction == ADD || instruction == SUB || instruction == MULT || instruction == COMPARE
+		|| instruction == AND || instruction == OR || instruction == XOR || instruction == IMPLIES;
+}
+
+// Вычисление инструкции над константами (как это сделала бы машина)
+static int evaluate(const Command& c, int left, int right)
+{
+	switch(c.getInstruction()) {
+		case ADD:
+			return addValues(left, right);
+		case SUB:
+			return subtractValues(left, right);
+		case MULT:
+			return multiplyValues(left, right);
+		case DIV:
+			return divideValues(left, right);
+		case COMPARE:
+			return compareValues(c.getArg(), left, right);
+		case AND:
+			return left != 0 && right != 0;
+		case OR:
+			return left != 0 || right != 0;
+		case XOR:
+			return (left != 0) != (right != 0);
+		case IMPLIES:
+			return left == 0 || right != 0;
+		case INVERT:
+			return negateValue(right);
+		case NOT:
+			return right == 0;
+		default:
+			return 0;
+	}
+}
+
+// Значение ячейки памяти для распространения копий
+struct CopyValue
+{
+	enum Kind
+	{
+		UNKNOWN,	// путь еще не рассмотрен
+		NONE,		// значение неизвестно
+		CELL,		// совпадает со значением ячейки value
+		CONSTANT	// равно константе value
+	};
+
+	CopyValue()
+		: kind(UNKNOWN), value(0)
+	{}
+
+	CopyValue(Kind k, int v)
+		: kind(k), value(v)
+	{}
+
+	bool operator==(const CopyValue& other) const
+	{
+		return kind == other.kind && value == other.value;
+	}
+
+	bool operator!=(const CopyValue& other) const
+	{
+		return !(*this == other);
+	}
+
+	Kind kind;
+	int value;
+};
+
+// Ячейки, значения которых отслеживает анализ копий, - те, к которым обращаются LOAD
+// и STORE. Остальные ячейки массивов читаются только через BLOAD, и хранить для них
+// состояние в каждом блоке незачем.
+struct CopyCells
+{
+	CopyCells(const vector<Command>& program, int cells)
+		: slot(cells, -1)
+	{
+		for(size_t i = 0; i < program.size(); ++i) {
+			Instruction instruction = program[i].getInstruction();
+			if((instruction == LOAD || instruction == STORE) && slot[program[i].getArg()] < 0) {
+				slot[program[i].getArg()] = 0;
+			}
+		}
+		for(int cell = 0; cell < cells; ++cell) {
+			if(slot[cell] >= 0) {
+				slot[cell] = addresses.size();
+				addresses.push_back(cell);
+			}
+		}
+	}
+
+	vector<int> slot;       // номер ячейки в состоянии копий (-1 - не отслеживается)
+	vector<int> addresses;  // адреса отслеживаемых ячеек по возрастанию
+};
+
+// Забывание значений ячеек [first, last) и копий этих ячеек (в памяти и в стеке)
+static void invalidateCopies(const CopyCells& tracked, vector<CopyValue>& state, vector<CopyValue>& stack,
+	int first, int last)
+{
+	for(size_t k = 0; k < state.size(); ++k) {
+		if((state[k].kind == CopyValue::CELL && state[k].value >= first && state[k].value < last)
+			|| (tracked.addresses[k] >= first && tracked.addresses[k] < last)) {
+			state[k] = CopyValue(CopyValue::NONE, 0);
+		}
+	}
+	for(size_t k = 0; k < stack.size(); ++k) {
+		if(stack[k].kind == CopyValue::CELL && stack[k].value >= first && stack[k].value < last) {
+			stack[k] = CopyValue(CopyValue::NONE, 0);
+		}
+	}
+}
+
+static CopyValue popCopy(vector<CopyValue>& stack)
+{
+	if(stack.empty()) {
+		return CopyValue(CopyValue::NONE, 0);
+	}
+	CopyValue top = stack.back();
+	stack.pop_back();
+	return top;
+}
+
+// Значение операции над значениями операндов: константа, если оба операнда - константы
+// (деление на ноль не вычисляется), иначе неизвестно. Пока хотя бы один операнд
+// не рассмотрен (UNKNOWN), не рассмотрен и результат.
+static CopyValue evaluateCopies(const Command& c, const CopyValue& left, const CopyValue& right)
+{
+	if(left.kind == CopyValue::NONE || right.kind == CopyValue::NONE
+		|| left.kind == CopyValue::CELL || right.kind == CopyValue::CELL
+		|| (c.getInstruction() == DIV && right.kind == CopyValue::CONSTANT && right.value == 0)) {
+		return CopyValue(CopyValue::NONE, 0);
+	}
+	if(left.kind == CopyValue::UNKNOWN || right.kind == CopyValue::UNKNOWN) {
+		return CopyValue();
+	}
+	return CopyValue(CopyValue::CONSTANT, evaluate(c, left.value, right.value));
+}
+
+// Применение инструкции с адресом address к состоянию копий. В stack - значения слов,
+// положенных в стек в текущем блоке: чтение ячейки дает ее копию или константу, а
+// операции над константами вычисляются, поэтому записываемое значение известно и тогда,
+// когда оно вычисляется выражением. Слова, положенные в стек в других блоках, неизвестны.
+static void transferCopies(const vector<Command>& program, const CopyCells& tracked, int address,
+	vector<CopyValue>& state, vector<CopyValue>& stack)
+{
+	const Command& c = program[address];
+	Instruction instruction = c.getInstruction();
+	if(instruction == PUSH) {
+		stack.push_back(CopyValue(CopyValue::CONSTANT, c.getArg()));
+	}
+	else if(instruction == LOAD) {
+		const CopyValue& value = state[tracked.slot[c.getArg()]];
+		stack.push_back(value.kind == CopyValue::NONE ? CopyValue(CopyValue::CELL, c.getArg()) : value);
+	}
+	else if(instruction == DUP) {
+		CopyValue top = popCopy(stack);
+		stack.push_back(top);
+		stack.push_back(top);
+	}
+	else if(instruction == STORE) {
+		int cell = c.getArg();
+		CopyValue value = popCopy(stack);
+		invalidateCopies(tracked, state, stack, cell, cell + 1);
+		if(value.kind != CopyValue::CELL || value.value != cell) {
+			state[tracked.slot[cell]] = value;
+		}
+	}
+	else if(isIndexedStore(instruction)) {
+		popCopy(stack);
+		popCopy(stack);
+		invalidateCopies(tracked, state, stack, c.getArg(), c.getArg() + c.getArg2());
+	}
+	else if(isPureBinary(instruction) || instruction == DIV) {
+		CopyValue right = popCopy(stack);
+		CopyValue left = popCopy(stack);
+		stack.push_back(evaluateCopies(c, left, right));
+	}
+	else if(instruction == INVERT || instruction == NOT) {
+		CopyValue right = popCopy(stack);
+		stack.push_back(evaluateCopies(c, CopyValue(CopyValue::CONSTANT, 0), right));
+	}
+	else {
+		for(int k = instructionPops(instruction); k > 0; --k) {
+			popCopy(stack);
+		}
+		for(int k = instructionPushes(instruction); k > 0; --k) {
+			stack.push_back(CopyValue(CopyValue::NONE, 0));
+		}
+	}
+}
+
+// Объединение значений ячеек, приходящих в блок по разным путям
+static void meetCopies(vector<CopyValue>& merged, const vector<CopyValue>& incoming)
+{
+	for(size_t k = 0; k < merged.size(); ++k) {
+		if(merged[k].kind == CopyValue::UNKNOWN) {
+			merged[k] = incoming[k];
+		}
+		else if(incoming[k].kind != CopyValue::UNKNOWN && incoming[k] != merged[k]) {
+			merged[k] = CopyValue(CopyValue::NONE, 0);
+		}
+	}
+}
+
+// Прямой анализ копий и констант: на входе в блок значение ячейки известно, только если оно
+// одинаково на всех входящих путях. На входе в программу ничего не известно. Условный
+// переход по известному значению передает состояние только в тот блок, куда ведет;
+// блоки, в которые не ведет ни один такой путь, считаются недостижимыми, и их состояние
+// остается нерассмотренным (UNKNOWN).
+static void computeCopies(const vector<Command>& program, const FlowGraph& graph, const CopyCells& tracked,
+	vector<vector<CopyValue> >& in, vector<vector<CopyValue> >& out)
+{
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	int count = blocks.size();
+	int cells = tracked.addresses.size();
+
+	// taken - единственный преемник, в который ведет условный переход блока
+	// (-1 - все преемники, -2 - блок еще не рассматривался)
+	in.assign(count, vector<CopyValue>(cells));
+	out.assign(count, vector<CopyValue>(cells));
+	in[0].assign(cells, CopyValue(CopyValue::NONE, 0));
+	vector<int> taken(count, -2);
+
+	// Блоки рассматриваются по возрастанию номера, начиная с первого; блок снова ставится
+	// в очередь, когда меняется выход одного из его предшественников. Так цикл с известными
+	// начальными значениями досчитывается до конца раньше кода за ним, и код после
+	// каждого такого цикла не приходится обходить заново.
+	set<int> pending;
+	pending.insert(0);
+	while(!pending.empty()) {
+		int b = *pending.begin();
+		pending.erase(pending.begin());
+		if(b > 0) {
+			vector<CopyValue> merged(cells);
+			bool reached = false;
+			for(size_t p = 0; p < blocks[b].predecessors.size(); ++p) {
+				int pred = blocks[b].predecessors[p];
+				if(taken[pred] == -1 || taken[pred] == b) {
+					meetCopies(merged, out[pred]);
+					reached = true;
+				}
+			}
+			if(!reached) {
+				continue;
+			}
+			in[b] = merged;
+		}
+
+		vector<CopyValue> state(in[b]);
+		vector<CopyValue> stack;
+		for(int i = blocks[b].begin; i < blocks[b].end - 1; ++i) {
+			transferCopies(program, tracked, i, state, stack);
+		}
+		const Command& last = program[blocks[b].end - 1];
+		int next = -1;
+		if((last.getInstruction() == JUMP_NO || last.getInstruction() == JUMP_YES)
+			&& !stack.empty() && stack.back().kind == CopyValue::CONSTANT) {
+			bool jumps = (stack.back().value == 0) == (last.getInstruction() == JUMP_NO);
+			next = jumps ? graph.blockOf(last.getJumpTarget()) : b + 1;
+		}
+		transferCopies(program, tracked, blocks[b].end - 1, state, stack);
+
+		// Значение на выходе блока только уточняется: из нерассмотренного становится
+		// известным, из известного - неизвестным. Чтение ячейки дает то ее константу,
+		// то копию, поэтому без этого значения могли бы чередоваться. Так же
+		// переход по условию, ставшему неизвестным, ведет во все преемники.
+		bool changed = false;
+		for(int k = 0; k < cells; ++k) {
+			CopyValue& value = out[b][k];
+			if(value != state[k] && value.kind != CopyValue::NONE) {
+				value = value.kind == CopyValue::UNKNOWN ? state[k] : CopyValue(CopyValue::NONE, 0);
+				changed = true;
+			}
+		}
+		if(taken[b] != next && taken[b] != -1) {
+			taken[b] = taken[b] == -2 ? next : -1;
+			changed = true;
+		}
+		if(changed) {
+			pending.insert(blocks[b].successors.begin(), blocks[b].successors.end());
+		}
+	}
+}
+
+int propagateCopies(vector<Command>& program)
+{
+	int cells = countCells(program);
+	if(cells <= 0) {
+		return 0;
+	}
+
+	FlowGraph graph(program);
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	int count = blocks.size();
+	CopyCells tracked(program, cells);
+	vector<vector<CopyValue> > in, out;
+	computeCopies(program, graph, tracked, in, out);
+
+	int replaced = 0;
+	for(int b = 0; b < count; ++b) {
+		vector<CopyValue>& state = in[b];
+		vector<CopyValue> stack;
+		for(int i = blocks[b].begin; i < blocks[b].end; ++i) {
+			const Command& c = program[i];
+			if(c.getInstruction() == LOAD) {
+				const CopyValue& value = state[tracked.slot[c.getArg()]];
+				if(value.kind == CopyValue::CELL) {
+					replaceCommand(program[i], Command(LOAD, value.value));
+					++replaced;
+				}
+				else if(value.kind == CopyValue::CONSTANT) {
+					replaceCommand(program[i], Command(PUSH, value.value));
+					++replaced;
+				}
+			}
+			transferCopies(program, tracked, i, state, stack);
+		}
+	}
+	return replaced;
+}
+
+int eliminateDeadStores(vector<Command>& program)
+{
+	int cells = countCells(program);
+	if(cells <= 0) {
+		return 0;
+	}
+
+	FlowGraph graph(program);
+	vector<CellSet> liveOut;
+	computeLiveness(program, graph, cells, liveOut);
+
+	int removed = 0;
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	for(size_t b = 0; b < blocks.size(); ++b) {
+		CellSet live(liveOut[b]);
+		for(int i = blocks[b].end - 1; i >= blocks[b].begin; --i) {
+			const Command& c = program[i];
+			if(c.getInstruction() == STORE) {
+				int cell = c.getArg();
+				if(!live.contains(cell)) {
+					replaceCommand(program[i], Command(POP));
+					++removed;
+				}
+				live.remove(cell);
+			}
+			else if(c.getInstruction() == LOAD) {
+				live.add(c.getArg());
+			}
+			else if(isIndexedLoad(c.getInstruction())) {
+				live.addRange(c.getArg(), c.getArg() + c.getArg2());
+			}
+		}
+	}
+
+	if(removed > 0) {
+		removeDeadValues(program);
+	}
+	return removed;
+}
+
+// Поиск самого длинного участка, начинающегося с адреса begin, который можно вынести из цикла.
+//    stored - ячейки, в которые пишет цикл
+//    headerLive - ячейки, живые перед заголовком цикла
+//    after - ячейки, живые после каждой инструкции блока (см. computeBlockLiveness)
+// Возвращает адрес последней инструкции участка или -1; в values - количество слов,
+// которые участок оставляет в стеке.
+static int findInvariant(const vector<Command>& program, const BasicBlock& block, int begin,
+	const CellSet& stored, const CellSet& headerLive, const vector<CellSet>& after, int& values)
+{
+	int best = -1;
+	int depth = 0;
+	vector<int> locals;
+	for(int e = begin; e < block.end; ++e) {
+		const Command& c = program[e];
+		Instruction instruction = c.getInstruction();
+		if(instruction == LOAD) {
+			int cell = c.getArg();
+			if(stored.contains(cell) && find(locals.begin(), locals.end(), cell) == locals.end()) {
+				break;
+			}
+			++depth;
+		}
+		else if(instruction == PUSH) {
+			++depth;
+		}
+		else if(instruction == DUP && depth >= 1) {
+			++depth;
+		}
+		else if((instruction == INVERT || instruction == NOT) && depth >= 1) {
+		}
+		else if(isPureBinary(instruction) && depth >= 2) {
+			--depth;
+		}
+		else if(instruction == STORE && depth >= 1) {
+			--depth;
+			locals.push_back(c.getArg());
+		}
+		else {
+			break;
+		}
+
+		// Вынос выгоден, если участок заметно длиннее чтения результата
+		if(depth < 1 || depth > 2 || e - begin + 1 - depth < 2) {
+			continue;
+		}
+		bool valid = true;
+		for(size_t k = 0; k < locals.size() && valid; ++k) {
+			valid = !after[e - block.begin].contains(locals[k]) && !headerLive.contains(locals[k]);
+		}
+		if(valid) {
+			best = e;
+			values = depth;
+		}
+	}
+	return best;
+}
+
+// Удаление блоков, недостижимых из начала программы
+static void removeUnreachable(vector<Command>& program)
+{
+	FlowGraph graph(program);
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	vector<bool> reachable(blocks.size(), false);
+	vector<int> work(1, 0);
+	reachable[0] = true;
+	while(!work.empty()) {
+		int b = work.back();
+		work.pop_back();
+		for(size_t s = 0; s < blocks[b].successors.size(); ++s) {
+			int next = blocks[b].successors[s];
+			if(!reachable[next]) {
+				reachable[next] = true;
+				work.push_back(next);
+			}
+		}
+	}
+
+	vector<int> newAddress(program.size() + 1, 0);
+	vector<Command> output;
+	for(size_t b = 0; b < blocks.size(); ++b) {
+		for(int i = blocks[b].begin; i < blocks[b].end; ++i) {
+			newAddress[i] = output.size();
+			if(reachable[b]) {
+				output.push_back(program[i]);
+			}
+		}
+	}
+	newAddress[program.size()] = output.size();
+	if(output.size() == program.size()) {
+		return;
+	}
+
+	for(size_t i = 0; i < output.size(); ++i) {
+		const Command& c = output[i];
+		if(isJump(c.getInstruction())) {
+			output[i].setJumpTarget(newAddress[c.getJumpTarget()]);
+		}
+	}
+	program.swap(output);
+}
+
+int foldConstants(vector<Command>& program)
+{
+	int size = program.size();
+	FlowGraph graph(program);
+
+	vector<Command> output;
+	vector<int> outputBlock;
+	vector<int> newAddress(size + 1, 0);
+	int folded = 0;
+	for(int i = 0; i < size; ++i) {
+		newAddress[i] = output.size();
+		const Command& c = program[i];
+		Instruction instruction = c.getInstruction();
+		int block = graph.blockOf(i);
+
+		// Сколько констант лежит на вершине стека, положенных в этом же блоке
+		int constants = 0;
+		for(int k = output.size() - 1; k >= 0 && constants < 2; --k) {
+			if(outputBlock[k] != block || output[k].getInstruction() != PUSH) {
+				break;
+			}
+			++constants;
+		}
+
+		if(constants == 2 && (isPureBinary(instruction)
+			|| (instruction == DIV && output.back().getArg() != 0))) {
+			int right = output.back().getArg();
+			output.pop_back();
+			outputBlock.pop_back();
+			int left = output.back().getArg();
+			replaceCommand(output.back(), Command(PUSH, evaluate(c, left, right)));
+			++folded;
+		}
+		else if(constants >= 1 && (instruction == INVERT || instruction == NOT)) {
+			replaceCommand(output.back(), Command(PUSH, evaluate(c, 0, output.back().getArg())));
+			++folded;
+		}
+		else if(constants >= 1 && isIndexed(instruction) && output.back().getArg() >= 0
+			&& output.back().getArg() < c.getArg2()) {
+			// Элемент массива с известным индексом - обычная ячейка
+			replaceCommand(output.back(),
+				Command(isIndexedStore(instruction) ? STORE : LOAD, c.getArg() + output.back().getArg()));
+			++folded;
+		}
+		else if(constants >= 1 && (instruction == JUMP_NO || instruction == JUMP_YES)) {
+			bool taken = (output.back().getArg() == 0) == (instruction == JUMP_NO);
+			output.pop_back();
+			outputBlock.pop_back();
+			if(taken) {
+				output.push_back(Command(JUMP, c.getArg()));
+				outputBlock.push_back(block);
+			}
+			++folded;
+		}
+		else {
+			output.push_back(c);
+			outputBlock.push_back(block);
+		}
+	}
+	newAddress[size] = output.size();
+
+	if(folded > 0) {
+		for(size_t i = 0; i < output.size(); ++i) {
+			const Command& c = output[i];
+			if(isJump(c.getInstruction())) {
+				output[i].setJumpTarget(newAddress[c.getJumpTarget()]);
+			}
+		}
+		program.swap(output);
+		removeUnreachable(program);
+	}
+	return folded;
+}
+
+// Копирование тела цикла [begin, end) в конец code. Переходы внутри тела
+// перенацеливаются на копию; переход на end ведет на инструкцию, следующую за копией.
+static void copyBody(const vector<Command>& program, int begin, int end, int base, vector<Command>& code)
+{
+	int offset = base + code.size() - begin;
+	for(int i = begin; i < end; ++i) {
+		const Command& c = program[i];
+		code.push_back(c);
+		if(isJump(c.getInstruction())) {
+			code.back().setJumpTarget(c.getJumpTarget() + offset);
+		}
+	}
+}
+
+// Количество повторений цикла "while i cmp limit do ...; i := i + step od" при начальном
+// значении i, равном initial. Возвращает false, если цикл не завершается или i
+// переполняется до выхода из цикла.
+static bool countTrips(int initial, int limit, int cmp, int step, long long& trips)
+{
+	if(!compareValues(cmp, initial, limit)) {
+		trips = 0;
+		return true;
+	}
+
+	long long distance = (long long) limit - initial;
+	long long c = step;
+	bool finite;
+	switch(cmp) {
+		case 0:
+			trips = 1;
+			finite = c != 0;
+			break;
+		case 1:
+			finite = c != 0 && distance % c == 0 && distance / c > 0;
+			trips = finite ? distance / c : 0;
+			break;
+		case 2:
+			finite = c > 0;
+			trips = finite ? (distance + c - 1) / c : 0;
+			break;
+		case 3:
+			finite = c < 0;
+			trips = finite ? (distance + c + 1) / c : 0;
+			break;
+		case 4:
+			finite = c > 0;
+			trips = finite ? distance / c + 1 : 0;
+			break;
+		case 5:
+			finite = c < 0;
+			trips = finite ? distance / c + 1 : 0;
+			break;
+		default:
+			return false;
+	}
+	long long last = initial + trips * c;
+	return finite && last >= INT_MIN && last <= INT_MAX;
+}
+
+int unrollLoops(vector<Command>& program, int budget, const BranchProfile* profile)
+{
+	// За одно построение графа разворачиваются все подходящие циклы, не содержащие
+	// уже развернутых. Объемлющие циклы рассматриваются при следующем построении,
+	// поэтому их количество ограничено глубиной вложенности.
+	int unrolled = 0;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		int cells = countCells(program);
+		if(cells <= 0) {
+			return unrolled;
+		}
+
+		FlowGraph graph(program);
+		const vector<BasicBlock>& blocks = graph.getBlocks();
+		const vector<Loop>& loops = graph.getLoops();
+		CopyCells tracked(program, cells);
+		vector<vector<CopyValue> > in, out;
+		computeCopies(program, graph, tracked, in, out);
+
+		vector<Replacement> replacements;
+		vector<bool> replaced(program.size(), false);
+		for(size_t l = 0; l < loops.size(); ++l) {
+			int header = loops[l].header;
+			int backEdge = loops[l].backEdge;
+			if(backEdge - header < 8
+				|| find(replaced.begin() + header, replaced.begin() + backEdge + 1, true)
+				!= replaced.begin() + backEdge + 1) {
+				continue;
+			}
+
+			// Условие "LOAD i; PUSH N; COMPARE cmp; JUMP_NO выход" и шаг "LOAD i; PUSH c; ADD; STORE i"
+			const Command* p = &program[header];
+			int bodyBegin = header + 4;
+			int bodyEnd = backEdge - 4;
+			if(p[0].getInstruction() != LOAD || p[1].getInstruction() != PUSH
+				|| p[2].getInstruction() != COMPARE || p[3].getInstruction() != JUMP_NO
+				|| p[3].getArg() != backEdge + 1) {
+				continue;
+			}
+			int cell = p[0].getArg();
+			int limit = p[1].getArg();
+			int cmp = p[2].getArg();
+			const Command* q = &program[bodyEnd];
+			if(q[0].getInstruction() != LOAD || q[0].getArg() != cell || q[1].getInstruction() != PUSH
+				|| q[2].getInstruction() != ADD || q[3].getInstruction() != STORE || q[3].getArg() != cell) {
+				continue;
+			}
+			int step = q[1].getArg();
+
+			// По профилю: тело, которое ни разу не выполнялось, не разворачивается,
+			// для горячих циклов бюджет увеличивается
+			int line = p[3].getLine();
+			if(profile && profile->isCold(line)) {
+				continue;
+			}
+			int loopBudget = profile && profile->isHot(line) ? budget * HOT_UNROLL_FACTOR : budget;
+
+			// Тело не изменяет i и не передает управление за свои пределы
+			bool simple = true;
+			for(int i = bodyBegin; i < bodyEnd && simple; ++i) {
+				const Command& c = program[i];
+				if(c.getInstruction() == STORE && c.getArg() == cell) {
+					simple = false;
+				}
+				else if(isIndexedStore(c.getInstruction())) {
+					simple = cell < c.getArg() || cell >= c.getArg() + c.getArg2();
+				}
+				else if(isJump(c.getInstruction())) {
+					simple = c.getArg() >= bodyBegin && c.getArg() <= bodyEnd;
+				}
+			}
+			if(!simple) {
+				continue;
+			}
+
+			// Начальное значение i приходит в цикл снаружи
+			int headerBlock = graph.blockOf(header);
+			vector<CopyValue> entry(tracked.addresses.size());
+			for(size_t k = 0; k < blocks[headerBlock].predecessors.size(); ++k) {
+				int pred = blocks[headerBlock].predecessors[k];
+				if(blocks[pred].begin < header || blocks[pred].begin > backEdge) {
+					meetCopies(entry, out[pred]);
+				}
+			}
+			const CopyValue& initial = entry[tracked.slot[cell]];
+			long long trips = 0;
+			if(initial.kind != CopyValue::CONSTANT || !countTrips(initial.value, limit, cmp, step, trips)) {
+				continue;
+			}
+
+			int bodySize = bodyEnd - bodyBegin;
+			Replacement replacement(header, backEdge + 1);
+			vector<Command>& code = replacement.code;
+			if(trips * (bodySize + 2) <= loopBudget) {
+				// Полная развертка: копии тела с константными значениями i между ними
+				long long value = initial.value;
+				for(int k = 0; k < trips; ++k) {
+					copyBody(program, bodyBegin, bodyEnd, header, code);
+					value += step;
+					code.push_back(Command(PUSH, (int) value));
+					code.push_back(Command(STORE, cell));
+				}
+			}
+			else {
+				// Частичная развертка: наибольший делитель числа повторений, помещающийся в бюджет
+				int factor = 8;
+				while(factor > 1 && (trips % factor != 0 || factor * (bodySize + 4) + 5 > loopBudget)) {
+					--factor;
+				}
+				if(factor < 2) {
+					continue;
+				}
+				code.insert(code.end(), program.begin() + header, program.begin() + bodyBegin);
+				for(int k = 0; k < factor; ++k) {
+					copyBody(program, bodyBegin, backEdge, header, code);
+				}
+				code.push_back(Command(JUMP, header));
+				code[3] = Command(JUMP_NO, header + code.size());
+			}
+
+			replacements.push_back(replacement);
+			fill(replaced.begin() + header, replaced.begin() + backEdge + 1, true);
+			++unrolled;
+			changed = true;
+		}
+		replaceRegions(program, replacements);
+	}
+	return unrolled;
+}
+
+// Значение в стеке при нумерации значений
+struct StackValue
+{
+	StackValue(int n, int b, int e, bool s)
+		: number(n), begin(b), end(e), separate(s)
+	{}
+
+	int number;     // номер значения
+	int begin;      // адрес первой инструкции вычисления
+	int end;        // адрес последней инструкции вычисления
+	bool separate;  // вычисление [begin, end] можно заменить одной инструкцией
+};
+
+// Повторное вычисление значения
+struct Occurrence
+{
+	int number;     // номер значения
+	int begin;      // адрес первой инструкции вычисления
+	int end;        // адрес последней инструкции вычисления
+	bool separate;  // вычисление [begin, end] можно заменить одной инструкцией
+};
+
+// Порядок обработки номеров значений: сначала самые длинные вычисления
+struct LongerValue
+{
+	explicit LongerValue(const vector<int>& length)
+		: length_(length)
+	{}
+
+	bool operator()(int a, int b) const
+	{
+		return length_[a] != length_[b] ? length_[a] > length_[b] : a < b;
+	}
+
+	const vector<int>& length_;
+};
+
+// Коммутативные операции: порядок операндов не влияет на результат
+static bool isCommutative(Instruction instruction)
+{
+	return instruction == ADD || instruction == MULT || instruction == AND || instruction == OR
+		|| instruction == XOR;
+}
+
+// Нумерация значений в блоке. Заполняет список вычислений значений операциями.
+static void numberValues(const vector<Command>& program, const BasicBlock& block,
+	vector<Occurrence>& occurrences)
+{
+	typedef vector<int> Key;
+	map<Key, int> numbers;
+	map<int, int> memory;
+	vector<StackValue> stack;
+	int next = 0;
+
+	for(int i = block.begin; i < block.end; ++i) {
+		const Command& c = program[i];
+		Instruction instruction = c.getInstruction();
+		int pops = instruction == DUP ? 0 : instructionPops(instruction);
+
+		// Значения, положенные в стек до начала блока, неизвестны
+		vector<StackValue> operands;
+		for(int k = 0; k < pops; ++k) {
+			if(stack.empty()) {
+				operands.insert(operands.begin(), StackValue(next++, -1, -1, false));
+			}
+			else {
+				operands.insert(operands.begin(), stack.back());
+				stack.pop_back();
+			}
+		}
+
+		Key key;
+		key.push_back(instruction);
+		key.push_back(c.getArg());
+		if(instruction == PUSH) {
+			if(numbers.find(key) == numbers.end()) {
+				numbers[key] = next++;
+			}
+			stack.push_back(StackValue(numbers[key], i, i, true));
+		}
+		else if(instruction == LOAD) {
+			if(memory.find(c.getArg()) == memory.end()) {
+				memory[c.getArg()] = next++;
+			}
+			stack.push_back(StackValue(memory[c.getArg()], i, i, true));
+		}
+		else if(instruction == STORE) {
+			memory[c.getArg()] = operands[0].number;
+		}
+		else if(instruction == DUP) {
+			StackValue top = stack.empty() ? StackValue(next++, -1, -1, false) : stack.back();
+			if(stack.empty()) {
+				stack.push_back(top);
+			}
+			stack.push_back(StackValue(top.number, i, i, false));
+		}
+		else if(isPureBinary(instruction) || instruction == DIV || instruction == INVERT || instruction == NOT) {
+			// Вычисление можно заменить, если код операндов идет подряд и непосредственно
+			// перед операцией, а сами операнды тоже можно заменить.
+			bool separate = true;
+			int begin = operands[0].begin;
+			int expected = begin;
+			for(size_t k = 0; k < operands.size(); ++k) {
+				separate = separate && operands[k].separate && operands[k].begin == expected;
+				expected = operands[k].end + 1;
+				key.push_back(operands[k].number);
+			}
+			separate = separate && expected == i;
+			if(isCommutative(instruction) && key[2] > key[3]) {
+				swap(key[2], key[3]);
+			}
+			if(numbers.find(key) == numbers.end()) {
+				numbers[key] = next++;
+			}
+
+			Occurrence occurrence;
+			occurrence.number = numbers[key];
+			occurrence.begin = begin;
+			occurrence.end = i;
+			occurrence.separate = separate && begin >= 0;
+			occurrences.push_back(occurrence);
+			stack.push_back(StackValue(occurrence.number, begin, i, occurrence.separate));
+		}
+		else if(instruction == INPUT) {
+			stack.push_back(StackValue(next++, i, i, false));
+		}
+		else if(isIndexedLoad(instruction)) {
+			// Какую ячейку прочитает элемент массива, неизвестно
+			stack.push_back(StackValue(next++, i, i, false));
+		}
+		else if(isIndexedStore(instruction)) {
+			memory.erase(memory.lower_bound(c.getArg()), memory.lower_bound(c.getArg() + c.getArg2()));
+		}
+	}
+}
+
+int eliminateCommonSubexpressions(vector<Command>& program)
+{
+	int cells = countCells(program);
+	if(cells <= 0) {
+		return 0;
+	}
+
+	int size = program.size();
+	FlowGraph graph(program);
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+
+	// Для каждой инструкции: в какую ячейку сохранить ее результат (save) и
+	// каким чтением заменить вычисление, которое с нее начинается (replace, until)
+	vector<int> save(size, -1);
+	vector<int> replace(size, -1);
+	vector<int> until(size, -1);
+	vector<bool> covered(size, false);
+	int cell = cells;
+	int replaced = 0;
+
+	for(size_t b = 0; b < blocks.size(); ++b) {
+		vector<Occurrence> occurrences;
+		numberValues(program, blocks[b], occurrences);
+
+		map<int, vector<int> > byNumber;
+		for(size_t k = 0; k < occurrences.size(); ++k) {
+			byNumber[occurrences[k].number].push_back(k);
+		}
+		vector<int> length(occurrences.size() > 0 ? occurrences.back().number + 1 : 0, 0);
+		vector<int> order;
+		for(map<int, vector<int> >::iterator it = byNumber.begin(); it != byNumber.end(); ++it) {
+			if(it->second.size() < 2) {
+				continue;
+			}
+			if((int) length.size() <= it->first) {
+				length.resize(it->first + 1, 0);
+			}
+			for(size_t k = 0; k < it->second.size(); ++k) {
+				const Occurrence& o = occurrences[it->second[k]];
+				length[it->first] = max(length[it->first], o.end - o.begin + 1);
+			}
+			order.push_back(it->first);
+		}
+		sort(order.begin(), order.end(), LongerValue(length));
+
+		for(size_t n = 0; n < order.size(); ++n) {
+			const vector<int>& list = byNumber[order[n]];
+
+			// Первое вычисление, которое останется в программе, и заменяемые повторы после него
+			int first = -1;
+			vector<int> repeats;
+			int benefit = -2;
+			for(size_t k = 0; k < list.size(); ++k) {
+				const Occurrence& o = occurrences[list[k]];
+				if(first < 0) {
+					if(!covered[o.end]) {
+						first = list[k];
+					}
+					continue;
+				}
+				if(o.separate && o.begin > occurrences[first].end && !covered[o.begin] && !covered[o.end]) {
+					repeats.push_back(list[k]);
+					benefit += o.end - o.begin;
+				}
+			}
+			if(first < 0 || benefit <= 0) {
+				continue;
+			}
+
+			save[occurrences[first].end] = cell;
+			for(size_t k = 0; k < repeats.size(); ++k) {
+				const Occurrence& o = occurrences[repeats[k]];
+				replace[o.begin] = cell;
+				until[o.begin] = o.end;
+				for(int i = o.begin; i <= o.end; ++i) {
+					covered[i] = true;
+				}
+				++replaced;
+			}
+			++cell;
+		}
+	}
+
+	if(replaced == 0) {
+		return 0;
+	}
+
+	vector<Command> output;
+	vector<int> newAddress(size + 1, 0);
+	for(int i = 0; i < size; ++i) {
+		newAddress[i] = output.size();
+		if(replace[i] >= 0) {
+			output.push_back(Command(LOAD, replace[i]));
+			for(int k = i + 1; k <= until[i]; ++k) {
+				newAddress[k] = output.size();
+			}
+			i = until[i];
+			continue;
+		}
+		output.push_back(program[i]);
+		if(save[i] >= 0) {
+			output.push_back(Command(DUP));
+			output.push_back(Command(STORE, save[i]));
+		}
+	}
+	newAddress[size] = output.size();
+
+	for(size_t i = 0; i < output.size(); ++i) {
+		const Command& c = output[i];
+		if(isJump(c.getInstruction())) {
+			output[i].setJumpTarget(newAddress[c.getJumpTarget()]);
+		}
+	}
+	program.swap(output);
+	return replaced;
+}
+
+int hoistLoopInvariants(vector<Command>& program)
+{
+	// Циклы, не содержащие друг друга, обрабатываются за одно построение графа;
+	// объемлющий цикл измененного - при следующем (см. unrollLoops)
+	int hoisted = 0;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		int cells = countCells(program);
+		if(cells <= 0) {
+			return hoisted;
+		}
+
+		FlowGraph graph(program);
+		const vector<BasicBlock>& blocks = graph.getBlocks();
+		const vector<Loop>& loops = graph.getLoops();
+		vector<CellSet> liveOut;
+		computeLiveness(program, graph, cells, liveOut);
+
+		vector<Replacement> replacements;
+		vector<bool> replaced(program.size(), false);
+		int cell = cells;
+		for(size_t l = 0; l < loops.size(); ++l) {
+			const Loop& loop = loops[l];
+			if(find(replaced.begin() + loop.header, replaced.begin() + loop.backEdge + 1, true)
+				!= replaced.begin() + loop.backEdge + 1) {
+				continue;
+			}
+
+			CellSet stored(cells);
+			for(int i = loop.header; i <= loop.backEdge; ++i) {
+				const Command& c = program[i];
+				if(c.getInstruction() == STORE) {
+					stored.add(c.getArg());
+				}
+				else if(isIndexedStore(c.getInstruction())) {
+					stored.addRange(c.getArg(), c.getArg() + c.getArg2());
+				}
+			}
+
+			vector<CellSet> after;
+			CellSet headerLive(cells);
+			computeBlockLiveness(program, blocks[graph.blockOf(loop.header)],
+				liveOut[graph.blockOf(loop.header)], after, headerLive);
+
+			// Поиск участков в блоках цикла
+			vector<int> begins, ends, counts;
+			for(int b = graph.blockOf(loop.header); b <= graph.blockOf(loop.backEdge); ++b) {
+				CellSet before(cells);
+				computeBlockLiveness(program, blocks[b], liveOut[b], after, before);
+				for(int s = blocks[b].begin; s < blocks[b].end; ++s) {
+					int values = 0;
+					int e = findInvariant(program, blocks[b], s, stored, headerLive, after, values);
+					if(e >= 0) {
+						begins.push_back(s);
+						ends.push_back(e);
+						counts.push_back(values);
+						s = e;
+					}
+				}
+			}
+			if(begins.empty()) {
+				continue;
+			}
+
+			// Предзаголовок: вычисление участков и сохранение результатов в новых ячейках;
+			// в цикле участки заменяются чтением результатов
+			Replacement preheader(loop.header, loop.header);
+			for(size_t k = 0; k < begins.size(); ++k) {
+				preheader.code.insert(preheader.code.end(),
+					program.begin() + begins[k], program.begin() + ends[k] + 1);
+				Replacement replacement(begins[k], ends[k] + 1);
+				for(int v = counts[k] - 1; v >= 0; --v) {
+					preheader.code.push_back(Command(STORE, cell + v));
+				}
+				for(int v = 0; v < counts[k]; ++v) {
+					replacement.code.push_back(Command(LOAD, cell + v));
+				}
+				replacements.push_back(replacement);
+				cell += counts[k];
+			}
+			replacements.push_back(preheader);
+			fill(replaced.begin() + loop.header, replaced.begin() + loop.backEdge + 1, true);
+
+			hoisted += begins.size();
+			changed = true;
+		}
+		replaceRegions(program, replacements);
+	}
+	return hoisted;
+}
+
+// Поиск произведения "LOAD cell; PUSH k; MULT" или "PUSH k; LOAD cell; MULT" по адресу address.
+// Возвращает true и множитель в factor, если оно найдено в пределах одного блока.
+static bool matchProduct(const vector<Command>& program, const FlowGraph& graph, int address,
+	int cell, int& factor)
+{
+	if(address + 2 >= (int) program.size() || program[address + 2].getInstruction() != MULT
+		|| graph.blockOf(address) != graph.blockOf(address + 2)) {
+		return false;
+	}
+	const Command& first = program[address];
+	const Command& second = program[address + 1];
+	if(first.getInstruction() == LOAD && first.getArg() == cell && second.getInstruction() == PUSH) {
+		factor = second.getArg();
+		return true;
+	}
+	if(first.getInstruction() == PUSH && second.getInstruction() == LOAD && second.getArg() == cell) {
+		factor = first.getArg();
+		return true;
+	}
+	return false;
+}
+
+// Проверка, что запись по адресу address имеет вид i := i + c или i := i - c.
+// Шаг (c или -c) возвращается в step.
+static bool matchIncrement(const vector<Command>& program, const FlowGraph& graph, int address, int& step)
+{
+	int cell = program[address].getArg();
+	if(address < 3 || graph.blockOf(address - 3) != graph.blockOf(address)) {
+		return false;
+	}
+	const Command& first = program[address - 3];
+	const Command& second = program[address - 2];
+	if(program[address - 1].getInstruction() == SUB) {
+		if(first.getInstruction() != LOAD || first.getArg() != cell || second.getInstruction() != PUSH
+			|| second.getArg() == INT_MIN) {
+			return false;
+		}
+		step = -second.getArg();
+		return true;
+	}
+	if(program[address - 1].getInstruction() != ADD) {
+		return false;
+	}
+	if(first.getInstruction() == LOAD && first.getArg() == cell && second.getInstruction() == PUSH) {
+		step = second.getArg();
+		return true;
+	}
+	if(first.getInstruction() == PUSH && second.getInstruction() == LOAD && second.getArg() == cell) {
+		step = first.getArg();
+		return true;
+	}
+	return false;
+}
+
+int reduceStrength(vector<Command>& program)
+{
+	// Циклы, не содержащие друг друга, обрабатываются за одно построение графа;
+	// объемлющий цикл измененного - при следующем (см. unrollLoops)
+	int reduced = 0;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		int cells = countCells(program);
+		if(cells <= 0) {
+			return reduced;
+		}
+
+		FlowGraph graph(program);
+		const vector<Loop>& loops = graph.getLoops();
+		vector<Replacement> replacements;
+		vector<bool> replaced(program.size(), false);
+		int product = cells;
+		for(size_t l = 0; l < loops.size(); ++l) {
+			const Loop& loop = loops[l];
+			if(find(replaced.begin() + loop.header, replaced.begin() + loop.backEdge + 1, true)
+				!= replaced.begin() + loop.backEdge + 1) {
+				continue;
+			}
+
+			// Индуктивные переменные: все записи в цикле имеют вид i := i + c
+			// (ячейки массивов, в которые пишет цикл, индуктивными не бывают)
+			map<int, bool> induction;
+			map<int, vector<int> > increments;
+			map<int, vector<int> > steps;
+			CellSet arrays(cells);
+			for(int i = loop.header; i <= loop.backEdge; ++i) {
+				const Command& c = program[i];
+				if(isIndexedStore(c.getInstruction())) {
+					arrays.addRange(c.getArg(), c.getArg() + c.getArg2());
+				}
+				if(c.getInstruction() != STORE) {
+					continue;
+				}
+				int cell = c.getArg();
+				int step = 0;
+				if(matchIncrement(program, graph, i, step)) {
+					induction.insert(make_pair(cell, true));
+					increments[cell].push_back(i);
+					steps[cell].push_back(step);
+				}
+				else {
+					induction[cell] = false;
+				}
+			}
+
+			// Произведения индуктивных переменных на константы; произведения на одну
+			// и ту же константу заменяются общей ячейкой
+			map<pair<int, int>, vector<int> > products;
+			for(int i = loop.header; i < loop.backEdge; ++i) {
+				int cell = program[i].getInstruction() == LOAD ? program[i].getArg() : program[i + 1].getArg();
+				map<int, bool>::const_iterator it = induction.find(cell);
+				int factor = 0;
+				if(it != induction.end() && it->second && !arrays.contains(cell)
+					&& matchProduct(program, graph, i, cell, factor)) {
+					products[make_pair(cell, factor)].push_back(i);
+				}
+			}
+
+			bool reducedLoop = false;
+			for(map<pair<int, int>, vector<int> >::iterator it = products.begin(); it != products.end(); ++it) {
+				int cell = it->first.first;
+				int factor = it->first.second;
+				const vector<int>& uses = it->second;
+				if(uses.size() < 2 * increments[cell].size()) {
+					continue;
+				}
+
+				for(size_t k = 0; k < uses.size(); ++k) {
+					Replacement replacement(uses[k], uses[k] + 3);
+					replacement.code.push_back(Command(LOAD, product));
+					replacements.push_back(replacement);
+				}
+				for(size_t k = 0; k < increments[cell].size(); ++k) {
+					// перед STORE i: m := m + c * k
+					Replacement replacement(increments[cell][k], increments[cell][k]);
+					replacement.code.push_back(Command(LOAD, product));
+					replacement.code.push_back(Command(PUSH, multiplyValues(steps[cell][k], factor)));
+					replacement.code.push_back(Command(ADD));
+					replacement.code.push_back(Command(STORE, product));
+					replacements.push_back(replacement);
+				}
+
+				Replacement preheader(loop.header, loop.header);
+				preheader.code.push_back(Command(LOAD, cell));
+				preheader.code.push_back(Command(PUSH, factor));
+				preheader.code.push_back(Command(MULT));
+				preheader.code.push_back(Command(STORE, product));
+				replacements.push_back(preheader);
+
+				reduced += uses.size();
+				++product;
+				reducedLoop = true;
+			}
+			if(reducedLoop) {
+				fill(replaced.begin() + loop.header, replaced.begin() + loop.backEdge + 1, true);
+				changed = true;
+			}
+		}
+		replaceRegions(program, replacements);
+	}
+	return reduced;
+}
+
+// Интервал возможных значений целого слова
+struct Interval
+{
+	Interval()
+		: low(INT_MIN), high(INT_MAX)
+	{}
+
+	Interval(long long l, long long h)
+		: low(l), high(h)
+	{}
+
+	long long low;
+	long long high;
+};
+
+// Интервал результата арифметической операции. Машина вычисляет по модулю 2^32,
+// поэтому при возможном переполнении значение неизвестно.
+static Interval combineIntervals(Instruction instruction, const Interval& a, const Interval& b)
+{
+	long long low, high;
+	if(instruction == ADD) {
+		low = a.low + b.low;
+		high = a.high + b.high;
+	}
+	else if(instruction == SUB) {
+		low = a.low - b.high;
+		high = a.high - b.low;
+	}
+	else {
+		long long products[4] = { a.low * b.low, a.low * b.high, a.high * b.low, a.high * b.high };
+		low = *min_element(products, products + 4);
+		high = *max_element(products, products + 4);
+	}
+	if(low < INT_MIN || high > INT_MAX) {
+		return Interval();
+	}
+	return Interval(low, high);
+}
+
+static Interval popInterval(vector<Interval>& stack)
+{
+	if(stack.empty()) {
+		return Interval();
+	}
+	Interval top = stack.back();
+	stack.pop_back();
+	return top;
+}
+
+// Переменная цикла и ее значения во всех точках тела [begin, end)
+struct LoopRange
+{
+	int cell;
+	int begin;
+	int end;
+	Interval values;
+};
+
+// Поиск границ переменной цикла "i := n0; while i cmp N do тело; i := i + c od".
+// Возвращает false, если цикл имеет другой вид или границы не доказываются.
+static bool findLoopRange(const vector<Command>& program, const FlowGraph& graph, const Loop& loop,
+	LoopRange& range)
+{
+	static const int mirrored[] = { 0, 1, 3, 2, 5, 4 };
+	int header = loop.header;
+	int backEdge = loop.backEdge;
+	if(backEdge - header < 8) {
+		return false;
+	}
+
+	// Условие "LOAD i; PUSH N; COMPARE cmp; JUMP_NO выход" или "PUSH N; LOAD i; ..."
+	const Command* p = &program[header];
+	if(p[2].getInstruction() != COMPARE || p[2].getArg() < 0 || p[2].getArg() > 5
+		|| p[3].getInstruction() != JUMP_NO || p[3].getArg() != backEdge + 1) {
+		return false;
+	}
+	int cell, limit, cmp;
+	if(p[0].getInstruction() == LOAD && p[1].getInstruction() == PUSH) {
+		cell = p[0].getArg();
+		limit = p[1].getArg();
+		cmp = p[2].getArg();
+	}
+	else if(p[0].getInstruction() == PUSH && p[1].getInstruction() == LOAD) {
+		cell = p[1].getArg();
+		limit = p[0].getArg();
+		cmp = mirrored[p[2].getArg()];
+	}
+	else {
+		return false;
+	}
+
+	// Последнее присваивание тела - i := i + c, других записей в i нет, а переходы
+	// не выходят за пределы тела
+	int step = 0;
+	const Command& last = program[backEdge - 1];
+	if(last.getInstruction() != STORE || last.getArg() != cell
+		|| !matchIncrement(program, graph, backEdge - 1, step)) {
+		return false;
+	}
+	range.cell = cell;
+	range.begin = header + 4;
+	range.end = backEdge - 4;
+	for(int i = range.begin; i < range.end; ++i) {
+		const Command& c = program[i];
+		if((c.getInstruction() == STORE && c.getArg() == cell)
+			|| (isIndexedStore(c.getInstruction()) && cell >= c.getArg() && cell < c.getArg() + c.getArg2())
+			|| (isJump(c.getInstruction()) && (c.getArg() < range.begin || c.getArg() > range.end))) {
+			return false;
+		}
+	}
+
+	// Начальное значение: в заголовок снаружи попадают только из предыдущего блока,
+	// и этот блок присваивает i константу
+	if(header == 0) {
+		return false;
+	}
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	const vector<int>& predecessors = blocks[graph.blockOf(header)].predecessors;
+	int entryBlock = graph.blockOf(header - 1);
+	if(find(predecessors.begin(), predecessors.end(), entryBlock) == predecessors.end()) {
+		return false;
+	}
+	for(size_t k = 0; k < predecessors.size(); ++k) {
+		int begin = blocks[predecessors[k]].begin;
+		if((begin < header || begin > backEdge) && predecessors[k] != entryBlock) {
+			return false;
+		}
+	}
+	long long initial = 0;
+	bool known = false;
+	for(int i = header - 1; i >= blocks[entryBlock].begin; --i) {
+		const Command& c = program[i];
+		if(c.getInstruction() == STORE && c.getArg() == cell) {
+			known = i > blocks[entryBlock].begin && program[i - 1].getInstruction() == PUSH;
+			initial = known ? program[i - 1].getArg() : 0;
+			break;
+		}
+		if(isIndexedStore(c.getInstruction()) && cell >= c.getArg() && cell < c.getArg() + c.getArg2()) {
+			break;
+		}
+	}
+	if(!known) {
+		return false;
+	}
+
+	// Внутри тела условие выполнено, а i монотонно изменяется от n0. Шаг не должен
+	// переполнять i после последней итерации.
+	if(step > 0 && (cmp == 2 || cmp == 4)) {
+		range.values = Interval(initial, cmp == 2 ? limit - 1LL : limit);
+		return range.values.high + step <= INT_MAX && range.values.low <= range.values.high;
+	}
+	if(step < 0 && (cmp == 3 || cmp == 5)) {
+		range.values = Interval(cmp == 3 ? limit + 1LL : limit, initial);
+		return range.values.low + step >= INT_MIN && range.values.low <= range.values.high;
+	}
+	return false;
+}
+
+int eliminateBoundsChecks(vector<Command>& program)
+{
+	for(size_t i = 0; i < program.size(); ++i) {
+		if(program[i].getInstruction() > IMPLIES) {
+			return 0;
+		}
+	}
+
+	FlowGraph graph(program);
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	const vector<Loop>& loops = graph.getLoops();
+	vector<LoopRange> ranges;
+	for(size_t l = 0; l < loops.size(); ++l) {
+		LoopRange range;
+		if(findLoopRange(program, graph, loops[l], range)) {
+			ranges.push_back(range);
+		}
+	}
+
+	// Интервалы слов стека и ячеек, записанных в блоке, вычисляются в пределах каждого
+	// блока; значения, пришедшие из других блоков, неизвестны (кроме переменных циклов)
+	int removed = 0;
+	for(size_t b = 0; b < blocks.size(); ++b) {
+		vector<Interval> stack;
+		map<int, Interval> stored;
+		for(int i = blocks[b].begin; i < blocks[b].end; ++i) {
+			const Command& c = program[i];
+			Instruction instruction = c.getInstruction();
+			if(instruction == PUSH) {
+				stack.push_back(Interval(c.getArg(), c.getArg()));
+			}
+			else if(instruction == LOAD) {
+				map<int, Interval>::iterator it = stored.find(c.getArg());
+				Interval value;
+				if(it != stored.end()) {
+					value = it->second;
+				}
+				else {
+					for(size_t r = 0; r < ranges.size(); ++r) {
+						if(ranges[r].cell == c.getArg() && i >= ranges[r].begin && i < ranges[r].end) {
+							value.low = max(value.low, ranges[r].values.low);
+							value.high = min(value.high, ranges[r].values.high);
+						}
+					}
+				}
+				stack.push_back(value);
+			}
+			else if(instruction == STORE) {
+				stored[c.getArg()] = popInterval(stack);
+			}
+			else if(instruction == DUP) {
+				Interval top = popInterval(stack);
+				stack.push_back(top);
+				stack.push_back(top);
+			}
+			else if(instruction == ADD || instruction == SUB || instruction == MULT) {
+				Interval right = popInterval(stack);
+				Interval left = popInterval(stack);
+				stack.push_back(combineIntervals(instruction, left, right));
+			}
+			else if(isIndexed(instruction)) {
+				Interval index = popInterval(stack);
+				if((instruction == BLOAD || instruction == BSTORE) && index.low >= 0 && index.high < c.getArg2()) {
+					replaceCommand(program[i], Command(instruction == BLOAD ? BLOAD_UNCHECKED : BSTORE_UNCHECKED,
+						c.getArg(), c.getArg2()));
+					++removed;
+				}
+				if(isIndexedStore(instruction)) {
+					popInterval(stack);
+					stored.erase(stored.lower_bound(c.getArg()), stored.lower_bound(c.getArg() + c.getArg2()));
+				}
+				else {
+					stack.push_back(Interval());
+				}
+			}
+			else {
+				for(int k = instructionPops(instruction); k > 0; --k) {
+					popInterval(stack);
+				}
+				for(int k = instructionPushes(instruction); k > 0; --k) {
+					stack.push_back(Interval());
+				}
+			}
+		}
+	}
+	return removed;
+}
+
+// Сравнение ячеек для раздачи адресов: сначала более частые, при равенстве - младшие
+struct HotterCell
+{
+	explicit HotterCell(const vector<long long>& weight)
+		: weight_(weight)
+	{}
+
+	bool operator()(int a, int b) const
+	{
+		return weight_[a] != weight_[b] ? weight_[a] > weight_[b] : a < b;
+	}
+
+	const vector<long long>& weight_;
+};
+
+int coalesceSlots(vector<Command>& program)
+{
+	int cells = countCells(program);
+	if(cells <= 0) {
+		return cells < 0 ? -1 : 0;
+	}
+
+	FlowGraph graph(program);
+	vector<CellSet> liveOut;
+	computeLiveness(program, graph, cells, liveOut);
+
+	// Ячейки массивов остаются на своих местах: элементы адресуются относительно начала
+	// массива. Их адреса не раздаются другим ячейкам, поэтому конфликты с ними не нужны.
+	CellSet pinned(cells);
+	int pinnedEnd = 0;
+	for(size_t i = 0; i < program.size(); ++i) {
+		const Command& c = program[i];
+		if(isIndexed(c.getInstruction())) {
+			pinned.addRange(c.getArg(), c.getArg() + c.getArg2());
+			pinnedEnd = max(pinnedEnd, c.getArg() + c.getArg2());
+		}
+	}
+
+	// Граф конфликтов: ячейка конфликтует со всеми ячейками, живыми в точке записи в нее.
+	vector<vector<int> > conflicts(cells);
+	vector<long long> weight(cells, 0);
+	vector<bool> used(cells, false);
+	const vector<BasicBlock>& blocks = graph.getBlocks();
+	vector<int> members;
+	for(size_t b = 0; b < blocks.size(); ++b) {
+		CellSet live(liveOut[b]);
+		live.subtract(pinned);
+		for(int i = blocks[b].end - 1; i >= blocks[b].begin; --i) {
+			const Command& c = program[i];
+			if((c.getInstruction() != LOAD && c.getInstruction() != STORE) || pinned.contains(c.getArg())) {
+				continue;
+			}
+
+			int cell = c.getArg();
+			long long w = 1;
+			for(int d = graph.loopDepth(i); d > 0 && w < 1000000; --d) {
+				w *= 10;
+			}
+			weight[cell] += w;
+			used[cell] = true;
+
+			if(c.getInstruction() == STORE) {
+				live.list(members);
+				for(size_t k = 0; k < members.size(); ++k) {
+					if(members[k] != cell) {
+						conflicts[cell].push_back(members[k]);
+						conflicts[members[k]].push_back(cell);
+					}
+				}
+				live.remove(cell);
+			}
+			else {
+				live.add(cell);
+			}
+		}
+	}
+
+	vector<int> order;
+	for(int cell = 0; cell < cells; ++cell) {
+		if(used[cell]) {
+			order.push_back(cell);
+		}
+	}
+	sort(order.begin(), order.end(), HotterCell(weight));
+
+	// Жадная раскраска: каждой ячейке - наименьший адрес, не занятый конфликтующими ячейками
+	vector<int> slot(cells, -1);
+	vector<int> busy;
+	int slots = 0;
+	for(int cell = 0; cell < cells; ++cell) {
+		if(pinned.contains(cell)) {
+			slot[cell] = cell;
+		}
+	}
+	for(size_t k = 0; k < order.size(); ++k) {
+		int cell = order[k];
+		busy.assign(slots + 1, -1);
+		for(size_t n = 0; n < conflicts[cell].size(); ++n) {
+			int other = slot[conflicts[cell][n]];
+			if(other >= 0) {
+				busy[other] = cell;
+			}
+		}
+		int s = 0;
+		while((s <= slots && busy[s] == cell) || (s < cells && pinned.contains(s))) {
+			++s;
+		}
+		slot[cell] = s;
+		slots = max(slots, s + 1);
+	}
+
+	for(size_t i = 0; i < program.size(); ++i) {
+		Instruction instruction = program[i].getInstruction();
+		if(instruction == LOAD || instruction == STORE) {
+			replaceCommand(program[i], Command(instruction, slot[program[i].getArg()]));
+		}
+	}
+	return max(slots, pinnedEnd);
+}
+
+// Участок программы, выносимый за пределы основного кода: [begin, end)
+struct ColdRegion
+{
+	int begin;
+	int end;
+};
+
+static bool regionOrder(const ColdRegion& a, const ColdRegion& b)
+{
+	return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+}
+
+// Отрицание условия сравнения с кодом cmp (-1, если код неизвестен)
+static int negateComparison(int cmp)
+{
+	static const int negated[] = { 1, 0, 5, 4, 3, 2 };
+	return cmp >= 0 && cmp < 6 ? negated[cmp] : -1;
+}
+
+int layoutBlocks(vector<Command>& program, const BranchProfile& profile)
+{
+	int size = program.size();
+	vector<int> jumpsInto(size + 1, 0);
+	for(int i = 0; i < size; ++i) {
+		if(isJump(program[i].getInstruction())) {
+			++jumpsInto[program[i].getJumpTarget()];
+		}
+	}
+
+	vector<ColdRegion> regions;
+	vector<bool> dropped(size, false);
+	vector<int> inverted;
+	for(int a = 0; a < size; ++a) {
+		const Command& c = program[a];
+		BranchCounts counts;
+		int target = c.getArg();
+		if(c.getInstruction() != JUMP_NO || target <= a + 1 || target > size
+			|| !profile.lookup(c.getLine(), counts)) {
+			continue;
+		}
+
+		// "JUMP_NO E; то; JUMP X; E: иначе; X:". Оператор без "иначе" не переставляется:
+		// вынесенная ветвь "то" стоила бы лишнего перехода и ничего не сэкономила бы.
+		// Условия циклов (перед E - переход назад) тоже не трогаем.
+		const Command& last = program[target - 1];
+		if(last.getInstruction() != JUMP || last.getArg() <= target) {
+			continue;
+		}
+
+		ColdRegion region;
+		bool invert = false;
+		if(counts.trueCount > counts.falseCount) {
+			// Холодная ветвь "иначе" выносится, переход в конец ветви "то" не нужен
+			region.begin = target;
+			region.end = last.getArg();
+		}
+		else if(counts.falseCount > counts.trueCount) {
+			// Холодная ветвь "то" выносится, условие обращается
+			region.begin = a + 1;
+			region.end = target;
+			invert = true;
+		}
+		else {
+			continue;
+		}
+
+		// Участки должны быть вложены друг в друга или не пересекаться
+		bool overlaps = false;
+		for(size_t r = 0; r < regions.size() && !overlaps; ++r) {
+			overlaps = (regions[r].begin < region.begin && region.begin < regions[r].end && regions[r].end < region.end)
+				|| (region.begin < regions[r].begin && regions[r].begin < region.end && region.end < regions[r].end);
+		}
+		if(overlaps) {
+			continue;
+		}
+
+		regions.push_back(region);
+		if(invert) {
+			inverted.push_back(a);
+		}
+		else {
+			dropped[target - 1] = true;
+		}
+	}
+	if(regions.empty()) {
+		return 0;
+	}
+
+	// Обращение условий: "COMPARE cmp; JUMP_NO" заменяется на "COMPARE !cmp; JUMP_NO",
+	// чтобы сохранить возможность подстановки COMPARE_JUMP_NO, иначе JUMP_NO - на JUMP_YES
+	for(size_t k = 0; k < inverted.size(); ++k) {
+		int a = inverted[k];
+		int negated = a > 0 && jumpsInto[a] == 0 && program[a - 1].getInstruction() == COMPARE
+			? negateComparison(program[a - 1].getArg()) : -1;
+		if(negated >= 0) {
+			replaceCommand(program[a - 1], Command(COMPARE, negated));
+			program[a].setJumpTarget(a + 1);
+		}
+		else {
+			replaceCommand(program[a], Command(JUMP_YES, a + 1));
+		}
+	}
+
+	// Каждая инструкция принадлежит самому внутреннему содержащему ее участку (-1 - основной код)
+	sort(regions.begin(), regions.end(), regionOrder);
+	vector<int> owner(size, -1);
+	for(size_t r = 0; r < regions.size(); ++r) {
+		for(int i = regions[r].begin; i < regions[r].end; ++i) {
+			owner[i] = r;
+		}
+	}
+
+	// Основной код, затем участки по порядку. Участок, который может закончиться без
+	// перехода, завершается переходом на инструкцию, следовавшую за ним. Адреса переходов
+	// в новой программе пока старые; удаленная инструкция получает адрес следующей.
+	vector<Command> output;
+	vector<int> newAddress(size + 1, 0);
+	for(int r = -1; r < (int) regions.size(); ++r) {
+		vector<int> pending;
+		for(int i = 0; i < size; ++i) {
+			if(owner[i] != r) {
+				continue;
+			}
+			if(dropped[i]) {
+				pending.push_back(i);
+				continue;
+			}
+			for(size_t k = 0; k < pending.size(); ++k) {
+				newAddress[pending[k]] = output.size();
+			}
+			pending.clear();
+			newAddress[i] = output.size();
+			output.push_back(program[i]);
+		}
+		if(r < 0) {
+			continue;
+		}
+		Instruction instruction = output.back().getInstruction();
+		if(!pending.empty() || (instruction != JUMP && instruction != STOP)) {
+			for(size_t k = 0; k < pending.size(); ++k) {
+				newAddress[pending[k]] = output.size();
+			}
+			int line = output.back().getLine();
+			output.push_back(Command(JUMP, regions[r].end));
+			output.back().setLine(line);
+		}
+	}
+	newAddress[size] = output.size();
+
+	for(size_t i = 0; i < output.size(); ++i) {
+		if(isJump(output[i].getInstruction())) {
+			output[i].setJumpTarget(newAddress[output[i].getJumpTarget()]);
+		}
+	}
+	program.swap(output);
+	return regions.size();
+}
+
+// Распространение копий и свертка констант до тех пор, пока они находят, что упростить
+// (свернутая константа может стать значением копии и наоборот), затем удаление мертвых присваиваний.
+static void simplify(vector<Command>& program)
+{
+	const int maxRounds = 64;
+	for(int round = 0; round < maxRounds; ++round) {
+		if(propagateCopies(program) + foldConstants(program) == 0) {
+			break;
+		}
+	}
+	eliminateDeadStores(program);
+}
+
+void optimize(vector<Command>& program, const BranchProfile* profile)
+{
+	simplify(program);
+	eliminateBoundsChecks(program);
+	if(unrollLoops(program, UNROLL_BUDGET, profile) > 0) {
+		simplify(program);
+	}
+	if(eliminateCommonSubexpressions(program) > 0) {
+		eliminateDeadStores(program);
+	}
+	hoistLoopInvariants(program);
+	reduceStrength(program);
+	eliminateDeadStores(program);
+	coalesceSlots(program);
+	inheritLines(program);
+}
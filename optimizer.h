@@ -0,0 +1,209 @@
+#ifndef CMILAN_OPTIMIZER_H
+#define CMILAN_OPTIMIZER_H
+
+#include "codegen.h"
+#include "profile.h"
+#include <vector>
+
+using namespace std;
+
+// Оптимизатор.
+//
+// Парсер порождает код за один проход, поэтому промежуточным представлением для
+// оптимизатора служит сама программа для виртуальной машины (буфер CodeGen).
+// Проходы оптимизатора строят по программе граф потока управления, выполняют
+// анализ потока данных для ячеек памяти и переписывают инструкции на месте.
+//
+// Проходы работают с обычными инструкциями и должны выполняться до подстановки
+// суперинструкций (см. fusion.h). Чтение элемента массива (BLOAD) считается чтением
+// всех ячеек массива, а запись в элемент (BSTORE) - возможным изменением любой из них.
+
+// Базовый блок: участок программы [begin, end), в который можно попасть только
+// через первую инструкцию и из которого можно выйти только после последней.
+struct BasicBlock
+{
+	int begin;                  // адрес первой инструкции
+	int end;                    // адрес, следующий за последней инструкцией
+	vector<int> successors;     // номера блоков-преемников
+	vector<int> predecessors;   // номера блоков-предшественников
+};
+
+// Естественный цикл, образованный обратным переходом. Парсер порождает для while
+// код вида "header: условие; JUMP_NO выход; тело; backEdge: JUMP header", поэтому
+// цикл занимает непрерывный участок [header, backEdge].
+struct Loop
+{
+	int header;     // адрес первой инструкции проверки условия
+	int backEdge;   // адрес инструкции JUMP на header
+};
+
+// Граф потока управления программы
+class FlowGraph
+{
+public:
+	explicit FlowGraph(const vector<Command>& program);
+
+	const vector<BasicBlock>& getBlocks() const
+	{
+		return blocks_;
+	}
+
+	// Номер блока, содержащего инструкцию с адресом address
+	int blockOf(int address) const
+	{
+		return blockOf_[address];
+	}
+
+	// Глубина вложенности циклов для инструкции с адресом address. Циклы находятся
+	// по обратным переходам: JUMP назад на адрес t образует цикл [t, адрес перехода].
+	int loopDepth(int address) const
+	{
+		return loopDepth_[address];
+	}
+
+	// Естественные циклы: в участок цикла можно войти только через заголовок.
+	// Вложенные циклы идут раньше объемлющих.
+	const vector<Loop>& getLoops() const
+	{
+		return loops_;
+	}
+
+private:
+	vector<BasicBlock> blocks_; // базовые блоки в порядке адресов
+	vector<Loop> loops_;        // естественные циклы
+	vector<int> blockOf_;       // номер блока для каждой инструкции
+	vector<int> loopDepth_;     // глубина вложенности циклов для каждой инструкции
+};
+
+// Распространение копий.
+//
+// Присваивание вида "LOAD b; STORE a" (a := b) или "PUSH n; STORE a" (a := n) запоминается,
+// и последующие чтения a заменяются чтением b или константой n во всех точках, куда
+// копия доходит по всем путям без изменения a и b. Анализ прямой, по графу потока управления.
+// Выражения над известными константами вычисляются при анализе, так что константой
+// становится и a := b * 2 + 1 при известном b; условный переход по известному значению
+// передает состояние только в тот блок, куда ведет. Анализ решается одним обходом
+// блоков по очереди, а не повторением прохода вместе со сверткой.
+// Возвращает количество замененных инструкций.
+int propagateCopies(vector<Command>& program);
+
+// Удаление мертвых присваиваний.
+//
+// Запись в ячейку, значение которой дальше не читается ни на одном пути, заменяется
+// снятием значения со стека, после чего вычисление этого значения удаляется, если
+// оно не имеет побочных эффектов. INPUT (чтение read(...)) и PRINT (write(...)) всегда
+// сохраняются, как и DIV, которая может остановить машину делением на ноль.
+// Возвращает количество удаленных присваиваний.
+int eliminateDeadStores(vector<Command>& program);
+
+// Свертка констант.
+//
+// Операции над константами, положенными в стек в том же блоке, вычисляются во время
+// компиляции; обращение к элементу массива с константным индексом в границах массива
+// заменяется обращением к его ячейке (LOAD/STORE). Условный переход по константе заменяется безусловным или удаляется,
+// после чего недостижимый код удаляется. Деление на ноль не сворачивается.
+// Возвращает количество свернутых инструкций.
+int foldConstants(vector<Command>& program);
+
+// Наибольший размер кода (в инструкциях), который может занять развернутый цикл
+const int UNROLL_BUDGET = 256;
+
+// Во сколько раз увеличивается бюджет развертки для горячих по профилю циклов
+const int HOT_UNROLL_FACTOR = 4;
+
+// Развертка циклов с известным числом повторений.
+//
+// Распознаются циклы вида "i := n0; while i cmp N do тело; i := i + c od", где n0 и N -
+// константы, а i изменяется в цикле только последним присваиванием. Число повторений
+// вычисляется по формуле, без прогона цикла. Если развернутый
+// цикл помещается в budget инструкций, он заменяется копиями тела, между которыми i
+// присваиваются константные значения; затем распространение констант и свертка
+// упрощают каждую копию. Иначе тело повторяется U раз (U делит число повторений, U <= 8)
+// и условие проверяется один раз на U итераций.
+// За одно построение графа разворачиваются все подходящие циклы, поэтому время прохода
+// растет с глубиной вложенности, а не с количеством циклов.
+// Если передан профиль (см. profile.h), циклы, тело которых ни разу не выполнялось,
+// не разворачиваются, а для горячих циклов бюджет увеличивается в HOT_UNROLL_FACTOR раз.
+// Возвращает количество развернутых циклов.
+int unrollLoops(vector<Command>& program, int budget = UNROLL_BUDGET, const BranchProfile* profile = 0);
+
+// Устранение проверок индексов массивов.
+//
+// Для циклов вида "i := n0; while i cmp N do тело; i := i + c od", где n0 и N - константы,
+// cmp - "<" или "<=" при c > 0 (">" или ">=" при c < 0; шаг может быть записан и как
+// i := i - c), а i изменяется в цикле только последним присваиванием, известны границы i
+// во всем теле, включая вложенные циклы.
+// В каждом блоке интервалы значений вычисляются для слов стека (PUSH, LOAD, ADD, SUB,
+// MULT) и ячеек, записанных в этом же блоке. BLOAD и BSTORE, индекс которых заведомо
+// лежит в границах массива, заменяются вариантами без проверки. Начальное значение i
+// ищется только в блоке перед заголовком, поэтому проход выполняется до развертки циклов.
+// Возвращает количество устраненных проверок.
+int eliminateBoundsChecks(vector<Command>& program);
+
+// Удаление общих подвыражений.
+//
+// Внутри каждого блока выполняется нумерация значений: одинаковые операции над
+// одинаковыми значениями получают один номер (для коммутативных операций порядок
+// операндов не важен), а чтение ячейки после записи получает номер записанного значения.
+// Благодаря этому совпадают и компоненты комплексных выражений, вычисляемые через
+// временные ячейки. Первое вычисление повторяющегося подвыражения сохраняется
+// инструкциями "DUP; STORE t", повторные заменяются на "LOAD t". Замена выполняется,
+// только если она сокращает код; более длинные подвыражения рассматриваются первыми.
+// Возвращает количество замененных вычислений.
+int eliminateCommonSubexpressions(vector<Command>& program);
+
+// Вынос инвариантов циклов.
+//
+// В каждом естественном цикле ищутся участки кода без побочных эффектов, которые
+// оставляют в стеке одно или два слова (целое или комплексное значение) и читают
+// только ячейки, не изменяемые в цикле. Такой участок может пользоваться своими
+// временными ячейками (так устроены комплексные операции), если их значения не нужны
+// после участка. Участок переносится в предзаголовок перед циклом, результат
+// сохраняется в новых ячейках, а в цикле остается только их чтение. Переходы в цикл
+// снаружи ведут на предзаголовок, обратные переходы - на прежний заголовок.
+// Возвращает количество вынесенных участков.
+int hoistLoopInvariants(vector<Command>& program);
+
+// Снижение стоимости операций с индуктивными переменными.
+//
+// Переменная i, которая в цикле изменяется только присваиваниями вида i := i + c
+// (или i := i - c), является индуктивной. Произведения i * k (k - константа) внутри цикла заменяются
+// чтением новой ячейки m, которая вычисляется перед циклом как i * k и увеличивается
+// на c * k при каждом изменении i. Замена выполняется, только если произведений в цикле
+// хотя бы вдвое больше, чем изменений i, иначе обновление m обходится дороже.
+// Возвращает количество выполненных замен.
+int reduceStrength(vector<Command>& program);
+
+// Совмещение ячеек памяти переменных.
+//
+// Анализ живучести по графу потока управления определяет, в каких точках программы
+// значение каждой ячейки еще может быть прочитано. Ячейки, время жизни которых не
+// пересекается, получают общий адрес. Адреса раздаются по убыванию частоты обращений
+// (обращения внутри циклов весят больше), так что часто используемые переменные
+// получают младшие смежные адреса.
+//
+// Ячейки массивов остаются на своих адресах: элементы адресуются относительно начала
+// массива, известного только инструкциям BLOAD/BSTORE.
+// Возвращает размер памяти данных после совмещения или -1, если программа не изменялась.
+int coalesceSlots(vector<Command>& program);
+
+// Расположение блоков по профилю.
+//
+// Для каждого оператора "if ... else", условие которого есть в профиле, более частая
+// ветвь становится продолжением условного перехода, а более редкая выносится за пределы
+// основного кода (в конец программы) и завершается переходом обратно:
+//    "то" чаще "иначе":  "JUMP_NO E; то; X: ..."       E: иначе; JUMP X
+//    "иначе" чаще "то":  "JUMP_YES T; иначе; X: ..."   T: то; JUMP X
+// В первом случае частый путь обходится без перехода в конец оператора, во втором
+// количество выполняемых инструкций не меняется. Обращенное условие после
+// COMPARE записывается обращением сравнения, чтобы сохранить подстановку COMPARE_JUMP_NO.
+// Условия циклов не затрагиваются. Проход выполняется последним: остальные проходы
+// рассчитывают на то, что код цикла занимает непрерывный участок.
+// Возвращает количество переставленных операторов.
+int layoutBlocks(vector<Command>& program, const BranchProfile& profile);
+
+// Применение всех проходов оптимизатора. Профиль (если передан) используется
+// при развертке циклов.
+void optimize(vector<Command>& program, const BranchProfile* profile = 0);
+
+#endif
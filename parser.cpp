@@ -5,12 +5,17 @@
 //никаких ошибок, то выводим последовательность команд стек-машины
 void Parser::parse()
 {
-	program(); 
-	if(!error_) {
+	if(compile()) {
 		codegen_->flush();
 	}
 }
 
+bool Parser::compile()
+{
+	program();
+	return !error_;
+}
+
 void Parser::program()
 {
 	mustBe(T_BEGIN);
@@ -39,16 +44,31 @@ void Parser::statementList()
 
 void Parser::statement()
 {
+	// Учет операторов: инструкции вложенных операторов относятся к ним самим
+	StatementKind kind = STATEMENT_INVALID;
+	int begin = codegen_->getCurrentAddress();
+	int outerNested = nestedCode_;
+	nestedCode_ = 0;
+
 	Type type_statement = TYPE_INT;
 	// Если встречаем переменную, то запоминаем ее адрес или добавляем новую если не встретили. 
 	// Следующей лексемой должно быть присваивание. Затем идет блок expression, который возвращает значение на вершину стека.
 	// Записываем это значение по адресу нашей переменной
 	if(see(T_IDENTIFIER)) {
+		kind = STATEMENT_ASSIGN;
 		string varName = scanner_->getStringValue();
 		int varAddress = findOrAddVariable(varName);
 		next();
-		mustBe(T_ASSIGN);
-		type_statement = expression();
+		//Присваивание элементу массива порождает код само, тип TYPE_UNDEF
+		//исключает дальнейшую запись в переменную
+		if (see(T_LBRACKET) || getLength(varName) > 0) {
+			storeElement(varName, varAddress);
+			type_statement = TYPE_UNDEF;
+		}
+		else {
+			mustBe(T_ASSIGN);
+			type_statement = expression();
+		}
 		if (type_statement == TYPE_INT) {
 			//Определяем тип новой переменной
 			if (getType(varName) == TYPE_UNDEF) {
@@ -96,6 +116,7 @@ void Parser::statement()
 	// Затем зарезервируем место для условного перехода JUMP_NO к блоку ELSE (переход в случае ложного условия). Адрес перехода
 	// станет известным только после того, как будет сгенерирован код для блока THEN.
 	else if(match(T_IF)) {
+		kind = STATEMENT_IF;
 		relation();
 		
 		int jumpNoAddress = codegen_->reserve();
@@ -122,6 +143,7 @@ void Parser::statement()
 	}
 
 	else if(match(T_WHILE)) {
+		kind = STATEMENT_WHILE;
 		//запоминаем адрес начала проверки условия.
 		int conditionAddress = codegen_->getCurrentAddress();
 		relation();
@@ -135,7 +157,12 @@ void Parser::statement()
 		//заполняем зарезервированный адрес инструкцией условного перехода на следующий за циклом оператор.
 		codegen_->emitAt(jumpNoAddress, JUMP_NO, codegen_->getCurrentAddress());
 	}
+	else if(see(T_TYPE)) {
+		kind = STATEMENT_DECLARE;
+		declaration();
+	}
 	else if(match(T_WRITE)) {
+		kind = STATEMENT_WRITE;
 		mustBe(T_LPAREN);
 		Type type_write = expression();
 		mustBe(T_RPAREN);
@@ -153,6 +180,17 @@ void Parser::statement()
 	else {
 		reportError("statement expected.");
 	}
+
+	int code = codegen_->getCurrentAddress() - begin;
+	if(stats_) {
+		++stats_->statements[kind];
+		stats_->statementCode[kind] += code - nestedCode_;
+	}
+	nestedCode_ = outerNested + code;
+	//После ошибки код программы не печатается, как и в буферизованном режиме
+	if(!error_) {
+		codegen_->commit();
+	}
 }
 Type Parser::expression()
 {
@@ -164,10 +202,10 @@ Type Parser::expression()
 			Type type_scndFactor = logicOr();
 			if (type_fstFactor == type_scndFactor && type_fstFactor == TYPE_BOOL) {
 				if (op == A_IMPLICATION) {
-					codegen_->emit(COMPARE, 4);
+					codegen_->emit(IMPLIES);
 				}
 				else if (op == A_XOR) {
-					codegen_->emit(COMPARE, 1);
+					codegen_->emit(XOR);
 				}
 			}
 			else {
@@ -182,9 +220,7 @@ Type Parser::logicOr() {
 		next();
 		Type sndLogic = logicAnd();
 		if (fstLogic == TYPE_BOOL && sndLogic == TYPE_BOOL) {
-			codegen_->emit(ADD);
-			codegen_->emit(PUSH, 1);
-			codegen_->emit(COMPARE, 5);
+			codegen_->emit(OR);
 		}
 		else {
 			reportError("a bool expression expected");
@@ -198,7 +234,7 @@ Type Parser::logicAnd() {
 		next();
 		Type sndLogic = relationTerm();
 		if (fstLogic == TYPE_BOOL && sndLogic == TYPE_BOOL) {
-			codegen_->emit(MULT);
+			codegen_->emit(AND);
 		}
 		else {
 			reportError("a bool expression expected");
@@ -248,28 +284,26 @@ Type Parser::relationTerm()
 		else if (fstExpression == TYPE_CMPLX && scndExpession == TYPE_CMPLX) {
 			Cmp cmp = scanner_->getCmpValue();
 			if (cmp == C_EQ) {
-				codegen_->emit(STORE, lastVar_ + SHIFT);
-				codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-				codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+				codegen_->emit(STORE, TEMP);
+				codegen_->emit(STORE, TEMP + 1);
+				codegen_->emit(STORE, TEMP + 2);
+				codegen_->emit(LOAD, TEMP + 1);
 				codegen_->emit(COMPARE, 0);
-				codegen_->emit(LOAD, lastVar_ + SHIFT);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
+				codegen_->emit(LOAD, TEMP);
+				codegen_->emit(LOAD, TEMP + 2);
 				codegen_->emit(COMPARE, 0);
-				codegen_->emit(MULT);
+				codegen_->emit(AND);
 			}
 			else if (cmp == C_NE) {
-				codegen_->emit(STORE, lastVar_ + SHIFT);
-				codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-				codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+				codegen_->emit(STORE, TEMP);
+				codegen_->emit(STORE, TEMP + 1);
+				codegen_->emit(STORE, TEMP + 2);
+				codegen_->emit(LOAD, TEMP + 1);
 				codegen_->emit(COMPARE, 1);
-				codegen_->emit(LOAD, lastVar_ + SHIFT);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
+				codegen_->emit(LOAD, TEMP);
+				codegen_->emit(LOAD, TEMP + 2);
 				codegen_->emit(COMPARE, 1);
-				codegen_->emit(ADD);
-				codegen_->emit(PUSH, 1);
-				codegen_->emit(COMPARE, 5);
+				codegen_->emit(OR);
 			}
 			else {
 				reportError("comparison operator is not defined for complex variables.");
@@ -293,31 +327,20 @@ Type Parser::arithmetic()
 		 терма, пока не встретим за термом символ, отличный от '+' и '-'
 		 Если выражение имеет тип bool, то разрешается использовать логическое "или"
      */
+	int fstAddress = codegen_->getCurrentAddress();
 	Type type_term = term();
 	while(see(T_ADDOP)) {
 		Arithmetic op = scanner_->getArithmeticValue();
 		next();
 		Type type_fstFactor = type_term;
+		int scndAddress = codegen_->getCurrentAddress();
 		Type type_scndFactor = term();
 		//приведение типов
 		if (type_scndFactor != type_fstFactor) {
 			// Выбирается тот тип, приоритет которого больше
 			type_term = (type_fstFactor > type_scndFactor)? type_fstFactor: type_scndFactor;
 			if (type_term == TYPE_CMPLX) {
-				if (type_fstFactor != TYPE_CMPLX) {
-					codegen_->emit(STORE, lastVar_ + SHIFT);
-					codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-					codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-					codegen_->emit(PUSH, 0);
-					codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
-					codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
-					codegen_->emit(LOAD, lastVar_ + SHIFT);
-				}
-				else {
-					codegen_->emit(STORE, lastVar_ + SHIFT);
-					codegen_->emit(PUSH, 0);
-					codegen_->emit(LOAD, lastVar_ + SHIFT);
-				}
+				promoteToComplex(type_fstFactor != TYPE_CMPLX ? fstAddress : scndAddress);
 			}
 		}
 		
@@ -332,18 +355,18 @@ Type Parser::arithmetic()
 			}
 		}
 		else if (type_term == TYPE_CMPLX) {
-			codegen_->emit(STORE, lastVar_ + SHIFT);
-			codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-			codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+			codegen_->emit(STORE, TEMP);
+			codegen_->emit(STORE, TEMP + 1);
+			codegen_->emit(STORE, TEMP + 2);
+			codegen_->emit(LOAD, TEMP + 1);
 			if (op == A_PLUS){
 				codegen_->emit(ADD);
 			}
 			else if (op == A_MINUS) {
 				codegen_->emit(SUB);
 			}
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
-			codegen_->emit(LOAD, lastVar_ + SHIFT);
+			codegen_->emit(LOAD, TEMP + 2);
+			codegen_->emit(LOAD, TEMP);
 			if (op == A_PLUS) {
 				codegen_->emit(ADD);
 			}
@@ -352,15 +375,12 @@ Type Parser::arithmetic()
 			}
 		}
 		else if (type_term == TYPE_BOOL) {
+			//для логических значений "+" означает "или", а "-" - исключающее "или"
 			if (op == A_PLUS) {
-				codegen_->emit(ADD);
-				codegen_->emit(PUSH, 1);
-				codegen_->emit(COMPARE, 5);
+				codegen_->emit(OR);
 			}
 			else if (op == A_MINUS) {
-				codegen_->emit(SUB);
-				codegen_->emit(PUSH, 0);
-				codegen_->emit(COMPARE, 1);
+				codegen_->emit(XOR);
 			}
 		}
 	}
@@ -376,35 +396,28 @@ Type Parser::term()
 		 удаляем его из потока и разбираем очередное слагаемое (вычитаемое). Повторяем проверку и разбор очередного 
 		 множителя, пока не встретим за ним символ, отличный от '*' и '/' 
 	*/
+	int fstAddress = codegen_->getCurrentAddress();
 	Type type_term = factor();
 	while(see(T_MULOP)) {
 		Arithmetic op = scanner_->getArithmeticValue();
 		next();
 		Type type_fstFactor = type_term;
+		int scndAddress = codegen_->getCurrentAddress();
 		Type type_scndFactor = factor();
 		//приведение типов
 		if (type_scndFactor != type_fstFactor) {
 			// Выбирается тот тип, приоритет которого больше
 			type_term = (type_fstFactor > type_scndFactor) ? type_fstFactor : type_scndFactor;
 			if (type_term == TYPE_CMPLX) {
-				if (type_fstFactor != TYPE_CMPLX) {
-					codegen_->emit(STORE, lastVar_ + SHIFT);
-					codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-					codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-					codegen_->emit(PUSH, 0);
-					codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
-					codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
-					codegen_->emit(LOAD, lastVar_ + SHIFT);
-				}
-				else {
-					codegen_->emit(STORE, lastVar_ + SHIFT);
-					codegen_->emit(PUSH, 0);
-					codegen_->emit(LOAD, lastVar_ + SHIFT);
-				}
+				promoteToComplex(type_fstFactor != TYPE_CMPLX ? fstAddress : scndAddress);
 			}
 		}
-		//вычисление умножения и деления
-		if (type_term == TYPE_INT || type_term == TYPE_BOOL)
+		//вычисление умножения и деления. Для логических значений умножение означает "и"
+		if (type_term == TYPE_BOOL && op == A_MULTIPLY)
+		{
+			codegen_->emit(AND);
+		}
+		else if (type_term == TYPE_INT || type_term == TYPE_BOOL)
 		{
 			if (op == A_MULTIPLY) {
 				codegen_->emit(MULT);
@@ -418,44 +431,44 @@ Type Parser::term()
 		}
 		else if (type_term == TYPE_CMPLX)
 		{
-			codegen_->emit(STORE, lastVar_ + SHIFT);
-			codegen_->emit(STORE, lastVar_ + SHIFT + 1);
-			codegen_->emit(STORE, lastVar_ + SHIFT + 2);
-			codegen_->emit(STORE, lastVar_ + SHIFT + 3);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 3);
-			codegen_->emit(LOAD, lastVar_ + SHIFT);
+			codegen_->emit(STORE, TEMP);
+			codegen_->emit(STORE, TEMP + 1);
+			codegen_->emit(STORE, TEMP + 2);
+			codegen_->emit(STORE, TEMP + 3);
+			codegen_->emit(LOAD, TEMP + 3);
+			codegen_->emit(LOAD, TEMP);
 			codegen_->emit(MULT);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+			codegen_->emit(LOAD, TEMP + 2);
+			codegen_->emit(LOAD, TEMP + 1);
 			codegen_->emit(MULT);
 			if (op == A_MULTIPLY) {
 				codegen_->emit(ADD);
 			}
 			else if (op == A_DIVIDE)  {
 				codegen_->emit(SUB);
-				codegen_->emit(LOAD, lastVar_ + SHIFT);
-				codegen_->emit(LOAD, lastVar_ + SHIFT);
+				codegen_->emit(LOAD, TEMP);
+				codegen_->emit(LOAD, TEMP);
 				codegen_->emit(MULT);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+				codegen_->emit(LOAD, TEMP + 1);
+				codegen_->emit(LOAD, TEMP + 1);
 				codegen_->emit(MULT);
 				codegen_->emit(ADD);
-				codegen_->emit(STORE, lastVar_ + SHIFT + 4);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 4);
+				codegen_->emit(STORE, TEMP + 4);
+				codegen_->emit(LOAD, TEMP + 4);
 				codegen_->emit(DIV);
 			}
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 2);
-			codegen_->emit(LOAD, lastVar_ + SHIFT);
+			codegen_->emit(LOAD, TEMP + 2);
+			codegen_->emit(LOAD, TEMP);
 			codegen_->emit(MULT);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 3);
-			codegen_->emit(LOAD, lastVar_ + SHIFT + 1);
+			codegen_->emit(LOAD, TEMP + 3);
+			codegen_->emit(LOAD, TEMP + 1);
 			codegen_->emit(MULT);
 			if (op == A_MULTIPLY) {
 				codegen_->emit(SUB);
 			}
 			else if (op == A_DIVIDE) {
 				codegen_->emit(ADD);
-				codegen_->emit(LOAD, lastVar_ + SHIFT + 4);
+				codegen_->emit(LOAD, TEMP + 4);
 				codegen_->emit(DIV);
 			}
 			else {
@@ -471,8 +484,8 @@ Type Parser::factor()
 	Type type_factor = TYPE_INT;
 	/*
 		Множитель описывается следующими правилами:
-		<factor> -> number | complex | bool | identifier | -<factor> | (<expression>) | READ
-		| !<factor>
+		<factor> -> number | complex | bool | identifier | identifier[<expression>] | -<factor>
+		| (<expression>) | READ | !<factor>
 	*/
 	if(see(T_NUMBER)) {
 		int value = scanner_->getIntValue();
@@ -495,10 +508,17 @@ Type Parser::factor()
 		type_factor = TYPE_BOOL;
 	}
 	else if(see(T_IDENTIFIER)) {
-		int varAddress = findOrAddVariable(scanner_->getStringValue());
-		Type varType = getType(scanner_->getStringValue());
+		string varName = scanner_->getStringValue();
+		int varAddress = findOrAddVariable(varName);
+		Type varType = getType(varName);
 		next();
-		if (varType == TYPE_INT || varType == TYPE_BOOL)
+		if (see(T_LBRACKET)) {
+			loadElement(varName, varAddress);
+		}
+		else if (getLength(varName) > 0) {
+			reportError("array element index expected");
+		}
+		else if (varType == TYPE_INT || varType == TYPE_BOOL)
 		{
 			codegen_->emit(LOAD, varAddress);
 		}
@@ -518,9 +538,9 @@ Type Parser::factor()
 		}
 		else if (type_factor == TYPE_CMPLX) {
 			codegen_->emit(INVERT);
-			codegen_->emit(STORE, lastVar_ + SHIFT);
+			codegen_->emit(STORE, TEMP);
 			codegen_->emit(INVERT);
-			codegen_->emit(LOAD, lastVar_ + SHIFT);
+			codegen_->emit(LOAD, TEMP);
 		}
 		//Если встретили знак "-", и за ним <factor> то инвертируем значение, лежащее на вершине стека
 	}
@@ -529,8 +549,7 @@ Type Parser::factor()
 		next();
 		type_factor = factor();
 		if (type_factor == TYPE_BOOL) {
-			codegen_->emit(PUSH, 0);
-			codegen_->emit(COMPARE, 0);
+			codegen_->emit(NOT);
 		}
 		else {
 			reportError("Bool variable expected");
@@ -551,9 +570,9 @@ Type Parser::factor()
 			}
 			else if (scanner_->getTypeValue() == "complex") {
 				codegen_->emit(INPUT);
-				codegen_->emit(STORE, lastVar_ + SHIFT);
+				codegen_->emit(STORE, TEMP);
 				codegen_->emit(INPUT);
-				codegen_->emit(LOAD, lastVar_ + SHIFT);
+				codegen_->emit(LOAD, TEMP);
 				type_factor = TYPE_CMPLX;
 			}
 			else if (scanner_->getTypeValue() == "bool") {
@@ -578,6 +597,141 @@ Type Parser::factor()
 	}
 	return type_factor;
 }
+void Parser::promoteToComplex(int operandAddress)
+{
+	//Тип операнда становится известен только после разбора второго операнда, но код выражения
+	//не содержит переходов, поэтому мнимую часть можно вставить прямо перед кодом целого операнда:
+	//литерал или переменная сразу материализуются как комплексное число (PUSH 0; PUSH v),
+	//без перекладывания операндов через временные ячейки.
+	codegen_->insert(operandAddress, PUSH, 0);
+}
+
+// Объявление массива: TYPE identifier [ number ]. Элементы массива занимают соседние ячейки,
+// а комплексного - вдвое больше: сначала действительные части всех элементов, затем мнимые,
+// чтобы адрес любой части вычислялся без умножения индекса. Как и остальные ячейки памяти,
+// элементы изначально равны нулю.
+void Parser::declaration()
+{
+	string typeName = scanner_->getTypeValue();
+	Type type = typeName == "complex" ? TYPE_CMPLX : typeName == "bool" ? TYPE_BOOL : TYPE_INT;
+	next();
+	string name = see(T_IDENTIFIER) ? scanner_->getStringValue() : "";
+	mustBe(T_IDENTIFIER);
+	mustBe(T_LBRACKET);
+	int length = see(T_NUMBER) ? scanner_->getIntValue() : 0;
+	mustBe(T_NUMBER);
+	mustBe(T_RBRACKET);
+	if(name.empty()) {
+		return;
+	}
+	if(stats_) {
+		++stats_->symbolLookups;
+	}
+	if(variables_.find(name) != variables_.end()) {
+		reportError("variable '" + name + "' is already defined");
+	}
+	else if(length < 1 || length > MAX_ARRAY_LENGTH) {
+		reportError("invalid array size");
+	}
+	else {
+		if(stats_) {
+			++stats_->variables;
+		}
+		variables_[name] = Variable(type, lastVar_);
+		arrays_[name] = length;
+		lastVar_ += type == TYPE_CMPLX ? 2 * length : length;
+	}
+}
+
+void Parser::index()
+{
+	mustBe(T_LBRACKET);
+	if(expression() != TYPE_INT) {
+		reportError("array index must be an integer");
+	}
+	mustBe(T_RBRACKET);
+}
+
+// Индекс комплексного элемента нужен дважды, поэтому он сохраняется во временной ячейке.
+// На вершине стека, как и для комплексной переменной, оказывается действительная часть.
+void Parser::loadElement(const string& name, int address)
+{
+	int length = getLength(name);
+	if(length == 0) {
+		reportError("'" + name + "' is not an array");
+	}
+	index();
+	if(getType(name) == TYPE_CMPLX) {
+		codegen_->emit(STORE, TEMP);
+		codegen_->emit(LOAD, TEMP);
+		codegen_->emit(BLOAD, address + length, length);
+		codegen_->emit(LOAD, TEMP);
+		codegen_->emit(BLOAD, address, length);
+	}
+	else {
+		codegen_->emit(BLOAD, address, length);
+	}
+}
+
+// BSTORE снимает индекс с вершины стека, а значение берет из-под него, поэтому код индекса
+// переносится за код значения. Порядок вычисления заметен только по чтению ввода: если
+// индекс читает ввод (a[read] := read), индекс и значение вычисляются в порядке текста,
+// а затем меняются местами через временные ячейки.
+// Тип значения должен совпадать с типом элементов, как и при присваивании переменной.
+void Parser::storeElement(const string& name, int address)
+{
+	int length = getLength(name);
+	Type type = getType(name);
+	if(length == 0) {
+		reportError("'" + name + "' is not an array");
+	}
+	int indexBegin = codegen_->getCurrentAddress();
+	if(see(T_LBRACKET)) {
+		index();
+	}
+	else {
+		reportError("array element index expected");
+	}
+	int indexEnd = codegen_->getCurrentAddress();
+	mustBe(T_ASSIGN);
+	Type valueType = expression();
+	bool sourceOrder = codegen_->readsInput(indexBegin, indexEnd);
+	if(!sourceOrder) {
+		codegen_->moveToEnd(indexBegin, indexEnd);
+	}
+	if(length == 0) {
+		return;
+	}
+	if(valueType != type) {
+		reportError("value type does not match the array element type");
+	}
+	else if(type == TYPE_CMPLX) {
+		if(sourceOrder) {
+			codegen_->emit(STORE, TEMP + 1);
+			codegen_->emit(STORE, TEMP + 2);
+			codegen_->emit(STORE, TEMP);
+			codegen_->emit(LOAD, TEMP + 2);
+			codegen_->emit(LOAD, TEMP + 1);
+		}
+		else {
+			codegen_->emit(STORE, TEMP);
+		}
+		codegen_->emit(LOAD, TEMP);
+		codegen_->emit(BSTORE, address, length);
+		codegen_->emit(LOAD, TEMP);
+		codegen_->emit(BSTORE, address + length, length);
+	}
+	else {
+		if(sourceOrder) {
+			codegen_->emit(STORE, TEMP + 1);
+			codegen_->emit(STORE, TEMP);
+			codegen_->emit(LOAD, TEMP + 1);
+			codegen_->emit(LOAD, TEMP);
+		}
+		codegen_->emit(BSTORE, address, length);
+	}
+}
+
 void Parser::relation() {
 	if (expression() != TYPE_BOOL)
 	{
@@ -587,8 +741,14 @@ void Parser::relation() {
 
 int Parser::findOrAddVariable(const string& var, Type type)
 {
+	if(stats_) {
+		++stats_->symbolLookups;
+	}
 	VarTable::iterator it = variables_.find(var);
 	if(it == variables_.end()) {
+		if(stats_) {
+			++stats_->variables;
+		}
 		variables_[var] = Variable (type, lastVar_);
 		return lastVar_++;
 	}
@@ -600,19 +760,53 @@ int Parser::findOrAddVariable(const string& var, Type type)
 
 void Parser::findAndChangeType(const string& var, Type type)
 {
+	if(stats_) {
+		++stats_->symbolLookups;
+	}
 	VarTable::iterator it = variables_.find(var);
 	if (it != variables_.end()) {
 		variables_[var].first = type;
 	}
 }
+int Parser::getLength(const string& var)
+{
+	ArrayTable::iterator it = arrays_.find(var);
+	return it != arrays_.end() ? it->second : 0;
+}
+
 Type Parser::getType(const string& var)
 {
+	if(stats_) {
+		++stats_->symbolLookups;
+	}
 	VarTable::iterator it = variables_.find(var);
 	if (it != variables_.end()) {
 		return variables_[var].first;
 	}
 	else return TYPE_INT;
 }
+void Parser::scanCounted()
+{
+	{
+		PhaseTimer timer(stats_, PHASE_LEX, false);
+		scanner_->nextToken();
+	}
+	Token t = scanner_->token();
+	if(t == T_EOF) {
+		return;
+	}
+	++stats_->tokens;
+	if(t == T_IDENTIFIER) {
+		++stats_->identifiers;
+	}
+	else if((t >= T_BEGIN && t <= T_READ) || t == T_TYPE) {
+		++stats_->keywords;
+	}
+	else if(t == T_NUMBER || t == T_COMPLEX || t == T_BOOL) {
+		++stats_->literals;
+	}
+}
+
 void Parser::mustBe(Token t)
 {
 	if(!match(t)) {
@@ -3,6 +3,7 @@
 
 #include "scanner.h"
 #include "codegen.h"
+#include "stats.h"
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -10,6 +11,8 @@
 
 using namespace std;
 
+const int MAX_ARRAY_LENGTH = 1 << 24; //наибольшее количество элементов массива
+
 /* Синтаксический анализатор.
  *
  * Задачи:
@@ -36,14 +39,16 @@ class Parser
 public:
 	// Конструктор
 	//    const string& fileName - имя файла с программой для анализа
+	//    CompileStats* stats - статистика компиляции (0 - не собирать)
 	//
 	// Конструктор создает экземпляры лексического анализатора и генератора.
 
-	Parser(const string& fileName, istream& input)
-		: output_(cout), error_(false), recovered_(true), lastVar_(0)
+	Parser(const string& fileName, istream& input, CompileStats* stats = 0)
+		: output_(cout), error_(false), recovered_(true), lastVar_(TEMP_CELLS), stats_(stats), nestedCode_(0)
 	{
 		scanner_ = new Scanner(fileName, input);
 		codegen_ = new CodeGen(output_);
+		codegen_->setStats(stats);
 		next();
 	}
 
@@ -53,11 +58,18 @@ public:
 		delete scanner_;
 	}
 
-	void parse();	//проводим синтаксический разбор 
+	void parse();	//проводим синтаксический разбор и печатаем программу, если ошибок нет
+	bool compile();	//проводим синтаксический разбор, не печатая программу. Возвращает false при ошибках
+
+	CodeGen& getCodeGen() //кодогенератор с результатом разбора
+	{
+		return *codegen_;
+	}
 
 private:
 	typedef pair<Type, int> Variable;
 	typedef map<string, Variable> VarTable;
+	typedef map<string, int> ArrayTable;
 	//описание блоков.
 	void program(); //Разбор программы. BEGIN statementList END
 	void statementList(); // Разбор списка операторов.
@@ -70,6 +82,12 @@ private:
 	Type term(); //разбор слагаемого.
 	Type factor(); //разбор множителя.
 	void relation(); //разбор условия.
+	void declaration(); //разбор объявления массива. TYPE identifier [ number ]
+	void index(); //разбор индекса элемента массива. [ expression ]
+	void loadElement(const string& name, int address); //разбор индекса и загрузка элемента массива
+	void storeElement(const string& name, int address); //разбор присваивания элементу массива
+	void promoteToComplex(int operandAddress); //приведение целого операнда, код которого начинается
+	//по адресу operandAddress, к комплексному типу.
 
 	// Сравнение текущей лексемы с образцом. Текущая позиция в потоке лексем не изменяется.
 	bool see(Token t)
@@ -83,7 +101,7 @@ private:
 	bool match(Token t)
 	{
 		if(scanner_->token() == t) {
-			scanner_->nextToken();
+			scan();
 			return true;
 		}
 		else {
@@ -91,13 +109,28 @@ private:
 		}
 	}
 
-	// Переход к следующей лексеме.
+	// Переход к следующей лексеме. Инструкции, порождаемые после этого, относятся
+	// к строке последней прочитанной лексемы.
 
 	void next()
 	{
-		scanner_->nextToken();
+		codegen_->setLine(scanner_->getLineNumber());
+		scan();
 	}
 
+	// Чтение следующей лексемы
+	void scan()
+	{
+		if(stats_) {
+			scanCounted();
+		}
+		else {
+			scanner_->nextToken();
+		}
+	}
+
+	void scanCounted(); //чтение лексемы с учетом времени и счетчиков лексем
+
 	// Обработчик ошибок.
 	void reportError(const string& message)
 	{
@@ -113,14 +146,18 @@ private:
 	//Если находит нужную переменную - возвращает ее номер, иначе добавляет ее в массив, увеличивает lastVar и возвращает его.
 	void findAndChangeType(const string&, Type type = TYPE_INT);//функция пробегает по variables_. 
 	//Если находит нужную переменную - изменяет ее тип.
-	Type getType(const string&); //возвращает тип переменной
+	Type getType(const string&); //возвращает тип переменной (для массива - тип элементов)
+	int getLength(const string&); //возвращает количество элементов массива (0 для простой переменной)
 	Scanner* scanner_; //лексический анализатор для конструктора
 	CodeGen* codegen_; //указатель на виртуальную машину
 	ostream& output_; //выходной поток (в данном случае используем cout)
 	bool error_; //флаг ошибки. Используется чтобы определить, выводим ли список команд после разбора или нет
 	bool recovered_; //не используется
 	VarTable variables_; //массив переменных, найденных в программе
-	int lastVar_; //номер последней записанной переменной
+	ArrayTable arrays_; //количество элементов объявленных массивов
+	int lastVar_; //адрес следующей переменной (первые TEMP_CELLS ячеек - временные)
+	CompileStats* stats_; //статистика компиляции (0, если не собирается)
+	int nestedCode_; //количество инструкций вложенных операторов разбираемого оператора
 };
 
 #endif
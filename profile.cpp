@@ -0,0 +1,271 @@
+#include "profile.h"
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+// Цикл программы: участок [begin, end], end - адрес последнего обратного перехода
+// на begin
+struct ProfileLoop
+{
+	int begin;              // адрес заголовка цикла
+	int end;                // адрес обратного перехода
+	int firstLine;          // наименьший номер строки инструкций цикла
+	int lastLine;           // наибольший номер строки инструкций цикла
+	long long executed;     // количество выполненных инструкций цикла
+};
+
+// Внешние циклы раньше вложенных
+static bool outerFirst(const ProfileLoop& a, const ProfileLoop& b)
+{
+	return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+}
+
+// Поиск циклов программы. Циклы упорядочены так, что объемлющий цикл
+// предшествует вложенным.
+static void findLoops(const vector<Command>& program, const vector<long long>& counts,
+	vector<ProfileLoop>& loops)
+{
+	map<int, int> ends;
+	for(size_t i = 0; i < program.size(); ++i) {
+		const Command& c = program[i];
+		if(isJump(c.getInstruction()) && c.getJumpTarget() <= (int) i) {
+			int& end = ends[c.getJumpTarget()];
+			end = max(end, (int) i);
+		}
+	}
+
+	loops.clear();
+	for(map<int, int>::const_iterator it = ends.begin(); it != ends.end(); ++it) {
+		ProfileLoop loop;
+		loop.begin = it->first;
+		loop.end = it->second;
+		loop.firstLine = 0;
+		loop.lastLine = 0;
+		loop.executed = 0;
+		for(int a = loop.begin; a <= loop.end; ++a) {
+			int line = program[a].getLine();
+			if(line > 0 && (loop.firstLine == 0 || line < loop.firstLine)) {
+				loop.firstLine = line;
+			}
+			loop.lastLine = max(loop.lastLine, line);
+			loop.executed += counts[a];
+		}
+		loops.push_back(loop);
+	}
+	sort(loops.begin(), loops.end(), outerFirst);
+}
+
+// Доля part от total в процентах с одним знаком после запятой
+static string share(long long part, long long total)
+{
+	long long permille = total > 0 ? part * 1000 / total : 0;
+	ostringstream os;
+	os << permille / 10 << "." << permille % 10 << "%";
+	return os.str();
+}
+
+// Сортировка пар (количество выполнений, ключ) по убыванию количества
+static bool moreExecuted(const pair<long long, int>& a, const pair<long long, int>& b)
+{
+	return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+void countOpcodes(const vector<Command>& program, const vector<long long>& counts,
+	vector<long long>& opcodes)
+{
+	opcodes.assign(INSTRUCTION_COUNT, 0);
+	for(size_t i = 0; i < program.size() && i < counts.size(); ++i) {
+		opcodes[program[i].getInstruction()] += counts[i];
+	}
+}
+
+void printProfile(ostream& os, const vector<Command>& program, const vector<long long>& counts)
+{
+	long long total = 0;
+	map<int, long long> lines;
+	for(size_t i = 0; i < program.size(); ++i) {
+		total += counts[i];
+		lines[program[i].getLine()] += counts[i];
+	}
+	os << "executed: " << total << endl;
+
+	vector<long long> opcodes;
+	countOpcodes(program, counts, opcodes);
+	vector<pair<long long, int> > order;
+	for(int op = 0; op < INSTRUCTION_COUNT; ++op) {
+		if(opcodes[op] > 0) {
+			order.push_back(make_pair(opcodes[op], op));
+		}
+	}
+	sort(order.begin(), order.end(), moreExecuted);
+	os << endl << "instruction\texecuted\tshare" << endl;
+	for(size_t k = 0; k < order.size(); ++k) {
+		os << instructionToString((Instruction) order[k].second) << "\t" << order[k].first
+			<< "\t" << share(order[k].first, total) << endl;
+	}
+
+	order.clear();
+	for(map<int, long long>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+		if(it->second > 0) {
+			order.push_back(make_pair(it->second, it->first));
+		}
+	}
+	sort(order.begin(), order.end(), moreExecuted);
+	os << endl << "line\texecuted\tshare" << endl;
+	for(size_t k = 0; k < order.size(); ++k) {
+		os << order[k].second << "\t" << order[k].first << "\t" << share(order[k].first, total) << endl;
+	}
+
+	vector<ProfileLoop> loops;
+	findLoops(program, counts, loops);
+	order.clear();
+	for(size_t k = 0; k < loops.size(); ++k) {
+		if(loops[k].executed > 0) {
+			order.push_back(make_pair(loops[k].executed, k));
+		}
+	}
+	sort(order.begin(), order.end(), moreExecuted);
+	os << endl << "loop\tlines\theader\texecuted\tshare" << endl;
+	for(size_t k = 0; k < order.size(); ++k) {
+		const ProfileLoop& loop = loops[order[k].second];
+		os << "loop@" << program[loop.begin].getLine() << "\t" << loop.firstLine << "-" << loop.lastLine
+			<< "\t" << counts[loop.begin] << "\t" << loop.executed << "\t" << share(loop.executed, total) << endl;
+	}
+
+	os << endl << "executed\tline\taddress\tinstruction" << endl;
+	for(size_t i = 0; i < program.size(); ++i) {
+		os << counts[i] << "\t" << program[i].getLine() << "\t";
+		program[i].print(i, os);
+	}
+}
+
+void printFoldedProfile(ostream& os, const string& name, const vector<Command>& program,
+	const vector<long long>& counts)
+{
+	vector<ProfileLoop> loops;
+	findLoops(program, counts, loops);
+
+	map<string, long long> stacks;
+	for(size_t i = 0; i < program.size(); ++i) {
+		if(counts[i] == 0) {
+			continue;
+		}
+		ostringstream stack;
+		stack << name;
+		for(size_t k = 0; k < loops.size(); ++k) {
+			if(loops[k].begin <= (int) i && (int) i <= loops[k].end) {
+				stack << ";loop@" << program[loops[k].begin].getLine();
+			}
+		}
+		stack << ";line@" << program[i].getLine();
+		stacks[stack.str()] += counts[i];
+	}
+
+	for(map<string, long long>::const_iterator it = stacks.begin(); it != stacks.end(); ++it) {
+		os << it->first << " " << it->second << endl;
+	}
+}
+
+void BranchProfile::collect(const vector<Command>& program, const vector<long long>& counts)
+{
+	int size = program.size();
+	vector<int> jumpsInto(size + 1, 0);
+	for(int i = 0; i < size; ++i) {
+		if(isJump(program[i].getInstruction())) {
+			++jumpsInto[program[i].getJumpTarget()];
+		}
+	}
+
+	branches_.clear();
+	total_ = 0;
+	for(int i = 0; i < size; ++i) {
+		Instruction instruction = program[i].getInstruction();
+		if(instruction != JUMP_NO && instruction != JUMP_YES && instruction != COMPARE_JUMP_NO) {
+			continue;
+		}
+
+		// Переходы по следующей инструкции, если в нее можно попасть только из i,
+		// иначе по инструкции перехода, если в нее ведет только этот переход
+		long long taken = -1;
+		int target = program[i].getJumpTarget();
+		if(i + 1 < size && jumpsInto[i + 1] == 0) {
+			taken = counts[i] - counts[i + 1];
+		}
+		else if(target < size && jumpsInto[target] == 1) {
+			Instruction before = target > 0 ? program[target - 1].getInstruction() : JUMP;
+			if(before == JUMP || before == STOP) {
+				taken = counts[target];
+			}
+			else if(!isJump(before)) {
+				taken = counts[target] - counts[target - 1];
+			}
+		}
+		if(taken < 0) {
+			continue;
+		}
+
+		BranchCounts& branch = branches_[program[i].getLine()];
+		if(instruction == JUMP_YES) {
+			branch.trueCount += taken;
+			branch.falseCount += counts[i] - taken;
+		}
+		else {
+			branch.trueCount += counts[i] - taken;
+			branch.falseCount += taken;
+		}
+		total_ += counts[i];
+	}
+}
+
+bool BranchProfile::read(istream& input)
+{
+	branches_.clear();
+	total_ = 0;
+	string word;
+	while(input >> word) {
+		if(word[0] == '#') {
+			getline(input, word);
+			continue;
+		}
+		int line;
+		BranchCounts counts;
+		if(word != "branch" || !(input >> line >> counts.trueCount >> counts.falseCount)
+			|| counts.trueCount < 0 || counts.falseCount < 0) {
+			return false;
+		}
+		branches_[line] = counts;
+		total_ += counts.trueCount + counts.falseCount;
+	}
+	return input.eof();
+}
+
+void BranchProfile::write(ostream& output) const
+{
+	output << "# cmilan branch profile: branch line true false" << endl;
+	for(map<int, BranchCounts>::const_iterator it = branches_.begin(); it != branches_.end(); ++it) {
+		output << "branch " << it->first << " " << it->second.trueCount << " " << it->second.falseCount << endl;
+	}
+}
+
+bool BranchProfile::lookup(int line, BranchCounts& counts) const
+{
+	map<int, BranchCounts>::const_iterator it = branches_.find(line);
+	if(it == branches_.end()) {
+		return false;
+	}
+	counts = it->second;
+	return true;
+}
+
+bool BranchProfile::isHot(int line) const
+{
+	BranchCounts counts;
+	return lookup(line, counts) && total_ > 0
+		&& (counts.trueCount + counts.falseCount) * 10 >= total_;
+}
+
+bool BranchProfile::isCold(int line) const
+{
+	BranchCounts counts;
+	return lookup(line, counts) && counts.trueCount == 0;
+}
@@ -0,0 +1,95 @@
+#ifndef CMILAN_PROFILE_H
+#define CMILAN_PROFILE_H
+
+#include "codegen.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Профиль выполнения программы (cmilan --run --profile).
+//
+// Машина считает, сколько раз выполнена инструкция по каждому адресу
+// (см. VirtualMachine::setInstructionCounts). Каждая инструкция помнит строку исходного
+// текста, из которой она получена (см. Command::getLine), поэтому счетчики можно
+// собрать по кодам инструкций, по строкам и по циклам. Циклом считается участок от
+// адреса обратного перехода до самого перехода; у циклов с общим заголовком участки
+// объединяются. Цикл обозначается номером строки своей первой инструкции (строкой
+// WHILE для кода, порожденного парсером).
+
+// Количество выполнений по кодам инструкций (массив размером INSTRUCTION_COUNT)
+//    const vector<Command>& program - выполненная программа
+//    const vector<long long>& counts - количество выполнений по адресам
+void countOpcodes(const vector<Command>& program, const vector<long long>& counts,
+	vector<long long>& opcodes);
+
+// Печать плоского отчета: коды инструкций, строки и циклы в порядке убывания
+// количества выполнений, затем листинг программы с количеством выполнений
+// каждой инструкции.
+void printProfile(ostream& os, const vector<Command>& program, const vector<long long>& counts);
+
+// Печать профиля в формате "свернутых стеков" (folded stacks), который принимают
+// flamegraph.pl и speedscope: строка "name;loop@5;loop@7;line@8 N" означает,
+// что инструкции строки 8, лежащие в цикле строки 7, вложенном в цикл строки 5,
+// выполнены N раз. name - корневой кадр (обычно имя файла программы).
+void printFoldedProfile(ostream& os, const string& name, const vector<Command>& program,
+	const vector<long long>& counts);
+
+// Профиль условий для оптимизации по профилю (cmilan --profile-generate=FILE,
+// cmilan --profile-use=FILE).
+//
+// Для каждого условного перехода выполненной программы сохраняется, сколько раз
+// его условие оказалось истинным и ложным. Адреса инструкций зависят от параметров
+// компиляции, поэтому условия сопоставляются по строке исходного текста: счетчики
+// всех условных переходов одной строки (например, копий условия в развернутом
+// цикле) складываются.
+//
+// Файл профиля текстовый: строка "branch L T F" для каждой строки L, где есть
+// условные переходы; T и F - количество истинных и ложных условий.
+
+// Количество истинных и ложных условий
+struct BranchCounts
+{
+	BranchCounts()
+		: trueCount(0), falseCount(0)
+	{}
+
+	long long trueCount;
+	long long falseCount;
+};
+
+class BranchProfile
+{
+public:
+	BranchProfile()
+		: total_(0)
+	{}
+
+	// Сбор профиля по счетчикам выполнения инструкций (см. VirtualMachine::setInstructionCounts).
+	// Количество переходов, выполненных условной инструкцией, вычисляется по счетчику
+	// следующей за ней инструкции или инструкции по адресу перехода; если ни то, ни
+	// другое невозможно (в обе точки ведут и другие переходы), переход не учитывается.
+	void collect(const vector<Command>& program, const vector<long long>& counts);
+
+	// Чтение и запись файла профиля. read возвращает false, если файл поврежден.
+	bool read(istream& input);
+	void write(ostream& output) const;
+
+	// Счетчики условий строки line. Возвращает false, если строки нет в профиле.
+	bool lookup(int line, BranchCounts& counts) const;
+
+	// Условие строки line проверялось не меньше чем в 1/10 всех проверок условий
+	bool isHot(int line) const;
+
+	// Условие строки line есть в профиле и ни разу не было истинным
+	// (для цикла - тело ни разу не выполнялось)
+	bool isCold(int line) const;
+
+private:
+	map<int, BranchCounts> branches_; // счетчики по строкам
+	long long total_;                 // общее количество проверок условий
+};
+
+#endif
@@ -0,0 +1,610 @@
+#include "regvm.h"
+#include "verifier.h"
+#include "vm.h"
+#include <map>
+
+static const char * registerInstructionNames_[] = {
+	"STOP",
+	"MOVE",
+	"ADD",
+	"SUB",
+	"MULT",
+	"DIV",
+	"INVERT",
+	"COMPARE",
+	"AND",
+	"OR",
+	"NOT",
+	"XOR",
+	"IMPLIES",
+	"JUMP",
+	"JUMP_YES",
+	"JUMP_NO",
+	"COMPARE_JUMP_NO",
+	"INPUT",
+	"PRINT",
+	"BLOAD",
+	"BSTORE",
+	"BLOAD_UNCHECKED",
+	"BSTORE_UNCHECKED",
+};
+
+const char * registerInstructionToString(RegisterInstruction instruction)
+{
+	return registerInstructionNames_[instruction];
+}
+
+// Печать номера регистра: константы печатаются значением
+static void printRegister(const RegisterProgram& program, int r, ostream& os)
+{
+	if(r >= program.constantBase) {
+		os << "\t#" << program.constants[r - program.constantBase];
+	}
+	else {
+		os << "\tr" << r;
+	}
+}
+
+void RegisterProgram::print(ostream& os) const
+{
+	for(size_t i = 0; i < code.size(); ++i) {
+		const RegisterCommand& c = code[i];
+		os << i << ":\t" << registerInstructionToString(c.instruction);
+		switch(c.instruction) {
+			case R_STOP:
+				break;
+
+			case R_MOVE:
+			case R_INVERT:
+			case R_NOT:
+				printRegister(*this, c.result, os);
+				printRegister(*this, c.left, os);
+				break;
+
+			case R_COMPARE:
+				printRegister(*this, c.result, os);
+				printRegister(*this, c.left, os);
+				printRegister(*this, c.right, os);
+				os << "\t" << c.arg;
+				break;
+
+			case R_JUMP:
+				os << "\t" << c.arg;
+				break;
+
+			case R_JUMP_YES:
+			case R_JUMP_NO:
+				printRegister(*this, c.left, os);
+				os << "\t" << c.arg;
+				break;
+
+			case R_COMPARE_JUMP_NO:
+				printRegister(*this, c.left, os);
+				printRegister(*this, c.right, os);
+				os << "\t" << c.result << "\t" << c.arg;
+				break;
+
+			case R_INPUT:
+				printRegister(*this, c.result, os);
+				break;
+
+			case R_PRINT:
+				printRegister(*this, c.left, os);
+				break;
+
+			case R_BLOAD:
+			case R_BLOAD_UNCHECKED:
+				printRegister(*this, c.result, os);
+				printRegister(*this, c.left, os);
+				os << "\t" << c.arg << "\t" << c.right;
+				break;
+
+			case R_BSTORE:
+			case R_BSTORE_UNCHECKED:
+				printRegister(*this, c.left, os);
+				printRegister(*this, c.right, os);
+				os << "\t" << c.arg << "\t" << c.result;
+				break;
+
+			default:
+				printRegister(*this, c.result, os);
+				printRegister(*this, c.left, os);
+				printRegister(*this, c.right, os);
+				break;
+		}
+		os << endl;
+	}
+	os.flush();
+}
+
+// Код операции регистровой машины для арифметических и логических инструкций
+static RegisterInstruction registerOperation(Instruction instruction)
+{
+	switch(instruction) {
+		case ADD:
+			return R_ADD;
+		case SUB:
+			return R_SUB;
+		case MULT:
+			return R_MULT;
+		case DIV:
+			return R_DIV;
+		case INVERT:
+			return R_INVERT;
+		case COMPARE:
+			return R_COMPARE;
+		case AND:
+			return R_AND;
+		case OR:
+			return R_OR;
+		case NOT:
+			return R_NOT;
+		case XOR:
+			return R_XOR;
+		case IMPLIES:
+			return R_IMPLIES;
+		default:
+			return R_STOP;
+	}
+}
+
+// Код противоположной операции сравнения: a cmp b ложно тогда и только тогда,
+// когда истинно a negateComparison(cmp) b.
+static int negateComparison(int cmp)
+{
+	static const int negated[] = { 1, 0, 5, 4, 3, 2 };
+	return cmp >= 0 && cmp < 6 ? negated[cmp] : cmp;
+}
+
+// Перевод стековой программы в регистровую. Стек моделируется во время перевода:
+// для каждого слова стека запоминается регистр, в котором лежит его значение.
+class RegisterTranslator
+{
+public:
+	RegisterTranslator(const vector<Command>& program, RegisterProgram& result)
+		: program_(program), result_(result), definition_(-1)
+	{}
+
+	bool translate();
+
+private:
+	// Печать сообщения об ошибке перевода. Всегда возвращает false.
+	bool fail(int address, const string& message);
+
+	// Проверка программы (см. verifier.h), вычисление глубины стека перед каждой
+	// инструкцией и поиск адресов переходов
+	bool analyze();
+
+	// Временный регистр для слова стека на глубине depth
+	int temporary(int depth) const
+	{
+		return result_.variables + depth;
+	}
+
+	// Регистр-константа со значением value
+	int constant(int value);
+
+	// Снятие слова со стека модели
+	int pop()
+	{
+		int r = stack_.back();
+		stack_.pop_back();
+		return r;
+	}
+
+	// Перенос всех слов стека модели в их временные регистры (перед переходами
+	// и на границах блоков глубина стека однозначно определяет регистры)
+	void materialize();
+
+	// Перенос во временные регистры слов стека, ссылающихся на регистры-переменные
+	// из [first, last), перед записью в них
+	void protect(int first, int last);
+
+	// Добавление инструкции, которая вычисляет значение в новый временный регистр
+	void define(RegisterInstruction instruction, int left, int right, int arg);
+
+	const vector<Command>& program_; // стековая программа
+	RegisterProgram& result_;        // регистровая программа
+	vector<int> depth_;              // глубина стека перед каждой инструкцией (-1 - недостижима)
+	vector<bool> targets_;           // признаки "на инструкцию есть переход"
+	vector<int> stack_;              // регистры слов стека модели
+	map<int, int> constants_;        // регистры-константы по значениям
+	int definition_;                 // адрес последней инструкции, вычислившей слово стека
+};
+
+bool RegisterTranslator::fail(int address, const string& message)
+{
+	cerr << "Translation error at " << address << ": " << message << endl;
+	return false;
+}
+
+bool RegisterTranslator::analyze()
+{
+	int size = program_.size();
+	targets_.assign(size, false);
+	for(int i = 0; i < size; ++i) {
+		Instruction instruction = program_[i].getInstruction();
+		if(instruction > IMPLIES) {
+			return fail(i, "superinstructions are not supported");
+		}
+		if(isJump(instruction) && program_[i].getJumpTarget() >= 0 && program_[i].getJumpTarget() < size) {
+			targets_[program_[i].getJumpTarget()] = true;
+		}
+	}
+
+	ProgramInfo info;
+	if(!verifyProgram(program_, info)) {
+		return fail(info.errorAddress, info.error);
+	}
+	depth_.swap(info.stackDepth);
+	return true;
+}
+
+int RegisterTranslator::constant(int value)
+{
+	map<int, int>::iterator it = constants_.find(value);
+	if(it != constants_.end()) {
+		return it->second;
+	}
+	int r = result_.constantBase + result_.constants.size();
+	result_.constants.push_back(value);
+	constants_[value] = r;
+	return r;
+}
+
+void RegisterTranslator::materialize()
+{
+	for(size_t d = 0; d < stack_.size(); ++d) {
+		if(stack_[d] != temporary(d)) {
+			result_.code.push_back(RegisterCommand(R_MOVE, temporary(d), stack_[d]));
+			stack_[d] = temporary(d);
+		}
+	}
+	definition_ = -1;
+}
+
+void RegisterTranslator::protect(int first, int last)
+{
+	for(size_t d = 0; d < stack_.size(); ++d) {
+		if(stack_[d] >= first && stack_[d] < last) {
+			result_.code.push_back(RegisterCommand(R_MOVE, temporary(d), stack_[d]));
+			stack_[d] = temporary(d);
+			definition_ = -1;
+		}
+	}
+}
+
+void RegisterTranslator::define(RegisterInstruction instruction, int left, int right, int arg)
+{
+	int r = temporary(stack_.size());
+	result_.code.push_back(RegisterCommand(instruction, r, left, right, arg));
+	stack_.push_back(r);
+	definition_ = result_.code.size() - 1;
+}
+
+bool RegisterTranslator::translate()
+{
+	int size = program_.size();
+	result_.code.clear();
+	result_.constants.clear();
+	result_.variables = requiredMemorySize(program_);
+	if(size == 0) {
+		result_.constantBase = result_.variables;
+		return true;
+	}
+	if(!analyze()) {
+		return false;
+	}
+
+	int temporaries = 0;
+	for(int i = 0; i < size; ++i) {
+		int pushes = instructionPushes(program_[i].getInstruction());
+		if(depth_[i] >= 0 && depth_[i] + pushes > temporaries) {
+			temporaries = depth_[i] + pushes;
+		}
+	}
+	result_.constantBase = result_.variables + temporaries;
+
+	vector<int> newAddress(size, 0);
+	bool reachable = false;
+	for(int i = 0; i < size; ++i) {
+		if(depth_[i] < 0) {
+			newAddress[i] = result_.code.size();
+			reachable = false;
+			continue;
+		}
+		if(targets_[i] || !reachable) {
+			// начало блока: слова стека лежат в своих временных регистрах
+			if(reachable) {
+				materialize();
+			}
+			stack_.clear();
+			for(int d = 0; d < depth_[i]; ++d) {
+				stack_.push_back(temporary(d));
+			}
+			definition_ = -1;
+		}
+		reachable = true;
+		newAddress[i] = result_.code.size();
+
+		const Command& c = program_[i];
+		Instruction instruction = c.getInstruction();
+		int left, right;
+		switch(instruction) {
+			case NOP:
+				break;
+
+			case STOP:
+				result_.code.push_back(RegisterCommand(R_STOP));
+				reachable = false;
+				break;
+
+			case LOAD:
+				stack_.push_back(c.getArg());
+				definition_ = -1;
+				break;
+
+			case PUSH:
+				stack_.push_back(constant(c.getArg()));
+				definition_ = -1;
+				break;
+
+			case STORE:
+				right = pop();
+				protect(c.getArg(), c.getArg() + 1);
+				if(right == temporary(stack_.size()) && definition_ == (int) result_.code.size() - 1) {
+					result_.code.back().result = c.getArg();
+				}
+				else if(right != c.getArg()) {
+					result_.code.push_back(RegisterCommand(R_MOVE, c.getArg(), right));
+				}
+				definition_ = -1;
+				break;
+
+			case BLOAD:
+			case BLOAD_UNCHECKED:
+				left = pop();
+				define(instruction == BLOAD ? R_BLOAD : R_BLOAD_UNCHECKED, left, c.getArg2(), c.getArg());
+				break;
+
+			case BSTORE:
+			case BSTORE_UNCHECKED:
+				left = pop();
+				right = pop();
+				protect(c.getArg(), c.getArg() + c.getArg2());
+				result_.code.push_back(RegisterCommand(instruction == BSTORE ? R_BSTORE : R_BSTORE_UNCHECKED,
+					c.getArg2(), left, right, c.getArg()));
+				definition_ = -1;
+				break;
+
+			case POP:
+				pop();
+				definition_ = -1;
+				break;
+
+			case DUP:
+				stack_.push_back(stack_.back());
+				definition_ = -1;
+				break;
+
+			case INVERT:
+			case NOT:
+				left = pop();
+				define(registerOperation(instruction), left, 0, 0);
+				break;
+
+			case JUMP:
+				materialize();
+				result_.code.push_back(RegisterCommand(R_JUMP, 0, 0, 0, c.getArg()));
+				reachable = false;
+				break;
+
+			case JUMP_YES:
+			case JUMP_NO:
+				left = pop();
+				if(left == temporary(stack_.size()) && definition_ == (int) result_.code.size() - 1
+					&& result_.code.back().instruction == R_COMPARE) {
+					// сравнение и переход по его результату - одна инструкция
+					RegisterCommand& compare = result_.code.back();
+					int cmp = instruction == JUMP_NO ? compare.arg : negateComparison(compare.arg);
+					int a = compare.left;
+					int b = compare.right;
+					result_.code.pop_back();
+					materialize();
+					result_.code.push_back(RegisterCommand(R_COMPARE_JUMP_NO, cmp, a, b, c.getArg()));
+				}
+				else {
+					materialize();
+					result_.code.push_back(RegisterCommand(instruction == JUMP_NO ? R_JUMP_NO : R_JUMP_YES,
+						0, left, 0, c.getArg()));
+				}
+				break;
+
+			case INPUT:
+				define(R_INPUT, 0, 0, 0);
+				break;
+
+			case PRINT:
+				left = pop();
+				result_.code.push_back(RegisterCommand(R_PRINT, 0, left));
+				definition_ = -1;
+				break;
+
+			default:
+				right = pop();
+				left = pop();
+				define(registerOperation(instruction), left, right, c.getArg());
+				break;
+		}
+	}
+
+	// Пересчет адресов переходов
+	for(size_t i = 0; i < result_.code.size(); ++i) {
+		RegisterCommand& c = result_.code[i];
+		if(c.instruction == R_JUMP || c.instruction == R_JUMP_YES || c.instruction == R_JUMP_NO
+			|| c.instruction == R_COMPARE_JUMP_NO) {
+			c.arg = newAddress[c.arg];
+		}
+	}
+	return true;
+}
+
+bool translateToRegisters(const vector<Command>& program, RegisterProgram& result)
+{
+	RegisterTranslator translator(program, result);
+	return translator.translate();
+}
+
+RegisterMachine::RegisterMachine(const RegisterProgram& program, istream& input, ostream& output)
+	: program_(program), reader_(input), writer_(output), executed_(0)
+{
+}
+
+bool RegisterMachine::fail(int address, const string& message)
+{
+	writer_.flush();
+	cerr << "Runtime error at " << address << ": " << message << endl;
+	return false;
+}
+
+bool RegisterMachine::run()
+{
+	const vector<RegisterCommand>& code = program_.code;
+	int size = code.size();
+	registers_.assign(program_.registers(), 0);
+	for(size_t k = 0; k < program_.constants.size(); ++k) {
+		registers_[program_.constantBase + k] = program_.constants[k];
+	}
+	int* r = registers_.empty() ? 0 : &registers_[0];
+	executed_ = 0;
+
+	int pc = 0;
+	while(true) {
+		if(pc < 0 || pc >= size) {
+			return fail(pc, "jump out of program");
+		}
+
+		const RegisterCommand& c = code[pc];
+		++executed_;
+
+		int next = pc + 1;
+		int index;
+		switch(c.instruction) {
+			case R_STOP:
+				writer_.flush();
+				return true;
+
+			case R_MOVE:
+				r[c.result] = r[c.left];
+				break;
+
+			case R_ADD:
+				r[c.result] = addValues(r[c.left], r[c.right]);
+				break;
+
+			case R_SUB:
+				r[c.result] = subtractValues(r[c.left], r[c.right]);
+				break;
+
+			case R_MULT:
+				r[c.result] = multiplyValues(r[c.left], r[c.right]);
+				break;
+
+			case R_DIV:
+				if(r[c.right] == 0) {
+					return fail(pc, "division by zero");
+				}
+				r[c.result] = divideValues(r[c.left], r[c.right]);
+				break;
+
+			case R_INVERT:
+				r[c.result] = negateValue(r[c.left]);
+				break;
+
+			case R_COMPARE:
+				r[c.result] = compareValues(c.arg, r[c.left], r[c.right]);
+				break;
+
+			case R_AND:
+				r[c.result] = (r[c.left] != 0 && r[c.right] != 0);
+				break;
+
+			case R_OR:
+				r[c.result] = (r[c.left] != 0 || r[c.right] != 0);
+				break;
+
+			case R_NOT:
+				r[c.result] = (r[c.left] == 0);
+				break;
+
+			case R_XOR:
+				r[c.result] = ((r[c.left] != 0) != (r[c.right] != 0));
+				break;
+
+			case R_IMPLIES:
+				r[c.result] = (r[c.left] == 0 || r[c.right] != 0);
+				break;
+
+			case R_JUMP:
+				next = c.arg;
+				break;
+
+			case R_JUMP_YES:
+				if(r[c.left] != 0) {
+					next = c.arg;
+				}
+				break;
+
+			case R_JUMP_NO:
+				if(r[c.left] == 0) {
+					next = c.arg;
+				}
+				break;
+
+			case R_COMPARE_JUMP_NO:
+				if(!compareValues(c.result, r[c.left], r[c.right])) {
+					next = c.arg;
+				}
+				break;
+
+			case R_INPUT:
+				if(!reader_.read(r[c.result])) {
+					return fail(pc, "integer input expected");
+				}
+				break;
+
+			case R_PRINT:
+				writer_.write(r[c.left]);
+				break;
+
+			case R_BLOAD:
+				index = r[c.left];
+				if((unsigned) index >= (unsigned) c.right) {
+					return fail(pc, "array index out of range");
+				}
+				r[c.result] = r[c.arg + index];
+				break;
+
+			case R_BSTORE:
+				index = r[c.left];
+				if((unsigned) index >= (unsigned) c.result) {
+					return fail(pc, "array index out of range");
+				}
+				r[c.arg + index] = r[c.right];
+				break;
+
+			case R_BLOAD_UNCHECKED:
+				r[c.result] = r[c.arg + r[c.left]];
+				break;
+
+			case R_BSTORE_UNCHECKED:
+				r[c.arg + r[c.left]] = r[c.right];
+				break;
+
+			default:
+				return fail(pc, "illegal instruction");
+		}
+
+		pc = next;
+	}
+}
@@ -0,0 +1,160 @@
+#ifndef CMILAN_REGVM_H
+#define CMILAN_REGVM_H
+
+#include "codegen.h"
+#include "intio.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Регистровая виртуальная машина Милана (cmilan --target=reg).
+//
+// Программа для стековой машины переводится в трехадресный код: каждая инструкция
+// сама указывает регистры операндов и регистр результата, поэтому чтения переменных и
+// констант не требуют отдельных диспетчеризаций. Регистры распределяются так:
+//    [0, variables)                 - ячейки памяти данных стековой программы;
+//    [variables, variables + temps) - временные регистры: слову стека на глубине d
+//                                     соответствует регистр variables + d;
+//    [constantBase, registers)      - константы программы, загружаемые перед запуском.
+//
+// Глубина стека в каждой точке стековой программы должна быть известна во время
+// перевода (так устроен код, порождаемый парсером), поэтому стек машине не нужен.
+
+// Инструкции регистровой машины. В комментариях d - регистр результата, a и b - регистры
+// операндов, cmp - код операции сравнения (см. COMPARE), addr - адрес перехода.
+enum RegisterInstruction
+{
+	R_STOP,				// остановка машины
+	R_MOVE,				// R_MOVE d a - d := a
+	R_ADD,				// R_ADD d a b - d := a + b
+	R_SUB,				// R_SUB d a b - d := a - b
+	R_MULT,				// R_MULT d a b - d := a * b
+	R_DIV,				// R_DIV d a b - d := a / b
+	R_INVERT,			// R_INVERT d a - d := -a
+	R_COMPARE,			// R_COMPARE d a b cmp - d := a cmp b
+	R_AND,				// R_AND d a b - логическое "и"
+	R_OR,				// R_OR d a b - логическое "или"
+	R_NOT,				// R_NOT d a - логическое отрицание
+	R_XOR,				// R_XOR d a b - исключающее "или"
+	R_IMPLIES,			// R_IMPLIES d a b - импликация a -> b
+	R_JUMP,				// R_JUMP addr - безусловный переход
+	R_JUMP_YES,			// R_JUMP_YES a addr - переход, если a не 0
+	R_JUMP_NO,			// R_JUMP_NO a addr - переход, если a равно 0
+	R_COMPARE_JUMP_NO,	// R_COMPARE_JUMP_NO a b cmp addr - переход, если условие a cmp b ложно
+	R_INPUT,			// R_INPUT d - чтение целого числа в d
+	R_PRINT,			// R_PRINT a - печать a
+	R_BLOAD,			// R_BLOAD d a addr n - d := элемент a массива из n ячеек по адресу addr
+	R_BSTORE,			// R_BSTORE a b addr n - элемент a массива из n ячеек по адресу addr := b
+	R_BLOAD_UNCHECKED,	// R_BLOAD_UNCHECKED d a addr n - R_BLOAD без проверки индекса
+	R_BSTORE_UNCHECKED,	// R_BSTORE_UNCHECKED a b addr n - R_BSTORE без проверки индекса
+
+	REGISTER_INSTRUCTION_COUNT	// количество инструкций (сама инструкцией не является)
+};
+
+// Мнемоника инструкции регистровой машины
+const char * registerInstructionToString(RegisterInstruction instruction);
+
+// Инструкция регистровой машины
+struct RegisterCommand
+{
+	RegisterCommand(RegisterInstruction i, int d = 0, int a = 0, int b = 0, int n = 0)
+		: instruction(i), result(d), left(a), right(b), arg(n)
+	{}
+
+	RegisterInstruction instruction; // код инструкции
+	int result;                      // регистр результата (код сравнения для R_COMPARE_JUMP_NO,
+	                                 // размер массива для R_BSTORE)
+	int left;                        // регистр первого операнда
+	int right;                       // регистр второго операнда (размер массива для R_BLOAD)
+	int arg;                         // код сравнения или адрес (для переходов, R_BLOAD и R_BSTORE)
+};
+
+// Программа для регистровой машины
+struct RegisterProgram
+{
+	vector<RegisterCommand> code;   // инструкции
+	int variables;                  // количество регистров-ячеек памяти данных
+	int constantBase;               // номер первого регистра-константы
+	vector<int> constants;          // значения регистров-констант
+
+	// Общее количество регистров
+	int registers() const
+	{
+		return constantBase + constants.size();
+	}
+
+	// Печать программы в текстовом виде. Регистры-константы печатаются как #n.
+	void print(ostream& os) const;
+};
+
+// Перевод программы стековой машины в программу регистровой машины.
+//    const vector<Command>& program - программа из обычных инструкций (без суперинструкций)
+//    RegisterProgram& result - результат перевода
+//
+// Временные значения, которые стековая программа только кладет в стек и сразу
+// использует, в регистровой программе не копируются: операндом инструкции становится
+// сам регистр переменной или константы, а результат последней операции перед записью
+// в переменную пишется прямо в ее регистр. Сравнение с последующим JUMP_NO или
+// JUMP_YES заменяется инструкцией R_COMPARE_JUMP_NO.
+// Программа должна проходить проверку verifyProgram (см. verifier.h). При ошибке
+// (суперинструкции, программа не прошла проверку) печатает сообщение и возвращает false.
+bool translateToRegisters(const vector<Command>& program, RegisterProgram& result);
+
+class RegisterMachine
+{
+public:
+	// Конструктор
+	//    const RegisterProgram& program - выполняемая программа
+	//    istream& input - поток, из которого читает инструкция R_INPUT
+	//    ostream& output - поток, в который печатает инструкция R_PRINT
+	RegisterMachine(const RegisterProgram& program, istream& input, ostream& output);
+
+	// Выполнение программы до инструкции R_STOP. Возвращает false при ошибке выполнения.
+	bool run();
+
+	// Двоичный ввод и вывод (см. VirtualMachine::setBinaryIO)
+	void setBinaryIO(bool binary)
+	{
+		reader_.setBinary(binary);
+		writer_.setBinary(binary);
+	}
+
+	// Интерактивный режим (см. VirtualMachine::setInteractive)
+	void setInteractive(bool interactive)
+	{
+		reader_.setInteractive(interactive);
+		writer_.setInteractive(interactive);
+	}
+
+	// Воспроизведение журнала ввода (см. VirtualMachine::setInputReplay)
+	void setInputReplay(const int* values, size_t count)
+	{
+		reader_.setReplay(values, count);
+	}
+
+	// Запись журнала ввода (см. VirtualMachine::setInputRecording)
+	void setInputRecording(IntegerWriter* recording)
+	{
+		reader_.setRecording(recording);
+	}
+
+	// Количество выполненных инструкций (диспетчеризаций) за последний запуск
+	long long getExecutedCount() const
+	{
+		return executed_;
+	}
+
+private:
+	// Печать сообщения об ошибке выполнения. Всегда возвращает false.
+	bool fail(int address, const string& message);
+
+	const RegisterProgram& program_; // выполняемая программа
+	IntegerReader reader_;           // ввод чисел (из потока ввода)
+	IntegerWriter writer_;           // вывод чисел (в поток вывода)
+	vector<int> registers_;          // регистры машины
+	long long executed_;             // количество выполненных инструкций
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "runner.h"
+#include "vm.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+bool readRecords(istream& input, vector<vector<int> >& records)
+{
+	records.clear();
+
+	// Остаток файла в байтах; у канала его не узнать, и количество не проверяется
+	streampos start = input.tellg();
+	bool sized = start != streampos(-1) && input.seekg(0, ios::end);
+	long long remaining = sized ? (long long) (input.tellg() - start) : 0;
+	input.clear();
+	if(sized) {
+		input.seekg(start);
+	}
+
+	int count;
+	while(input.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+		remaining -= sizeof(count) + (long long) count * sizeof(int);
+		if(count < 0 || (sized && remaining < 0)) {
+			return false;
+		}
+
+		// Значения читаются частями, так что память выделяется только под то,
+		// что действительно есть в потоке
+		records.push_back(vector<int>());
+		vector<int>& values = records.back();
+		while((int) values.size() < count) {
+			size_t begin = values.size();
+			values.resize(begin + min(count - begin, (size_t) 65536));
+			if(!input.read(reinterpret_cast<char*>(&values[begin]), (values.size() - begin) * sizeof(int))) {
+				return false;
+			}
+		}
+	}
+	return input.gcount() == 0;
+}
+
+// Диапазон записей [begin, end) потока, упакованный в одно 64-битное слово
+static unsigned long long packRange(unsigned begin, unsigned end)
+{
+	return ((unsigned long long) begin << 32) | end;
+}
+
+static unsigned rangeBegin(unsigned long long range)
+{
+	return (unsigned) (range >> 32);
+}
+
+static unsigned rangeEnd(unsigned long long range)
+{
+	return (unsigned) range;
+}
+
+// Общие данные потоков
+struct RecordQueue
+{
+	RecordQueue(const vector<Command>& p, const vector<vector<int> >& r, int threads)
+		: program(p), records(r), ranges(threads), outputs(r.size()), errors(r.size()), done(r.size())
+	{}
+
+	const vector<Command>& program;                  // выполняемая программа
+	const vector<vector<int> >& records;             // входные записи
+	vector<atomic<unsigned long long> > ranges;      // диапазоны записей потоков
+	vector<string> outputs;                          // результаты записей
+	vector<string> errors;                           // ошибки выполнения записей
+	vector<bool> done;                               // признаки готовности результатов
+	mutex lock;                                      // защищает done
+	condition_variable ready;                        // сигнал о готовности результата
+};
+
+// Взятие следующей записи из собственного диапазона потока. Возвращает -1, если диапазон пуст.
+static int takeRecord(atomic<unsigned long long>& range)
+{
+	unsigned long long current = range.load();
+	while(rangeBegin(current) < rangeEnd(current)) {
+		if(range.compare_exchange_weak(current, packRange(rangeBegin(current) + 1, rangeEnd(current)))) {
+			return rangeBegin(current);
+		}
+	}
+	return -1;
+}
+
+// Перенос в диапазон потока self половины диапазона другого потока.
+// Возвращает false, если все диапазоны пусты.
+static bool stealRecords(RecordQueue& queue, int self)
+{
+	int threads = queue.ranges.size();
+	for(int k = 1; k < threads; ++k) {
+		atomic<unsigned long long>& victim = queue.ranges[(self + k) % threads];
+		unsigned long long current = victim.load();
+		while(rangeBegin(current) < rangeEnd(current)) {
+			unsigned begin = rangeBegin(current);
+			unsigned end = rangeEnd(current);
+			unsigned half = (end - begin + 1) / 2;
+			if(victim.compare_exchange_weak(current, packRange(begin, end - half))) {
+				queue.ranges[self].store(packRange(end - half, end));
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Поток выполнения записей
+static void runWorker(RecordQueue& queue, int self)
+{
+	// Значения записи передаются машине напрямую (см. VirtualMachine::setInputReplay);
+	// пустой поток ввода читается только для пустой записи
+	istringstream input;
+	ostringstream output;
+	ostringstream errors;
+	VirtualMachine vm(queue.program, input, output);
+	vm.setErrorOutput(errors);
+
+	while(true) {
+		int record = takeRecord(queue.ranges[self]);
+		if(record < 0) {
+			if(!stealRecords(queue, self)) {
+				return;
+			}
+			continue;
+		}
+
+		const vector<int>& r = queue.records[record];
+		vm.setInputReplay(r.data(), r.size());
+		output.str("");
+		errors.str("");
+
+		vm.run();
+		queue.outputs[record] = output.str();
+		queue.errors[record] = errors.str();
+		{
+			lock_guard<mutex> guard(queue.lock);
+			queue.done[record] = true;
+		}
+		queue.ready.notify_one();
+	}
+}
+
+bool runRecords(const vector<Command>& program, const vector<vector<int> >& records,
+	int threads, ostream& output)
+{
+	int count = records.size();
+	if(threads <= 0) {
+		threads = thread::hardware_concurrency();
+	}
+	if(threads > count) {
+		threads = count;
+	}
+	if(threads <= 0) {
+		threads = 1;
+	}
+
+	RecordQueue queue(program, records, threads);
+	for(int t = 0; t < threads; ++t) {
+		queue.ranges[t].store(packRange((long long) count * t / threads, (long long) count * (t + 1) / threads));
+	}
+
+	vector<thread> workers;
+	for(int t = 0; t < threads; ++t) {
+		workers.push_back(thread(runWorker, ref(queue), t));
+	}
+
+	// Печать результатов по порядку записей
+	bool ok = true;
+	for(int i = 0; i < count; ++i) {
+		{
+			unique_lock<mutex> guard(queue.lock);
+			while(!queue.done[i]) {
+				queue.ready.wait(guard);
+			}
+		}
+		output << queue.outputs[i] << '\n';
+		if(!queue.errors[i].empty()) {
+			cerr << "Record " << i << ": " << queue.errors[i];
+			ok = false;
+		}
+		string().swap(queue.outputs[i]);
+	}
+	output.flush();
+
+	for(int t = 0; t < threads; ++t) {
+		workers[t].join();
+	}
+	return ok;
+}
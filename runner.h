@@ -0,0 +1,38 @@
+#ifndef CMILAN_RUNNER_H
+#define CMILAN_RUNNER_H
+
+#include "codegen.h"
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Многопоточное выполнение программы для набора входных записей
+// (cmilan --run --inputs records.bin -j N).
+//
+// Программа компилируется один раз, после чего каждая запись (набор значений, которые
+// читает INPUT) выполняется отдельным запуском машины. Записи распределяются между
+// потоками по диапазонам; поток, закончивший свой диапазон, забирает половину
+// оставшегося диапазона у другого потока (work stealing). Диапазоны хранятся в одном
+// атомарном слове (начало и конец), поэтому владелец и "воры" обходятся без блокировок.
+// У каждого потока своя машина со своим стеком и памятью, переиспользуемыми между записями.
+//
+// Результат каждой записи накапливается в собственном буфере; главный поток печатает
+// буферы строго в порядке записей по мере их готовности, без общей блокировки вывода.
+// Готовности очередной записи главный поток ждет на условной переменной.
+// После результата каждой записи печатается пустая строка; ошибки выполнения печатаются
+// в cerr с номером записи.
+//
+// Файл записей двоичный: для каждой записи 32-битное количество значений n и затем
+// n 32-битных значений (порядок байтов машины, на которой запускается cmilan).
+
+// Чтение файла записей. Возвращает false, если файл обрывается посреди записи
+// или количество значений записи больше, чем значений осталось в файле.
+bool readRecords(istream& input, vector<vector<int> >& records);
+
+// Выполнение программы для всех записей в threads потоках (0 - по числу процессоров).
+// Возвращает false, если хотя бы одна запись завершилась ошибкой.
+bool runRecords(const vector<Command>& program, const vector<vector<int> >& records,
+	int threads, ostream& output);
+
+#endif
@@ -35,6 +35,8 @@ static const char * tokenNames_[] = {
 	"&",
 	"|",
 	"'->' or '^'",
+	"'['",
+	"']'",
 };
 
 void Scanner::nextToken()
@@ -157,6 +159,15 @@ void Scanner::nextToken()
 				token_ = T_RPAREN;
 				nextChar();
 				break;
+			//Квадратные скобки окружают индекс элемента массива
+			case '[':
+				token_ = T_LBRACKET;
+				nextChar();
+				break;
+			case ']':
+				token_ = T_RBRACKET;
+				nextChar();
+				break;
 			//Признак лексемы ";" - встретили ";"
 			case ';':
 				token_ = T_SEMICOLON;
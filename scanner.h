@@ -43,7 +43,9 @@ enum Token {
 	T_UNAR,			//Унарная логическая операция
 	T_LOGICAND,		//Логическое и "&"
 	T_LOGICOR,		//Логическе или "|"
-	T_LOGIC			//Сводная лексема для "->" и "^" (логическая операция наименьшего приоритета)
+	T_LOGIC,		//Сводная лексема для "->" и "^" (логическая операция наименьшего приоритета)
+	T_LBRACKET,		//Открывающая квадратная скобка
+	T_RBRACKET		//Закрывающая квадратная скобка
 };
 
 // Функция tokenToString возвращает описание лексемы.
@@ -0,0 +1,150 @@
+#include "scheduler.h"
+
+Scheduler::Context::Context(const vector<Command>& program)
+	: vm(program, input, output), closed(false), parked(false)
+{
+	vm.setInputQueue(&queue);
+	vm.setErrorOutput(errors);
+	vm.reset();
+}
+
+Scheduler::Scheduler(const vector<Command>& program, int threads, long long budget)
+	: program_(program), threads_(threads > 0 ? threads : thread::hardware_concurrency()),
+	  budget_(budget), finished_(0), stopping_(false), preemptions_(0), parks_(0)
+{
+	if(threads_ <= 0) {
+		threads_ = 1;
+	}
+}
+
+Scheduler::~Scheduler()
+{
+	for(size_t i = 0; i < contexts_.size(); ++i) {
+		delete contexts_[i];
+	}
+}
+
+int Scheduler::spawn()
+{
+	contexts_.push_back(new Context(program_));
+	int context = contexts_.size() - 1;
+	ready_.push_back(context);
+	return context;
+}
+
+void Scheduler::start()
+{
+	for(int t = 0; t < threads_; ++t) {
+		workers_.push_back(thread(&Scheduler::work, this));
+	}
+}
+
+void Scheduler::makeReady(int context)
+{
+	lock_guard<mutex> guard(lock_);
+	ready_.push_back(context);
+	changed_.notify_one();
+}
+
+void Scheduler::provideInput(int context, int value)
+{
+	Context& c = *contexts_[context];
+	bool wake;
+	{
+		lock_guard<mutex> guard(c.lock);
+		c.inbox.push_back(value);
+		wake = c.parked;
+		c.parked = false;
+	}
+	if(wake) {
+		makeReady(context);
+	}
+}
+
+void Scheduler::closeInput(int context)
+{
+	Context& c = *contexts_[context];
+	bool wake;
+	{
+		lock_guard<mutex> guard(c.lock);
+		c.closed = true;
+		wake = c.parked;
+		c.parked = false;
+	}
+	if(wake) {
+		makeReady(context);
+	}
+}
+
+void Scheduler::work()
+{
+	while(true) {
+		int context;
+		{
+			unique_lock<mutex> guard(lock_);
+			while(ready_.empty() && !stopping_) {
+				changed_.wait(guard);
+			}
+			if(ready_.empty()) {
+				return;
+			}
+			context = ready_.front();
+			ready_.pop_front();
+		}
+
+		// Передача машине пришедших значений
+		Context& c = *contexts_[context];
+		{
+			lock_guard<mutex> guard(c.lock);
+			c.queue.insert(c.queue.end(), c.inbox.begin(), c.inbox.end());
+			c.inbox.clear();
+			if(c.closed) {
+				c.vm.closeInput();
+			}
+		}
+
+		RunStatus status = c.vm.resume(budget_);
+		if(status == RUN_PREEMPTED) {
+			lock_guard<mutex> guard(lock_);
+			++preemptions_;
+			ready_.push_back(context);
+			changed_.notify_one();
+		}
+		else if(status == RUN_WAITING_INPUT) {
+			// Данные могли прийти, пока контекст выполнялся: тогда он сразу готов
+			bool again;
+			{
+				lock_guard<mutex> guard(c.lock);
+				again = !c.inbox.empty() || c.closed;
+				c.parked = !again;
+			}
+			lock_guard<mutex> guard(lock_);
+			++parks_;
+			if(again) {
+				ready_.push_back(context);
+				changed_.notify_one();
+			}
+		}
+		else {
+			lock_guard<mutex> guard(lock_);
+			++finished_;
+			changed_.notify_all();
+		}
+	}
+}
+
+void Scheduler::wait()
+{
+	{
+		unique_lock<mutex> guard(lock_);
+		while(finished_ < (int) contexts_.size()) {
+			changed_.wait(guard);
+		}
+		stopping_ = true;
+		changed_.notify_all();
+	}
+	for(size_t t = 0; t < workers_.size(); ++t) {
+		workers_[t].join();
+	}
+	workers_.clear();
+}
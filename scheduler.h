@@ -0,0 +1,115 @@
+#ifndef CMILAN_SCHEDULER_H
+#define CMILAN_SCHEDULER_H
+
+#include "codegen.h"
+#include "vm.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Кооперативный планировщик (cmilan --inputs FILE --cooperative).
+//
+// Много контекстов выполнения одной программы (у каждого своя машина со стеком,
+// памятью и очередью ввода) выполняются небольшим пулом потоков. Поток берет контекст
+// из общей очереди готовых и выполняет его, пока не будет исчерпан бюджет инструкций
+// (машина останавливается на ближайшем обратном переходе, см. VirtualMachine::resume),
+// после чего контекст возвращается в конец очереди. Контекст, которому нужен ввод,
+// а очередь ввода пуста, "паркуется" и не занимает поток, пока для него не придут
+// данные (provideInput) или ввод не будет закрыт (closeInput).
+
+class Scheduler
+{
+public:
+	// Конструктор
+	//    const vector<Command>& program - выполняемая программа
+	//    int threads - количество потоков (0 - по числу процессоров)
+	//    long long budget - бюджет инструкций на одно выполнение контекста
+	Scheduler(const vector<Command>& program, int threads, long long budget);
+
+	~Scheduler();
+
+	// Создание контекста. Контексты создаются до вызова start.
+	// Возвращает номер контекста.
+	int spawn();
+
+	// Запуск потоков
+	void start();
+
+	// Передача значения в очередь ввода контекста. Припаркованный контекст
+	// снова становится готовым к выполнению.
+	void provideInput(int context, int value);
+
+	// Закрытие ввода контекста: чтение из пустой очереди станет ошибкой выполнения
+	void closeInput(int context);
+
+	// Ожидание завершения всех контекстов и остановка потоков
+	void wait();
+
+	// Значения, напечатанные контекстом
+	string getOutput(int context) const
+	{
+		return contexts_[context]->output.str();
+	}
+
+	// Сообщения об ошибках выполнения контекста
+	string getErrors(int context) const
+	{
+		return contexts_[context]->errors.str();
+	}
+
+	// Количество вытеснений по исчерпанию бюджета
+	long long getPreemptions() const
+	{
+		return preemptions_;
+	}
+
+	// Количество остановок в ожидании ввода
+	long long getParks() const
+	{
+		return parks_;
+	}
+
+private:
+	// Контекст выполнения
+	struct Context
+	{
+		explicit Context(const vector<Command>& program);
+
+		istringstream input;        // не используется: ввод берется из очереди
+		ostringstream output;       // напечатанные значения
+		ostringstream errors;       // сообщения об ошибках
+		VirtualMachine vm;          // машина контекста
+		deque<int> queue;           // очередь ввода машины (доступна только выполняющему потоку)
+		mutex lock;                 // защищает поля ниже
+		deque<int> inbox;           // пришедшие, но еще не переданные машине значения
+		bool closed;                // ввод закрыт
+		bool parked;                // контекст ждет ввода
+	};
+
+	// Цикл потока пула
+	void work();
+
+	// Постановка контекста в очередь готовых
+	void makeReady(int context);
+
+	const vector<Command>& program_; // выполняемая программа
+	int threads_;                    // количество потоков
+	long long budget_;               // бюджет инструкций
+	vector<Context*> contexts_;      // контексты
+	vector<thread> workers_;         // потоки пула
+	mutex lock_;                     // защищает поля ниже
+	condition_variable changed_;     // сигнал об изменении очереди или завершении контекста
+	deque<int> ready_;               // очередь готовых контекстов
+	int finished_;                   // количество завершенных контекстов
+	bool stopping_;                  // потоки должны завершиться
+	long long preemptions_;          // количество вытеснений
+	long long parks_;                // количество остановок в ожидании ввода
+};
+
+#endif
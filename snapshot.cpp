@@ -0,0 +1,111 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Заголовок файла снимка
+struct SnapshotHeader
+{
+	char magic[4];                // "CMVS"
+	unsigned version;             // версия формата
+	unsigned long long checksum;  // контрольная сумма программы
+	long long inputPosition;      // количество прочитанных значений ввода
+	long long executed;           // количество выполненных инструкций
+	int pc;                       // адрес следующей инструкции
+	int stackDepth;               // глубина стека
+	int memorySize;               // размер памяти данных
+	int reserved;                 // выравнивание
+};
+
+static const char snapshotMagic[4] = { 'C', 'M', 'V', 'S' };
+static const unsigned snapshotVersion = 1;
+
+// Контрольная сумма программы (FNV-1a по кодам инструкций и аргументам)
+static unsigned long long programChecksum(const vector<Command>& program)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < program.size(); ++i) {
+		const Command& c = program[i];
+		int words[4] = { c.getInstruction(), c.getArg(), c.getArg2(), c.getArg3() };
+		for(int k = 0; k < 4; ++k) {
+			hash = (hash ^ (unsigned) words[k]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+bool saveSnapshot(const string& file, const vector<Command>& program, const VirtualMachine& vm)
+{
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+	header.version = snapshotVersion;
+	header.checksum = programChecksum(program);
+	header.inputPosition = vm.getInputPosition();
+	header.executed = vm.getExecutedCount();
+	header.pc = vm.getProgramCounter();
+	header.stackDepth = vm.getStackDepth();
+	header.memorySize = vm.getMemory().size();
+
+	string temporary = file + ".tmp";
+	ofstream output(temporary.c_str(), ios::binary | ios::trunc);
+	output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	output.write(reinterpret_cast<const char*>(vm.getStack()), header.stackDepth * sizeof(int));
+	if(header.memorySize > 0) {
+		output.write(reinterpret_cast<const char*>(&vm.getMemory()[0]), header.memorySize * sizeof(int));
+	}
+	output.close();
+	if(!output || rename(temporary.c_str(), file.c_str()) != 0) {
+		cerr << "Cannot write snapshot '" << file << "'" << endl;
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool loadSnapshot(const string& file, const vector<Command>& program, VirtualMachine& vm)
+{
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0) {
+		cerr << "File '" << file << "' not found" << endl;
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SnapshotHeader)) {
+		close(fd);
+		cerr << "File '" << file << "' is not a valid snapshot" << endl;
+		return false;
+	}
+	size_t size = st.st_size;
+	void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		cerr << "Cannot map snapshot '" << file << "'" << endl;
+		return false;
+	}
+
+	const SnapshotHeader* header = static_cast<const SnapshotHeader*>(data);
+	const int* stack = reinterpret_cast<const int*>(header + 1);
+	bool ok = memcmp(header->magic, snapshotMagic, sizeof(header->magic)) == 0
+		&& header->version == snapshotVersion
+		&& header->stackDepth >= 0 && header->memorySize >= 0
+		&& size == sizeof(SnapshotHeader) + ((size_t) header->stackDepth + header->memorySize) * sizeof(int);
+	if(!ok) {
+		cerr << "File '" << file << "' is not a valid snapshot" << endl;
+	}
+	else if(header->checksum != programChecksum(program)) {
+		cerr << "Snapshot '" << file << "' was taken from a different program" << endl;
+		ok = false;
+	}
+	else if(!vm.restore(header->pc, stack, header->stackDepth, stack + header->stackDepth,
+		header->memorySize, header->inputPosition, header->executed)) {
+		cerr << "Snapshot '" << file << "' does not match the program or its input" << endl;
+		ok = false;
+	}
+	munmap(data, size);
+	return ok;
+}
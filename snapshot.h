@@ -0,0 +1,36 @@
+#ifndef CMILAN_SNAPSHOT_H
+#define CMILAN_SNAPSHOT_H
+
+#include "codegen.h"
+#include "vm.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Снимки состояния виртуальной машины (cmilan --run --checkpoint FILE).
+//
+// Снимок содержит все, что нужно для продолжения выполнения остановленной машины:
+// адрес следующей инструкции, стек, память данных, количество прочитанных значений
+// ввода и количество выполненных инструкций. Вывод, напечатанный до снимка, в него
+// не входит: он уже выдан.
+//
+// Формат файла (порядок байтов машины, на которой запускается cmilan):
+//    заголовок SnapshotHeader;
+//    stackDepth 32-битных слов стека от дна к вершине;
+//    memorySize 32-битных слов памяти данных.
+// Заголовок хранит контрольную сумму программы, поэтому снимок нельзя применить
+// к другой программе (или к той же, скомпилированной с другими параметрами).
+// Снимок записывается во временный файл, который затем переименовывается, так что
+// файл снимка всегда содержит целый снимок. При восстановлении файл отображается
+// в память (mmap), и стек и память машины копируются прямо из отображения.
+
+// Запись снимка машины, остановленной вызовом resume. При ошибке печатает сообщение
+// и возвращает false.
+bool saveSnapshot(const string& file, const vector<Command>& program, const VirtualMachine& vm);
+
+// Восстановление машины из снимка. Значения ввода, прочитанные до снимка, пропускаются
+// (см. VirtualMachine::restore). При ошибке печатает сообщение и возвращает false.
+bool loadSnapshot(const string& file, const vector<Command>& program, VirtualMachine& vm);
+
+#endif
@@ -0,0 +1,143 @@
+#include "stats.h"
+#include <cstdio>
+#include <sys/resource.h>
+#include <time.h>
+
+static const char* phaseNames[PHASE_COUNT] = {
+	"parse", "lex", "optimize", "fuse", "emit", "run"
+};
+
+static const char* statementNames[STATEMENT_COUNT] = {
+	"assignment", "if", "while", "write", "declaration", "invalid"
+};
+
+// Показания часов clock, с
+static double seconds(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Время в миллисекундах с тремя знаками после запятой
+static void printMilliseconds(ostream& os, double time)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.3f", time * 1000);
+	os << buffer;
+}
+
+CompileStats::CompileStats()
+	: tokens(0), identifiers(0), keywords(0), literals(0), symbolLookups(0), variables(0),
+	  emitted(0), backpatches(0), inserts(0)
+{
+	for(int p = 0; p < PHASE_COUNT; ++p) {
+		wall[p] = 0;
+		cpu[p] = p == PHASE_LEX ? -1 : 0;
+	}
+	for(int k = 0; k < STATEMENT_COUNT; ++k) {
+		statements[k] = 0;
+		statementCode[k] = 0;
+	}
+}
+
+void CompileStats::printTimes(ostream& os) const
+{
+	os << "phase\twall ms\tcpu ms" << endl;
+	for(int p = 0; p < PHASE_COUNT; ++p) {
+		if(wall[p] == 0) {
+			continue;
+		}
+		os << (p == PHASE_LEX ? "  " : "") << phaseNames[p] << "\t";
+		printMilliseconds(os, wall[p]);
+		os << "\t";
+		if(cpu[p] < 0) {
+			os << "-";
+		}
+		else {
+			printMilliseconds(os, cpu[p]);
+		}
+		os << endl;
+	}
+}
+
+void CompileStats::printCounters(ostream& os) const
+{
+	os << "tokens: " << tokens << " (identifiers " << identifiers << ", keywords " << keywords
+		<< ", literals " << literals << ")" << endl;
+	os << "symbol lookups: " << symbolLookups << " (variables " << variables << ")" << endl;
+	os << "instructions: " << emitted << " emitted, " << backpatches << " backpatched, "
+		<< inserts << " inserted" << endl;
+	os << "statement\tcount\tinstructions" << endl;
+	for(int k = 0; k < STATEMENT_COUNT; ++k) {
+		if(statements[k] > 0) {
+			os << statementNames[k] << "\t" << statements[k] << "\t" << statementCode[k] << endl;
+		}
+	}
+	os << "peak memory: " << peakMemory() << " KB" << endl;
+}
+
+void CompileStats::printJson(ostream& os) const
+{
+	os << "{" << endl << "  \"phases\": {";
+	bool first = true;
+	for(int p = 0; p < PHASE_COUNT; ++p) {
+		if(wall[p] == 0) {
+			continue;
+		}
+		os << (first ? "" : ",") << endl << "    \"" << phaseNames[p] << "\": {\"wall_ms\": ";
+		printMilliseconds(os, wall[p]);
+		if(cpu[p] >= 0) {
+			os << ", \"cpu_ms\": ";
+			printMilliseconds(os, cpu[p]);
+		}
+		os << "}";
+		first = false;
+	}
+	os << endl << "  }," << endl;
+	os << "  \"tokens\": " << tokens << "," << endl;
+	os << "  \"identifiers\": " << identifiers << "," << endl;
+	os << "  \"keywords\": " << keywords << "," << endl;
+	os << "  \"literals\": " << literals << "," << endl;
+	os << "  \"symbol_lookups\": " << symbolLookups << "," << endl;
+	os << "  \"variables\": " << variables << "," << endl;
+	os << "  \"instructions_emitted\": " << emitted << "," << endl;
+	os << "  \"backpatches\": " << backpatches << "," << endl;
+	os << "  \"inserts\": " << inserts << "," << endl;
+	os << "  \"statements\": {";
+	for(int k = 0; k < STATEMENT_COUNT; ++k) {
+		os << (k > 0 ? "," : "") << endl << "    \"" << statementNames[k] << "\": {\"count\": "
+			<< statements[k] << ", \"instructions\": " << statementCode[k] << "}";
+	}
+	os << endl << "  }," << endl;
+	os << "  \"peak_memory_kb\": " << peakMemory() << endl;
+	os << "}" << endl;
+}
+
+PhaseTimer::PhaseTimer(CompileStats* stats, CompilePhase phase, bool measureCpu)
+	: stats_(stats), phase_(phase), measureCpu_(measureCpu), wall_(0), cpu_(0)
+{
+	if(stats_) {
+		wall_ = seconds(CLOCK_MONOTONIC);
+		if(measureCpu_) {
+			cpu_ = seconds(CLOCK_PROCESS_CPUTIME_ID);
+		}
+	}
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	if(stats_) {
+		stats_->wall[phase_] += seconds(CLOCK_MONOTONIC) - wall_;
+		if(measureCpu_) {
+			stats_->cpu[phase_] += seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu_;
+		}
+	}
+}
+
+long peakMemory()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
@@ -0,0 +1,90 @@
+#ifndef CMILAN_STATS_H
+#define CMILAN_STATS_H
+
+#include <iostream>
+
+using namespace std;
+
+// Статистика компиляции (cmilan --time-report, --stats, --stats-json FILE).
+//
+// Счетчики и таймеры заполняются, только если парсеру передан объект CompileStats;
+// иначе каждая точка учета стоит одной проверки указателя. Время лексического
+// анализа измеряется вокруг каждого вызова Scanner::nextToken и входит во время
+// разбора; для него считается только астрономическое время: процессорное время
+// процесса читается системным вызовом, который дороже разбора одной лексемы.
+
+// Фазы работы компилятора
+enum CompilePhase
+{
+	PHASE_PARSE,        // разбор и порождение кода (Parser::compile)
+	PHASE_LEX,          // лексический анализ (часть PHASE_PARSE)
+	PHASE_OPTIMIZE,     // оптимизация и расположение блоков по профилю
+	PHASE_FUSE,         // подстановка суперинструкций
+	PHASE_EMIT,         // печать программы (CodeGen::flush)
+	PHASE_RUN,          // выполнение
+
+	PHASE_COUNT         // количество фаз (само фазой не является)
+};
+
+// Виды операторов
+enum StatementKind
+{
+	STATEMENT_ASSIGN,   // присваивание
+	STATEMENT_IF,       // if
+	STATEMENT_WHILE,    // while
+	STATEMENT_WRITE,    // write
+	STATEMENT_DECLARE,  // объявление массива
+	STATEMENT_INVALID,  // ошибочный оператор
+
+	STATEMENT_COUNT     // количество видов (само видом не является)
+};
+
+struct CompileStats
+{
+	CompileStats();
+
+	double wall[PHASE_COUNT];                   // астрономическое время фаз, с
+	double cpu[PHASE_COUNT];                    // процессорное время фаз, с (-1 - не измеряется)
+	long long tokens;                           // прочитано лексем
+	long long identifiers;                      // из них идентификаторов
+	long long keywords;                         // ключевых слов (включая имена типов)
+	long long literals;                         // числовых, комплексных и логических литералов
+	long long symbolLookups;                    // поисков в таблице переменных
+	long long variables;                        // добавленных переменных
+	long long emitted;                          // инструкций, добавленных в конец программы
+	long long backpatches;                      // инструкций, записанных по адресу (emitAt)
+	long long inserts;                          // инструкций, вставленных в середину (insert)
+	long long statements[STATEMENT_COUNT];      // операторов каждого вида
+	long long statementCode[STATEMENT_COUNT];   // инструкций, порожденных операторами каждого
+	                                            // вида (без вложенных операторов)
+
+	// Печать времени фаз
+	void printTimes(ostream& os) const;
+
+	// Печать счетчиков и наибольшего объема памяти процесса
+	void printCounters(ostream& os) const;
+
+	// Печать времени фаз и счетчиков одним объектом JSON
+	void printJson(ostream& os) const;
+};
+
+// Измерение времени фазы: время от создания объекта до его уничтожения добавляется
+// к времени фазы. Если stats равен 0, ничего не измеряется.
+class PhaseTimer
+{
+public:
+	PhaseTimer(CompileStats* stats, CompilePhase phase, bool measureCpu = true);
+	~PhaseTimer();
+
+private:
+	CompileStats* stats_;
+	CompilePhase phase_;
+	bool measureCpu_;
+	double wall_;
+	double cpu_;
+};
+
+// Наибольший объем памяти, занимавшийся процессом, КБ
+long peakMemory();
+
+#endif
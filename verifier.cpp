@@ -0,0 +1,116 @@
+#include "verifier.h"
+#include "vm.h"
+#include <algorithm>
+
+// Запись сведений об ошибке. Всегда возвращает false.
+static bool reject(ProgramInfo& info, int address, const string& message)
+{
+	info.errorAddress = address;
+	info.error = message;
+	return false;
+}
+
+// Наименьший адрес памяти, к которому обращается инструкция, или 0
+static int lowestAddress(const Command& c)
+{
+	switch(c.getInstruction()) {
+		case LOAD:
+		case STORE:
+		case BLOAD:
+		case BSTORE:
+		case BLOAD_UNCHECKED:
+		case BSTORE_UNCHECKED:
+		case LOAD_PUSH:
+		case LOAD_ADD:
+		case LOAD_SUB:
+		case LOAD_MULT:
+		case INCR:
+			return c.getArg();
+
+		case LOAD2:
+		case LOAD_STORE:
+		case STORE2:
+			return min(c.getArg(), c.getArg2());
+
+		case PUSH_STORE:
+			return c.getArg2();
+
+		case ADD3:
+		case SUB3:
+		case MULT3:
+			return min(c.getArg(), min(c.getArg2(), c.getArg3()));
+
+		default:
+			return 0;
+	}
+}
+
+bool verifyProgram(const vector<Command>& program, ProgramInfo& info)
+{
+	int size = program.size();
+	info.stackDepth.assign(size, -1);
+	info.maxStackDepth = 0;
+	info.memorySize = requiredMemorySize(program);
+	info.errorAddress = -1;
+	info.error.clear();
+
+	if(size == 0) {
+		return reject(info, 0, "empty program");
+	}
+
+	vector<int> work;
+	info.stackDepth[0] = 0;
+	work.push_back(0);
+	while(!work.empty()) {
+		int i = work.back();
+		work.pop_back();
+
+		const Command& c = program[i];
+		Instruction instruction = c.getInstruction();
+		int depth = info.stackDepth[i];
+		if(instruction < NOP || instruction >= INSTRUCTION_COUNT) {
+			return reject(info, i, "illegal instruction");
+		}
+		if(depth < instructionPops(instruction)) {
+			return reject(info, i, "stack underflow");
+		}
+		if(lowestAddress(c) < 0) {
+			return reject(info, i, "memory address out of range");
+		}
+		if(isIndexed(instruction) && c.getArg2() < 1) {
+			return reject(info, i, "invalid array size");
+		}
+
+		// DUP снимает слово и кладет две его копии, поэтому наибольшая глубина
+		// достигается после инструкции
+		int after = depth - instructionPops(instruction) + instructionPushes(instruction);
+		info.maxStackDepth = max(info.maxStackDepth, max(depth, after));
+
+		int next[2];
+		int count = 0;
+		if(isJump(instruction)) {
+			int target = c.getJumpTarget();
+			if(target < 0 || target >= size) {
+				return reject(info, i, "jump out of program");
+			}
+			next[count++] = target;
+		}
+		if(instruction != JUMP && instruction != STOP) {
+			if(i + 1 >= size) {
+				return reject(info, i, "execution continues past the end of program");
+			}
+			next[count++] = i + 1;
+		}
+
+		for(int k = 0; k < count; ++k) {
+			if(info.stackDepth[next[k]] < 0) {
+				info.stackDepth[next[k]] = after;
+				work.push_back(next[k]);
+			}
+			else if(info.stackDepth[next[k]] != after) {
+				return reject(info, next[k], "inconsistent stack depth");
+			}
+		}
+	}
+	return true;
+}
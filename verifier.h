@@ -0,0 +1,41 @@
+#ifndef CMILAN_VERIFIER_H
+#define CMILAN_VERIFIER_H
+
+#include "codegen.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Статическая проверка программы.
+//
+// Проверка проходит по всем путям выполнения программы и вычисляет глубину стека
+// перед каждой инструкцией. Программа корректна, если:
+//    - глубина стека в каждой точке одинакова на всех путях, ведущих в эту точку,
+//      и ни одна инструкция не снимает со стека больше слов, чем в нем есть;
+//    - все переходы ведут на инструкции программы, а выполнение не может выйти
+//      за последнюю инструкцию (каждый путь заканчивается инструкцией STOP);
+//    - все адреса памяти в инструкциях неотрицательны, то есть лежат в области
+//      переменных, массивов и временных ячеек размером memorySize;
+//    - размер массива в каждом обращении к элементу положителен.
+//
+// Для корректной программы машине не нужно проверять во время выполнения адреса
+// переходов и переполнение стека: стек можно выделить заранее размером maxStackDepth.
+// Проверяются только индексы BLOAD/BSTORE (они известны лишь во время выполнения),
+// деление на ноль и ввод.
+
+// Сведения о программе, полученные проверкой
+struct ProgramInfo
+{
+	vector<int> stackDepth; // глубина стека перед каждой инструкцией (-1 - инструкция недостижима)
+	int maxStackDepth;      // наибольшая глубина стека
+	int memorySize;         // размер памяти данных (см. requiredMemorySize)
+	int errorAddress;       // адрес инструкции, на которой проверка не прошла
+	string error;           // описание ошибки
+};
+
+// Проверка программы. Возвращает false, если программа некорректна; в этом случае
+// в info записываются адрес и описание первой найденной ошибки.
+bool verifyProgram(const vector<Command>& program, ProgramInfo& info);
+
+#endif
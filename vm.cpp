@@ -0,0 +1,1048 @@
+#include "vm.h"
+#include "verifier.h"
+#include <algorithm>
+#include <climits>
+#include <sstream>
+
+VirtualMachine::VirtualMachine(const vector<Command>& program, istream& input, ostream& output)
+	: program_(program), reader_(input), writer_(output),
+	  executed_(0), instructionCounts_(0),
+	  errors_(&cerr), verifiedDepth_(-2), pc_(0), sp_(0), inputQueue_(0),
+	  inputClosed_(false), inputPosition_(0), stackCaching_(false)
+{
+}
+
+int requiredMemorySize(const vector<Command>& program)
+{
+	int size = 0;
+	for(size_t i = 0; i < program.size(); ++i) {
+		const Command& c = program[i];
+		int address = -1;
+		switch(c.getInstruction()) {
+			case LOAD:
+			case STORE:
+			case LOAD_PUSH:
+			case LOAD_ADD:
+			case LOAD_SUB:
+			case LOAD_MULT:
+				address = c.getArg();
+				break;
+
+			case LOAD2:
+			case LOAD_STORE:
+			case STORE2:
+				address = max(c.getArg(), c.getArg2());
+				break;
+
+			case PUSH_STORE:
+				address = c.getArg2();
+				break;
+
+			case INCR:
+				address = c.getArg();
+				break;
+
+			case BLOAD:
+			case BSTORE:
+			case BLOAD_UNCHECKED:
+			case BSTORE_UNCHECKED:
+				address = c.getArg() + c.getArg2() - 1;
+				break;
+
+			case ADD3:
+			case SUB3:
+			case MULT3:
+				address = max(c.getArg(), max(c.getArg2(), c.getArg3()));
+				break;
+
+			default:
+				break;
+		}
+		if(address + 1 > size) {
+			size = address + 1;
+		}
+	}
+	return size;
+}
+
+RunStatus VirtualMachine::fail(int address, const string& message)
+{
+	// Вывод, напечатанный до ошибки, должен оказаться перед сообщением
+	writer_.flush();
+	*errors_ << "Runtime error at " << address << ": " << message << endl;
+	return RUN_FAILED;
+}
+
+bool VirtualMachine::run()
+{
+	reset();
+	return resume(LLONG_MAX) == RUN_FINISHED;
+}
+
+void VirtualMachine::reset()
+{
+	if(verifiedDepth_ == -2) {
+		ProgramInfo info;
+		verifiedDepth_ = verifyProgram(program_, info) ? info.maxStackDepth : -1;
+	}
+	memory_.assign(requiredMemorySize(program_), 0);
+	stack_.assign(verifiedDepth_ >= 0 ? verifiedDepth_ + 2 : 16, 0);
+	executed_ = 0;
+	pc_ = 0;
+	sp_ = 0;
+	inputPosition_ = 0;
+	reader_.discard();
+}
+
+bool VirtualMachine::restore(int pc, const int* stack, int depth, const int* memory, int memorySize,
+	long long inputPosition, long long executed)
+{
+	reset();
+	if(pc < 0 || pc >= (int) program_.size() || depth < 0 || inputPosition < 0
+		|| (verifiedDepth_ >= 0 && depth > verifiedDepth_) || memorySize != (int) memory_.size()) {
+		return false;
+	}
+
+	if(depth + 2 > (int) stack_.size()) {
+		stack_.resize(depth + 2, 0);
+	}
+	copy(stack, stack + depth, stack_.begin() + 1);
+	copy(memory, memory + memorySize, memory_.begin());
+
+	// Значения, прочитанные до снимка, пропускаются
+	if(!inputQueue_) {
+		int value;
+		for(long long k = 0; k < inputPosition; ++k) {
+			if(!reader_.read(value)) {
+				return false;
+			}
+		}
+	}
+	pc_ = pc;
+	sp_ = depth;
+	executed_ = executed;
+	inputPosition_ = inputPosition;
+	return true;
+}
+
+RunStatus VirtualMachine::readInput(int& value)
+{
+	if(!inputQueue_) {
+		if(!reader_.read(value)) {
+			return RUN_FAILED;
+		}
+	}
+	else if(inputQueue_->empty()) {
+		return inputClosed_ ? RUN_FAILED : RUN_WAITING_INPUT;
+	}
+	else {
+		value = inputQueue_->front();
+		inputQueue_->pop_front();
+	}
+	++inputPosition_;
+	return RUN_FINISHED;
+}
+
+RunStatus VirtualMachine::resume(long long budget)
+{
+	RunStatus status;
+	if(verifiedDepth_ >= 0 && stackCaching_ && !instructionCounts_) {
+		status = executeCached(budget);
+	}
+	else if(verifiedDepth_ >= 0) {
+		status = execute<false>(budget);
+	}
+	else {
+		status = execute<true>(budget);
+	}
+	if(status == RUN_FINISHED || status == RUN_FAILED) {
+		writer_.flush();
+	}
+	else {
+		writer_.sync();
+	}
+	return status;
+}
+
+template<bool checked>
+RunStatus VirtualMachine::execute(long long budget)
+{
+	int size = program_.size();
+	int* s = &stack_[1];
+	int sp = sp_;
+
+	long long executed = 0;
+	long long* counts = instructionCounts_ ? &(*instructionCounts_)[0] : 0;
+	int pc = pc_;
+	while(true) {
+		if(checked && (pc < 0 || pc >= size)) {
+			return suspend(executed, pc, sp, fail(pc, "jump out of program"));
+		}
+
+		const Command& c = program_[pc];
+		Instruction instruction = c.getInstruction();
+		if(checked) {
+			if(sp < instructionPops(instruction)) {
+				return suspend(executed, pc, sp, fail(pc, "stack underflow"));
+			}
+			if(sp + 3 >= (int) stack_.size()) {
+				stack_.resize(stack_.size() * 2);
+				s = &stack_[1];
+			}
+		}
+
+		++executed;
+		if(counts) {
+			++counts[pc];
+		}
+
+		int next = pc + 1;
+		int right, left;
+		RunStatus status;
+		switch(instruction) {
+			case NOP:
+				break;
+
+			case STOP:
+				return suspend(executed, pc, sp, RUN_FINISHED);
+
+			case LOAD:
+				s[sp++] = memory_[c.getArg()];
+				break;
+
+			case STORE:
+				memory_[c.getArg()] = s[--sp];
+				break;
+
+			case BLOAD:
+				right = s[sp - 1];
+				if((unsigned) right >= (unsigned) c.getArg2()) {
+					return suspend(executed, pc, sp, fail(pc, "array index out of range"));
+				}
+				s[sp - 1] = memory_[c.getArg() + right];
+				break;
+
+			case BSTORE:
+				right = s[sp - 1];
+				if((unsigned) right >= (unsigned) c.getArg2()) {
+					return suspend(executed, pc, sp, fail(pc, "array index out of range"));
+				}
+				--sp;
+				memory_[c.getArg() + right] = s[--sp];
+				break;
+
+			case BLOAD_UNCHECKED:
+				left = c.getArg() + s[sp - 1];
+				if(checked && (left < 0 || left >= (int) memory_.size())) {
+					return suspend(executed, pc, sp, fail(pc, "memory address out of range"));
+				}
+				s[sp - 1] = memory_[left];
+				break;
+
+			case BSTORE_UNCHECKED:
+				left = c.getArg() + s[sp - 1];
+				if(checked && (left < 0 || left >= (int) memory_.size())) {
+					return suspend(executed, pc, sp, fail(pc, "memory address out of range"));
+				}
+				--sp;
+				memory_[left] = s[--sp];
+				break;
+
+			case PUSH:
+				s[sp++] = c.getArg();
+				break;
+
+			case POP:
+				--sp;
+				break;
+
+			case DUP:
+				s[sp] = s[sp - 1];
+				++sp;
+				break;
+
+			case ADD:
+				right = s[--sp];
+				s[sp - 1] = addValues(s[sp - 1], right);
+				break;
+
+			case SUB:
+				right = s[--sp];
+				s[sp - 1] = subtractValues(s[sp - 1], right);
+				break;
+
+			case MULT:
+				right = s[--sp];
+				s[sp - 1] = multiplyValues(s[sp - 1], right);
+				break;
+
+			case DIV:
+				right = s[sp - 1];
+				if(right == 0) {
+					return suspend(executed, pc, sp, fail(pc, "division by zero"));
+				}
+				--sp;
+				s[sp - 1] = divideValues(s[sp - 1], right);
+				break;
+
+			case INVERT:
+				s[sp - 1] = negateValue(s[sp - 1]);
+				break;
+
+			case COMPARE:
+				right = s[--sp];
+				s[sp - 1] = compareValues(c.getArg(), s[sp - 1], right);
+				break;
+
+			case JUMP:
+				next = c.getArg();
+				if(next <= pc && executed >= budget) {
+					return suspend(executed, next, sp, RUN_PREEMPTED);
+				}
+				break;
+
+			case JUMP_YES:
+				if(s[sp - 1] != 0) {
+					next = c.getArg();
+				}
+				--sp;
+				if(next <= pc && executed >= budget) {
+					return suspend(executed, next, sp, RUN_PREEMPTED);
+				}
+				break;
+
+			case JUMP_NO:
+				if(s[sp - 1] == 0) {
+					next = c.getArg();
+				}
+				--sp;
+				if(next <= pc && executed >= budget) {
+					return suspend(executed, next, sp, RUN_PREEMPTED);
+				}
+				break;
+
+			case INPUT:
+				status = readInput(left);
+				if(status == RUN_WAITING_INPUT) {
+					if(counts) {
+						--counts[pc];
+					}
+					// INPUT будет выполнена заново при следующем вызове
+					suspend(executed, pc, sp, RUN_WAITING_INPUT);
+					--executed_;
+					return RUN_WAITING_INPUT;
+				}
+				if(status == RUN_FAILED) {
+					return suspend(executed, pc, sp, fail(pc, "integer input expected"));
+				}
+				s[sp++] = left;
+				break;
+
+			case PRINT:
+				writer_.write(s[sp - 1]);
+				--sp;
+				break;
+
+			case AND:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] != 0 && right != 0);
+				break;
+
+			case OR:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] != 0 || right != 0);
+				break;
+
+			case NOT:
+				s[sp - 1] = (s[sp - 1] == 0);
+				break;
+
+			case XOR:
+				right = s[--sp];
+				s[sp - 1] = ((s[sp - 1] != 0) != (right != 0));
+				break;
+
+			case IMPLIES:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] == 0 || right != 0);
+				break;
+
+			case LOAD2:
+				s[sp++] = memory_[c.getArg()];
+				s[sp++] = memory_[c.getArg2()];
+				break;
+
+			case LOAD_PUSH:
+				s[sp++] = memory_[c.getArg()];
+				s[sp++] = c.getArg2();
+				break;
+
+			case LOAD_ADD:
+				s[sp - 1] = addValues(s[sp - 1], memory_[c.getArg()]);
+				break;
+
+			case LOAD_SUB:
+				s[sp - 1] = subtractValues(s[sp - 1], memory_[c.getArg()]);
+				break;
+
+			case LOAD_MULT:
+				s[sp - 1] = multiplyValues(s[sp - 1], memory_[c.getArg()]);
+				break;
+
+			case PUSH_ADD:
+				s[sp - 1] = addValues(s[sp - 1], c.getArg());
+				break;
+
+			case PUSH_SUB:
+				s[sp - 1] = subtractValues(s[sp - 1], c.getArg());
+				break;
+
+			case PUSH_MULT:
+				s[sp - 1] = multiplyValues(s[sp - 1], c.getArg());
+				break;
+
+			case PUSH_COMPARE:
+				s[sp - 1] = compareValues(c.getArg2(), s[sp - 1], c.getArg());
+				break;
+
+			case COMPARE_JUMP_NO:
+				right = s[--sp];
+				if(!compareValues(c.getArg(), s[sp - 1], right)) {
+					next = c.getArg2();
+				}
+				--sp;
+				if(next <= pc && executed >= budget) {
+					return suspend(executed, next, sp, RUN_PREEMPTED);
+				}
+				break;
+
+			case LOAD_STORE:
+				memory_[c.getArg2()] = memory_[c.getArg()];
+				break;
+
+			case PUSH_STORE:
+				memory_[c.getArg2()] = c.getArg();
+				break;
+
+			case STORE2:
+				memory_[c.getArg()] = s[--sp];
+				memory_[c.getArg2()] = s[--sp];
+				break;
+
+			case INCR:
+				memory_[c.getArg()] = addValues(memory_[c.getArg()], c.getArg2());
+				break;
+
+			case ADD3:
+				memory_[c.getArg3()] = addValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			case SUB3:
+				memory_[c.getArg3()] = subtractValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			case MULT3:
+				memory_[c.getArg3()] = multiplyValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			default:
+				return suspend(executed, pc, sp, fail(pc, "illegal instruction"));
+		}
+
+		pc = next;
+	}
+}
+
+// Ключи диспетчеризации executeCached: инструкция плюс состояние кэша
+// (0, CACHED1 - одно слово в a, CACHED2 - два слова, вершина в b)
+const int CACHED1 = INSTRUCTION_COUNT;
+const int CACHED2 = 2 * INSTRUCTION_COUNT;
+
+// Выгрузка кэшированных слов в массив стека s глубины sp. Возвращает новую глубину.
+static inline int spillCache(int* s, int sp, int cache, int a, int b)
+{
+	if(cache != 0) {
+		s[sp++] = a;
+	}
+	if(cache == CACHED2) {
+		s[sp++] = b;
+	}
+	return sp;
+}
+
+RunStatus VirtualMachine::executeCached(long long budget)
+{
+	int* s = &stack_[1];
+	int sp = sp_;
+	int cache = 0;
+	int a = 0, b = 0;
+
+	long long executed = 0;
+	int pc = pc_;
+	while(true) {
+		// Счетчик сразу указывает на следующую инструкцию, выполняемая лежит по адресу pc - 1.
+		// Переход назад - переход на адрес меньше pc.
+		const Command& c = program_[pc++];
+		Instruction instruction = c.getInstruction();
+
+		++executed;
+
+		int right, left;
+		RunStatus status;
+		switch(instruction + cache) {
+			// Инструкции, не работающие со стеком, одинаковы во всех состояниях
+			case NOP:
+			case NOP + CACHED1:
+			case NOP + CACHED2:
+				break;
+
+			case STOP:
+			case STOP + CACHED1:
+			case STOP + CACHED2:
+				return suspend(executed, pc - 1, spillCache(s, sp, cache, a, b), RUN_FINISHED);
+
+			case JUMP:
+			case JUMP + CACHED1:
+			case JUMP + CACHED2:
+				if(c.getArg() < pc && executed >= budget) {
+					return suspend(executed, c.getArg(), spillCache(s, sp, cache, a, b), RUN_PREEMPTED);
+				}
+				pc = c.getArg();
+				break;
+
+			case LOAD_STORE:
+			case LOAD_STORE + CACHED1:
+			case LOAD_STORE + CACHED2:
+				memory_[c.getArg2()] = memory_[c.getArg()];
+				break;
+
+			case PUSH_STORE:
+			case PUSH_STORE + CACHED1:
+			case PUSH_STORE + CACHED2:
+				memory_[c.getArg2()] = c.getArg();
+				break;
+
+			case INCR:
+			case INCR + CACHED1:
+			case INCR + CACHED2:
+				memory_[c.getArg()] = addValues(memory_[c.getArg()], c.getArg2());
+				break;
+
+			case ADD3:
+			case ADD3 + CACHED1:
+			case ADD3 + CACHED2:
+				memory_[c.getArg3()] = addValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			case SUB3:
+			case SUB3 + CACHED1:
+			case SUB3 + CACHED2:
+				memory_[c.getArg3()] = subtractValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			case MULT3:
+			case MULT3 + CACHED1:
+			case MULT3 + CACHED2:
+				memory_[c.getArg3()] = multiplyValues(memory_[c.getArg()], memory_[c.getArg2()]);
+				break;
+
+			// Загрузка слова: кэш заполняется, а при полном кэше нижнее слово уходит в массив
+			case LOAD:
+				a = memory_[c.getArg()];
+				cache = CACHED1;
+				break;
+
+			case LOAD + CACHED1:
+				b = memory_[c.getArg()];
+				cache = CACHED2;
+				break;
+
+			case LOAD + CACHED2:
+				s[sp++] = a;
+				a = b;
+				b = memory_[c.getArg()];
+				break;
+
+			case PUSH:
+				a = c.getArg();
+				cache = CACHED1;
+				break;
+
+			case PUSH + CACHED1:
+				b = c.getArg();
+				cache = CACHED2;
+				break;
+
+			case PUSH + CACHED2:
+				s[sp++] = a;
+				a = b;
+				b = c.getArg();
+				break;
+
+			case LOAD2:
+				a = memory_[c.getArg()];
+				b = memory_[c.getArg2()];
+				cache = CACHED2;
+				break;
+
+			case LOAD2 + CACHED1:
+				s[sp++] = a;
+				a = memory_[c.getArg()];
+				b = memory_[c.getArg2()];
+				cache = CACHED2;
+				break;
+
+			case LOAD2 + CACHED2:
+				s[sp++] = a;
+				s[sp++] = b;
+				a = memory_[c.getArg()];
+				b = memory_[c.getArg2()];
+				break;
+
+			case LOAD_PUSH:
+				a = memory_[c.getArg()];
+				b = c.getArg2();
+				cache = CACHED2;
+				break;
+
+			case LOAD_PUSH + CACHED1:
+				s[sp++] = a;
+				a = memory_[c.getArg()];
+				b = c.getArg2();
+				cache = CACHED2;
+				break;
+
+			case LOAD_PUSH + CACHED2:
+				s[sp++] = a;
+				s[sp++] = b;
+				a = memory_[c.getArg()];
+				b = c.getArg2();
+				break;
+
+			// Снятие слова
+			case STORE:
+				memory_[c.getArg()] = s[--sp];
+				break;
+
+			case STORE + CACHED1:
+				memory_[c.getArg()] = a;
+				cache = 0;
+				break;
+
+			case STORE + CACHED2:
+				memory_[c.getArg()] = b;
+				cache = CACHED1;
+				break;
+
+			case STORE2 + CACHED2:
+				memory_[c.getArg()] = b;
+				memory_[c.getArg2()] = a;
+				cache = 0;
+				break;
+
+			case POP:
+				--sp;
+				break;
+
+			case POP + CACHED1:
+				cache = 0;
+				break;
+
+			case POP + CACHED2:
+				cache = CACHED1;
+				break;
+
+			// После вызовов функций a и b перезаписываются: тогда их старые значения
+			// не живут во время вызова, и компилятор держит a и b в регистрах, а не
+			// в памяти. Поэтому PRINT с двумя кэшированными словами выгружает кэш.
+			case PRINT:
+				writer_.write(s[--sp]);
+				a = b = 0;
+				break;
+
+			case PRINT + CACHED1:
+				writer_.write(a);
+				cache = 0;
+				a = b = 0;
+				break;
+
+			case JUMP_YES:
+			case JUMP_NO:
+				left = s[--sp];
+				if((left != 0) == (instruction == JUMP_YES)) {
+					if(c.getArg() < pc && executed >= budget) {
+						return suspend(executed, c.getArg(), sp, RUN_PREEMPTED);
+					}
+					pc = c.getArg();
+				}
+				break;
+
+			case JUMP_YES + CACHED1:
+			case JUMP_NO + CACHED1:
+				cache = 0;
+				if((a != 0) == (instruction == JUMP_YES)) {
+					if(c.getArg() < pc && executed >= budget) {
+						return suspend(executed, c.getArg(), sp, RUN_PREEMPTED);
+					}
+					pc = c.getArg();
+				}
+				break;
+
+			case JUMP_YES + CACHED2:
+			case JUMP_NO + CACHED2:
+				cache = CACHED1;
+				if((b != 0) == (instruction == JUMP_YES)) {
+					if(c.getArg() < pc && executed >= budget) {
+						return suspend(executed, c.getArg(), spillCache(s, sp, cache, a, b), RUN_PREEMPTED);
+					}
+					pc = c.getArg();
+				}
+				break;
+
+			// Двуместные операции: результат остается в a
+			case ADD:
+				right = s[--sp];
+				a = addValues(s[--sp], right);
+				cache = CACHED1;
+				break;
+
+			case ADD + CACHED1:
+				a = addValues(s[--sp], a);
+				break;
+
+			case ADD + CACHED2:
+				a = addValues(a, b);
+				cache = CACHED1;
+				break;
+
+			case SUB:
+				right = s[--sp];
+				a = subtractValues(s[--sp], right);
+				cache = CACHED1;
+				break;
+
+			case SUB + CACHED1:
+				a = subtractValues(s[--sp], a);
+				break;
+
+			case SUB + CACHED2:
+				a = subtractValues(a, b);
+				cache = CACHED1;
+				break;
+
+			case MULT:
+				right = s[--sp];
+				a = multiplyValues(s[--sp], right);
+				cache = CACHED1;
+				break;
+
+			case MULT + CACHED1:
+				a = multiplyValues(s[--sp], a);
+				break;
+
+			case MULT + CACHED2:
+				a = multiplyValues(a, b);
+				cache = CACHED1;
+				break;
+
+			case DIV + CACHED1:
+				if(a == 0) {
+					sp = spillCache(s, sp, cache, a, b);
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "division by zero"));
+				}
+				a = divideValues(s[--sp], a);
+				break;
+
+			case DIV + CACHED2:
+				if(b == 0) {
+					sp = spillCache(s, sp, cache, a, b);
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "division by zero"));
+				}
+				a = divideValues(a, b);
+				cache = CACHED1;
+				break;
+
+			case COMPARE:
+				right = s[--sp];
+				a = compareValues(c.getArg(), s[--sp], right);
+				cache = CACHED1;
+				break;
+
+			case COMPARE + CACHED1:
+				a = compareValues(c.getArg(), s[--sp], a);
+				break;
+
+			case COMPARE + CACHED2:
+				a = compareValues(c.getArg(), a, b);
+				cache = CACHED1;
+				break;
+
+			case COMPARE_JUMP_NO:
+				right = s[--sp];
+				left = s[--sp];
+				if(!compareValues(c.getArg(), left, right)) {
+					if(c.getArg2() < pc && executed >= budget) {
+						return suspend(executed, c.getArg2(), sp, RUN_PREEMPTED);
+					}
+					pc = c.getArg2();
+				}
+				break;
+
+			case COMPARE_JUMP_NO + CACHED1:
+				cache = 0;
+				if(!compareValues(c.getArg(), s[--sp], a)) {
+					if(c.getArg2() < pc && executed >= budget) {
+						return suspend(executed, c.getArg2(), sp, RUN_PREEMPTED);
+					}
+					pc = c.getArg2();
+				}
+				break;
+
+			case COMPARE_JUMP_NO + CACHED2:
+				cache = 0;
+				if(!compareValues(c.getArg(), a, b)) {
+					if(c.getArg2() < pc && executed >= budget) {
+						return suspend(executed, c.getArg2(), sp, RUN_PREEMPTED);
+					}
+					pc = c.getArg2();
+				}
+				break;
+
+			// Операции над вершиной стека: в состоянии 0 результат переходит в кэш
+			case LOAD_ADD:
+				a = addValues(s[--sp], memory_[c.getArg()]);
+				cache = CACHED1;
+				break;
+
+			case LOAD_ADD + CACHED1:
+				a = addValues(a, memory_[c.getArg()]);
+				break;
+
+			case LOAD_ADD + CACHED2:
+				b = addValues(b, memory_[c.getArg()]);
+				break;
+
+			case LOAD_SUB:
+				a = subtractValues(s[--sp], memory_[c.getArg()]);
+				cache = CACHED1;
+				break;
+
+			case LOAD_SUB + CACHED1:
+				a = subtractValues(a, memory_[c.getArg()]);
+				break;
+
+			case LOAD_SUB + CACHED2:
+				b = subtractValues(b, memory_[c.getArg()]);
+				break;
+
+			case LOAD_MULT:
+				a = multiplyValues(s[--sp], memory_[c.getArg()]);
+				cache = CACHED1;
+				break;
+
+			case LOAD_MULT + CACHED1:
+				a = multiplyValues(a, memory_[c.getArg()]);
+				break;
+
+			case LOAD_MULT + CACHED2:
+				b = multiplyValues(b, memory_[c.getArg()]);
+				break;
+
+			case PUSH_ADD:
+				a = addValues(s[--sp], c.getArg());
+				cache = CACHED1;
+				break;
+
+			case PUSH_ADD + CACHED1:
+				a = addValues(a, c.getArg());
+				break;
+
+			case PUSH_ADD + CACHED2:
+				b = addValues(b, c.getArg());
+				break;
+
+			case PUSH_SUB:
+				a = subtractValues(s[--sp], c.getArg());
+				cache = CACHED1;
+				break;
+
+			case PUSH_SUB + CACHED1:
+				a = subtractValues(a, c.getArg());
+				break;
+
+			case PUSH_SUB + CACHED2:
+				b = subtractValues(b, c.getArg());
+				break;
+
+			case PUSH_MULT:
+				a = multiplyValues(s[--sp], c.getArg());
+				cache = CACHED1;
+				break;
+
+			case PUSH_MULT + CACHED1:
+				a = multiplyValues(a, c.getArg());
+				break;
+
+			case PUSH_MULT + CACHED2:
+				b = multiplyValues(b, c.getArg());
+				break;
+
+			case PUSH_COMPARE:
+				a = compareValues(c.getArg2(), s[--sp], c.getArg());
+				cache = CACHED1;
+				break;
+
+			case PUSH_COMPARE + CACHED1:
+				a = compareValues(c.getArg2(), a, c.getArg());
+				break;
+
+			case PUSH_COMPARE + CACHED2:
+				b = compareValues(c.getArg2(), b, c.getArg());
+				break;
+
+			case BLOAD:
+				right = s[sp - 1];
+				if((unsigned) right >= (unsigned) c.getArg2()) {
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "array index out of range"));
+				}
+				--sp;
+				a = memory_[c.getArg() + right];
+				cache = CACHED1;
+				break;
+
+			case BLOAD + CACHED1:
+				if((unsigned) a >= (unsigned) c.getArg2()) {
+					sp = spillCache(s, sp, cache, a, b);
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "array index out of range"));
+				}
+				a = memory_[c.getArg() + a];
+				break;
+
+			case BLOAD + CACHED2:
+				if((unsigned) b >= (unsigned) c.getArg2()) {
+					sp = spillCache(s, sp, cache, a, b);
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "array index out of range"));
+				}
+				b = memory_[c.getArg() + b];
+				break;
+
+			case BLOAD_UNCHECKED:
+				a = memory_[c.getArg() + s[--sp]];
+				cache = CACHED1;
+				break;
+
+			case BLOAD_UNCHECKED + CACHED1:
+				a = memory_[c.getArg() + a];
+				break;
+
+			case BLOAD_UNCHECKED + CACHED2:
+				b = memory_[c.getArg() + b];
+				break;
+
+			// Запись элемента: индекс на вершине, значение под ним
+			case BSTORE + CACHED2:
+				if((unsigned) b >= (unsigned) c.getArg2()) {
+					sp = spillCache(s, sp, cache, a, b);
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "array index out of range"));
+				}
+				memory_[c.getArg() + b] = a;
+				cache = 0;
+				break;
+
+			case BSTORE_UNCHECKED + CACHED2:
+				memory_[c.getArg() + b] = a;
+				cache = 0;
+				break;
+
+			// Редкие инструкции выполняются только в состоянии 0, как в execute
+			case BSTORE:
+				right = s[sp - 1];
+				if((unsigned) right >= (unsigned) c.getArg2()) {
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "array index out of range"));
+				}
+				--sp;
+				memory_[c.getArg() + right] = s[--sp];
+				break;
+
+			case BSTORE_UNCHECKED:
+				left = c.getArg() + s[--sp];
+				memory_[left] = s[--sp];
+				break;
+
+			case STORE2:
+				memory_[c.getArg()] = s[--sp];
+				memory_[c.getArg2()] = s[--sp];
+				break;
+
+			case DUP:
+				s[sp] = s[sp - 1];
+				++sp;
+				break;
+
+			case DIV:
+				right = s[sp - 1];
+				if(right == 0) {
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "division by zero"));
+				}
+				--sp;
+				s[sp - 1] = divideValues(s[sp - 1], right);
+				break;
+
+			case INVERT:
+				s[sp - 1] = negateValue(s[sp - 1]);
+				break;
+
+			case INPUT:
+				status = readInput(left);
+				if(status == RUN_WAITING_INPUT) {
+					// INPUT будет выполнена заново при следующем вызове
+					suspend(executed, pc - 1, sp, RUN_WAITING_INPUT);
+					--executed_;
+					return RUN_WAITING_INPUT;
+				}
+				if(status == RUN_FAILED) {
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "integer input expected"));
+				}
+				a = left;
+				cache = CACHED1;
+				b = 0;
+				break;
+
+			case AND:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] != 0 && right != 0);
+				break;
+
+			case OR:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] != 0 || right != 0);
+				break;
+
+			case NOT:
+				s[sp - 1] = (s[sp - 1] == 0);
+				break;
+
+			case XOR:
+				right = s[--sp];
+				s[sp - 1] = ((s[sp - 1] != 0) != (right != 0));
+				break;
+
+			case IMPLIES:
+				right = s[--sp];
+				s[sp - 1] = (s[sp - 1] == 0 || right != 0);
+				break;
+
+			default:
+				if(cache == 0) {
+					return suspend(executed, pc - 1, sp, fail(pc - 1, "illegal instruction"));
+				}
+				// Кэш выгружается, и инструкция выбирается заново в состоянии 0
+				sp = spillCache(s, sp, cache, a, b);
+				cache = 0;
+				--executed;
+				--pc;
+				continue;
+		}
+
+	}
+}
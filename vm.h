@@ -0,0 +1,281 @@
+#ifndef CMILAN_VM_H
+#define CMILAN_VM_H
+
+#include "codegen.h"
+#include "intio.h"
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Встроенная виртуальная машина Милана.
+//
+// Выполняет программу, сформированную кодогенератором, без печати ее в текстовом виде.
+// Машина стековая: операнды арифметических и логических инструкций снимаются с вершины
+// стека, результат кладется обратно. Память данных - массив слов, размер которого
+// определяется по наибольшему адресу, встречающемуся в программе.
+//
+// Перед первым запуском программа проверяется (см. verifier.h). Для проверенной программы
+// стек выделяется заранее, а адреса переходов и глубина стека во время выполнения
+// не проверяются; иначе проверяются все обращения к стеку и адреса переходов.
+// Проверенную программу можно выполнять с кэшированием вершины стека (setStackCaching).
+// Индексы BLOAD/BSTORE проверяются всегда; BLOAD_UNCHECKED/BSTORE_UNCHECKED проверяются
+// только в непроверенной программе, и то лишь на выход за пределы памяти. При ошибке
+// машина печатает сообщение с адресом инструкции и останавливается.
+//
+// Ввод и вывод буферизуются (см. intio.h): напечатанные числа передаются в поток
+// вывода, когда resume возвращает управление, а поток выталкивается после
+// завершения программы или ошибки.
+
+// Результат выполнения части программы (см. VirtualMachine::resume)
+enum RunStatus
+{
+	RUN_FINISHED,       // выполнена инструкция STOP
+	RUN_FAILED,         // ошибка выполнения
+	RUN_PREEMPTED,      // исчерпан бюджет инструкций
+	RUN_WAITING_INPUT   // INPUT ждет значения в пустой очереди ввода
+};
+
+class VirtualMachine
+{
+public:
+	// Конструктор
+	//    const vector<Command>& program - выполняемая программа
+	//    istream& input - поток, из которого читает инструкция INPUT
+	//    ostream& output - поток, в который печатает инструкция PRINT
+	VirtualMachine(const vector<Command>& program, istream& input, ostream& output);
+
+	// Выполнение программы до инструкции STOP. Возвращает false при ошибке выполнения.
+	bool run();
+
+	// Подготовка к выполнению программы с начала: очистка стека и памяти
+	void reset();
+
+	// Продолжение выполнения с места остановки. Машина останавливается на обратном
+	// переходе, если за этот вызов выполнено не меньше budget инструкций, и на INPUT,
+	// если значения берутся из пустой очереди (см. setInputQueue). Инструкция INPUT
+	// в последнем случае не выполняется и будет выполнена при следующем вызове.
+	RunStatus resume(long long budget);
+
+	// Восстановление состояния машины, остановленной вызовом resume (см. snapshot.h)
+	//    int pc - адрес следующей инструкции
+	//    const int* stack, int depth - слова стека от дна к вершине и их количество
+	//    const int* memory, int memorySize - содержимое памяти данных
+	//    long long inputPosition - количество значений, прочитанных до остановки;
+	//                              при вводе из потока они пропускаются
+	//    long long executed - количество инструкций, выполненных до остановки
+	// Возвращает false, если состояние не подходит к программе или ввод короче inputPosition.
+	bool restore(int pc, const int* stack, int depth, const int* memory, int memorySize,
+		long long inputPosition, long long executed);
+
+	// Адрес инструкции, с которой продолжится выполнение
+	int getProgramCounter() const
+	{
+		return pc_;
+	}
+
+	// Глубина стека
+	int getStackDepth() const
+	{
+		return sp_;
+	}
+
+	// Слова стека от дна к вершине
+	const int* getStack() const
+	{
+		return &stack_[1];
+	}
+
+	// Память данных
+	const vector<int>& getMemory() const
+	{
+		return memory_;
+	}
+
+	// Количество значений, прочитанных инструкциями INPUT с последнего запуска
+	long long getInputPosition() const
+	{
+		return inputPosition_;
+	}
+
+	// Количество выполненных инструкций (диспетчеризаций) с последнего запуска
+	long long getExecutedCount() const
+	{
+		return executed_;
+	}
+
+	// Включение подсчета выполнений по адресам инструкций. Счетчики накапливаются
+	// в переданном массиве размером с программу; 0 отключает подсчет.
+	void setInstructionCounts(vector<long long>* counts)
+	{
+		instructionCounts_ = counts;
+	}
+
+	// Очередь ввода: если задана, INPUT берет значения из нее, а не из потока.
+	// Пустая очередь останавливает машину, пока ввод не закрыт вызовом closeInput.
+	void setInputQueue(deque<int>* queue)
+	{
+		inputQueue_ = queue;
+	}
+
+	// Закрытие ввода: INPUT из пустой очереди становится ошибкой выполнения
+	void closeInput()
+	{
+		inputClosed_ = true;
+	}
+
+	// Поток для сообщений об ошибках выполнения (по умолчанию cerr)
+	void setErrorOutput(ostream& errors)
+	{
+		errors_ = &errors;
+	}
+
+	// Двоичный ввод и вывод: INPUT и PRINT читают и пишут числа по 4 байта
+	void setBinaryIO(bool binary)
+	{
+		reader_.setBinary(binary);
+		writer_.setBinary(binary);
+	}
+
+	// Интерактивный режим: ввод читается по строкам, каждое напечатанное число
+	// сразу выталкивается в поток вывода
+	void setInteractive(bool interactive)
+	{
+		reader_.setInteractive(interactive);
+		writer_.setInteractive(interactive);
+	}
+
+	// Воспроизведение журнала ввода: INPUT берет значения из массива values
+	// (count значений), а не из потока ввода (см. inputlog.h)
+	void setInputReplay(const int* values, size_t count)
+	{
+		reader_.setReplay(values, count);
+	}
+
+	// Запись каждого прочитанного INPUT значения в журнал (0 - не записывать)
+	void setInputRecording(IntegerWriter* recording)
+	{
+		reader_.setRecording(recording);
+	}
+
+	// Кэширование вершины стека: до двух верхних слов стека хранятся в локальных
+	// переменных цикла выполнения (в регистрах процессора). Применяется только
+	// к программам, прошедшим проверку.
+	void setStackCaching(bool enabled)
+	{
+		stackCaching_ = enabled;
+	}
+
+private:
+	// Печать сообщения об ошибке выполнения. Всегда возвращает RUN_FAILED.
+	RunStatus fail(int address, const string& message);
+
+	// Сохранение состояния при остановке цикла выполнения (счетчик инструкций, адрес
+	// и глубина стека в цикле локальные, чтобы компилятор держал их в регистрах).
+	// Возвращает status.
+	RunStatus suspend(long long executed, int pc, int sp, RunStatus status)
+	{
+		executed_ += executed;
+		pc_ = pc;
+		sp_ = sp;
+		return status;
+	}
+
+	// Чтение значения для INPUT из очереди или потока ввода. Возвращает RUN_FINISHED,
+	// если значение прочитано, RUN_WAITING_INPUT, если очередь пуста, и RUN_FAILED,
+	// если ввод исчерпан. Вынесено из цикла выполнения, чтобы не занимать в нем регистры.
+	RunStatus readInput(int& value);
+
+	// Выполнение программы. Если checked = false, программа прошла проверку
+	// (см. verifier.h), и стек уже выделен по наибольшей глубине: адреса переходов,
+	// исчерпание и переполнение стека не проверяются.
+	// Слово стека с номером k хранится в stack_[k + 1].
+	template<bool checked>
+	RunStatus execute(long long budget);
+
+	// Выполнение проверенной программы с кэшированием вершины стека. Состояние кэша -
+	// количество верхних слов стека (0, 1 или 2), хранящихся в переменных a и b
+	// (вершина - в b, если кэшированы два слова, иначе в a); остальные слова лежат
+	// в массиве стека, как в execute. Состояние входит в ключ диспетчеризации, так что
+	// у частых инструкций свой обработчик для каждого состояния; остальные инструкции
+	// выгружают кэш в массив и выполняются в состоянии 0. На входе и при любой
+	// остановке кэш пуст.
+	RunStatus executeCached(long long budget);
+
+	const vector<Command>& program_; // выполняемая программа
+	IntegerReader reader_;           // ввод чисел (из потока ввода)
+	IntegerWriter writer_;           // вывод чисел (в поток вывода)
+	vector<int> stack_;              // стек машины
+	vector<int> memory_;             // память данных
+	long long executed_;             // количество выполненных инструкций
+	vector<long long>* instructionCounts_; // счетчики выполнений по адресам инструкций
+	ostream* errors_;                // поток сообщений об ошибках
+	int verifiedDepth_;              // наибольшая глубина стека проверенной программы
+	                                 // (-1 - проверка не прошла, -2 - еще не проверялась)
+	int pc_;                         // адрес следующей инструкции
+	int sp_;                         // глубина стека
+	deque<int>* inputQueue_;         // очередь ввода (0 - ввод из потока)
+	bool inputClosed_;               // ввод из очереди закрыт
+	long long inputPosition_;        // количество прочитанных значений
+	bool stackCaching_;              // кэширование вершины стека
+};
+
+// Размер памяти данных, необходимый программе: наибольший адрес, к которому
+// обращаются инструкции работы с памятью (для массивов - адрес последнего элемента), плюс один.
+int requiredMemorySize(const vector<Command>& program);
+
+// Вычисление операции сравнения с кодом cmp (см. инструкцию COMPARE). Встраивается
+// в циклы выполнения: вызов функции заставил бы компилятор держать кэшированные слова
+// стека (см. VirtualMachine::executeCached) в памяти, а не в регистрах.
+inline bool compareValues(int cmp, int left, int right)
+{
+	switch(cmp) {
+		case 0:
+			return left == right;
+		case 1:
+			return left != right;
+		case 2:
+			return left < right;
+		case 3:
+			return left > right;
+		case 4:
+			return left <= right;
+		case 5:
+			return left >= right;
+		default:
+			return false;
+	}
+}
+
+// Целочисленная арифметика машин. Сложение, вычитание, умножение и смена знака
+// выполняются по модулю 2^32: переполнение не ошибка, результат берется
+// в дополнительном коде. Деление INT_MIN на -1 по той же причине дает INT_MIN;
+// деление на 0 проверяет вызывающий.
+inline int addValues(int left, int right)
+{
+	return (int) ((unsigned) left + (unsigned) right);
+}
+
+inline int subtractValues(int left, int right)
+{
+	return (int) ((unsigned) left - (unsigned) right);
+}
+
+inline int multiplyValues(int left, int right)
+{
+	return (int) ((unsigned) left * (unsigned) right);
+}
+
+inline int negateValue(int value)
+{
+	return (int) (0u - (unsigned) value);
+}
+
+inline int divideValues(int left, int right)
+{
+	return right == -1 ? negateValue(left) : left / right;
+}
+
+#endif